@@ -3,6 +3,7 @@ include(CheckSymbolExists)
 include(CheckFunctionExists)
 include(CheckLibraryExists)
 include(CheckTypeSize)
+include(CheckStructHasMember)
 include(CheckCXXSourceCompiles)
 
 set(PACKAGE ${APPLICATION_NAME})
@@ -51,6 +52,10 @@ check_function_exists(timegm HAVE_TIMEGM)
 check_function_exists(strerror_r HAVE_STRERROR_R)
 check_function_exists(utimes HAVE_UTIMES)
 check_function_exists(lstat HAVE_LSTAT)
+check_function_exists(fstatat HAVE_FSTATAT)
+check_function_exists(statx HAVE_STATX)
+check_struct_has_member("struct stat" st_mtim sys/stat.h HAVE_STRUCT_STAT_ST_MTIM)
+check_struct_has_member("struct stat" st_mtimespec sys/stat.h HAVE_STRUCT_STAT_ST_MTIMESPEC)
 check_function_exists(asprintf HAVE_ASPRINTF)
 if (WIN32)
 	check_function_exists(__mingw_asprintf HAVE___MINGW_ASPRINTF)
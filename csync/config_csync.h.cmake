@@ -19,6 +19,10 @@
 #cmakedefine HAVE_STRERROR_R 1
 #cmakedefine HAVE_UTIMES 1
 #cmakedefine HAVE_LSTAT 1
+#cmakedefine HAVE_FSTATAT 1
+#cmakedefine HAVE_STATX 1
+#cmakedefine HAVE_STRUCT_STAT_ST_MTIM 1
+#cmakedefine HAVE_STRUCT_STAT_ST_MTIMESPEC 1
 #cmakedefine HAVE_FNMATCH 1
 #cmakedefine HAVE_ICONV 1
 #cmakedefine HAVE_ICONV_CONST 1
@@ -56,37 +56,17 @@
 
 #include "csync_log.h"
 #include "csync_rename.h"
+#include "csync_local_prefetch.h"
+#include "csync_checksum_pool.h"
 #include "c_jhash.h"
 
-static int _key_cmp(const void *key, const void *data) {
-  uint64_t a;
-  csync_file_stat_t *b;
+/* Most entries of a sync end up in the trees and live until csync_commit. Taking them
+ * from big blocks saves a malloc per entry and string, and gives the memory back to the
+ * system in one piece instead of leaving the heap fragmented after big syncs. */
+#define CSYNC_ARENA_BLOCK_SIZE (256 * 1024)
 
-  a = *(uint64_t *) (key);
-  b = (csync_file_stat_t *) data;
-
-  if (a < b->phash) {
-    return -1;
-  } else if (a > b->phash) {
-    return 1;
-  }
-
-  return 0;
-}
-
-static int _data_cmp(const void *key, const void *data) {
-  csync_file_stat_t *a, *b;
-
-  a = (csync_file_stat_t *) key;
-  b = (csync_file_stat_t *) data;
-
-  if (a->phash < b->phash) {
-    return -1;
-  } else if (a->phash > b->phash) {
-    return 1;
-  }
-
-  return 0;
+static uint64_t _tree_key(const void *data) {
+  return ((const csync_file_stat_t *) data)->phash;
 }
 
 void csync_create(CSYNC **csync, const char *local) {
@@ -128,8 +108,9 @@ void csync_init(CSYNC *ctx, const char *db_file) {
   SAFE_FREE(ctx->statedb.file);
   ctx->statedb.file = c_strdup(db_file);
 
-  c_rbtree_create(&ctx->local.tree, _key_cmp, _data_cmp);
-  c_rbtree_create(&ctx->remote.tree, _key_cmp, _data_cmp);
+  c_htable_create(&ctx->local.tree, _tree_key);
+  c_htable_create(&ctx->remote.tree, _tree_key);
+  ctx->arena = c_arena_new(CSYNC_ARENA_BLOCK_SIZE);
 
   ctx->remote.root_perms = 0;
 
@@ -157,18 +138,30 @@ int csync_update(CSYNC *ctx) {
 
   ctx->status_code = CSYNC_STATUS_OK;
 
+  /* Answer the per file lookups of the update and reconcile phases from memory */
+  if (csync_statedb_load_index(ctx) < 0) {
+      CSYNC_LOG(CSYNC_LOG_PRIORITY_WARN, "Could not load the statedb in memory, querying it instead");
+  }
+
   csync_memstat_check();
 
   if (!ctx->excludes) {
       CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG, "No exclude file loaded or defined!");
   }
+  ctx->exclude_matcher = csync_exclude_matcher_new(ctx->excludes);
 
   /* update detection for local replica */
   csync_gettime(&start);
   ctx->current = LOCAL_REPLICA;
   ctx->replica = ctx->local.type;
 
+  if (ctx->local.prefetch_threads > 1) {
+      csync_local_prefetch_start(ctx, ctx->local.prefetch_threads);
+  }
+  /* hashes files until csync_update_resolve_checksums(), along the remote update detection */
+  csync_checksum_pool_start(ctx, ctx->local.checksum_threads);
   rc = csync_ftw(ctx, ctx->local.uri, csync_walker, MAX_DEPTH);
+  csync_local_prefetch_stop(ctx);
   if (rc < 0) {
     if(ctx->status_code == CSYNC_STATUS_OK) {
         ctx->status_code = csync_errno_to_status(errno, CSYNC_STATUS_UPDATE_ERROR);
@@ -180,7 +173,7 @@ int csync_update(CSYNC *ctx) {
 
   CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG,
             "Update detection for local replica took %.2f seconds walking %zu files.",
-            c_secdiff(finish, start), c_rbtree_size(ctx->local.tree));
+            c_secdiff(finish, start), c_htable_size(ctx->local.tree));
   csync_memstat_check();
 
   /* update detection for remote replica */
@@ -201,14 +194,22 @@ int csync_update(CSYNC *ctx) {
   CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG,
             "Update detection for remote replica took %.2f seconds "
             "walking %zu files.",
-            c_secdiff(finish, start), c_rbtree_size(ctx->remote.tree));
+            c_secdiff(finish, start), c_htable_size(ctx->remote.tree));
   csync_memstat_check();
 
+  rc = csync_update_resolve_checksums(ctx);
+  if (rc < 0) {
+      goto out;
+  }
+
   ctx->status |= CSYNC_STATUS_UPDATE;
 
   rc = 0;
 
 out:
+  csync_checksum_pool_stop(ctx);
+  csync_exclude_matcher_free(ctx->exclude_matcher);
+  ctx->exclude_matcher = NULL;
   csync_statedb_close(ctx);
   return rc;
 }
@@ -240,7 +241,7 @@ int csync_reconcile(CSYNC *ctx) {
 
   CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG,
       "Reconciliation for local replica took %.2f seconds visiting %zu files.",
-      c_secdiff(finish, start), c_rbtree_size(ctx->local.tree));
+      c_secdiff(finish, start), c_htable_size(ctx->local.tree));
 
   if (rc < 0) {
       if (!CSYNC_STATUS_IS_OK(ctx->status_code)) {
@@ -261,7 +262,7 @@ int csync_reconcile(CSYNC *ctx) {
 
   CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG,
       "Reconciliation for remote replica took %.2f seconds visiting %zu files.",
-      c_secdiff(finish, start), c_rbtree_size(ctx->remote.tree));
+      c_secdiff(finish, start), c_htable_size(ctx->remote.tree));
 
   if (rc < 0) {
       if (!CSYNC_STATUS_IS_OK(ctx->status_code)) {
@@ -275,6 +276,7 @@ int csync_reconcile(CSYNC *ctx) {
   rc = 0;
 
 out:
+  csync_statedb_free_index(ctx);
   csync_statedb_close(ctx);
   return 0;
 }
@@ -286,11 +288,11 @@ static int _csync_treewalk_visitor(void *obj, void *data) {
     int rc = 0;
     csync_file_stat_t *cur         = NULL;
     CSYNC *ctx                     = NULL;
-    c_rbtree_visit_func *visitor   = NULL;
+    csync_treewalk_visit_func *visitor = NULL;
     _csync_treewalk_context *twctx = NULL;
     TREE_WALK_FILE trav;
-    c_rbtree_t *other_tree = NULL;
-    c_rbnode_t *other_node = NULL;
+    c_htable_t *other_tree = NULL;
+    csync_file_stat_t *other_stat = NULL;
 
     cur = (csync_file_stat_t *) obj;
     ctx = (CSYNC *) data;
@@ -311,9 +313,9 @@ static int _csync_treewalk_visitor(void *obj, void *data) {
         break;
     }
 
-    other_node = c_rbtree_find(other_tree, &cur->phash);
+    other_stat = c_htable_find(other_tree, cur->phash);
 
-    if (!other_node) {
+    if (!other_stat) {
         /* Check the renamed path as well. */
         int len;
         uint64_t h = 0;
@@ -322,12 +324,12 @@ static int _csync_treewalk_visitor(void *obj, void *data) {
         if (!c_streq(renamed_path, cur->path)) {
             len = strlen( renamed_path );
             h = c_jhash64((uint8_t *) renamed_path, len, 0);
-            other_node = c_rbtree_find(other_tree, &h);
+            other_stat = c_htable_find(other_tree, h);
         }
         SAFE_FREE(renamed_path);
     }
 
-    if (!other_node) {
+    if (!other_stat) {
         /* Check the source path as well. */
         int len;
         uint64_t h = 0;
@@ -336,7 +338,7 @@ static int _csync_treewalk_visitor(void *obj, void *data) {
         if (!c_streq(renamed_path, cur->path)) {
             len = strlen( renamed_path );
             h = c_jhash64((uint8_t *) renamed_path, len, 0);
-            other_node = c_rbtree_find(other_tree, &h);
+            other_stat = c_htable_find(other_tree, h);
         }
         SAFE_FREE(renamed_path);
     }
@@ -358,11 +360,14 @@ static int _csync_treewalk_visitor(void *obj, void *data) {
         return 0;
     }
 
-    visitor = (c_rbtree_visit_func*)(twctx->user_visitor);
+    visitor = (csync_treewalk_visit_func*)(twctx->user_visitor);
     if (visitor != NULL) {
       trav.path         = cur->path;
       trav.size         = cur->size;
       trav.modtime      = cur->modtime;
+      trav.modtime_nsec = cur->modtime_nsec;
+      trav.ctime        = cur->ctime;
+      trav.ctime_nsec   = cur->ctime_nsec;
       trav.mode         = cur->mode;
       trav.type         = cur->type;
       trav.instruction  = cur->instruction;
@@ -379,26 +384,33 @@ static int _csync_treewalk_visitor(void *obj, void *data) {
       trav.checksum = cur->checksum;
       trav.checksumTypeId = cur->checksumTypeId;
 
-      if( other_node ) {
-          csync_file_stat_t *other_stat = (csync_file_stat_t*)other_node->data;
+      if( other_stat ) {
           trav.other.etag = other_stat->etag;
           trav.other.file_id = other_stat->file_id;
           trav.other.instruction = other_stat->instruction;
           trav.other.modtime = other_stat->modtime;
+          trav.other.modtime_nsec = other_stat->modtime_nsec;
+          trav.other.ctime = other_stat->ctime;
+          trav.other.ctime_nsec = other_stat->ctime_nsec;
           trav.other.size = other_stat->size;
       } else {
           trav.other.etag = 0;
           trav.other.file_id = 0;
           trav.other.instruction = CSYNC_INSTRUCTION_NONE;
           trav.other.modtime = 0;
+          trav.other.modtime_nsec = 0;
+          trav.other.ctime = 0;
+          trav.other.ctime_nsec = 0;
           trav.other.size = 0;
       }
 
       rc = (*visitor)(&trav, twctx->userdata);
       cur->instruction = trav.instruction;
       if (trav.etag != cur->etag) { // FIXME It would be nice to have this documented
-          SAFE_FREE(cur->etag);
-          cur->etag = c_strdup(trav.etag);
+          if (!cur->in_arena) {
+              SAFE_FREE(cur->etag);
+          }
+          cur->etag = csync_file_stat_strdup(ctx, cur, trav.etag);
       }
 
       return rc;
@@ -411,11 +423,11 @@ static int _csync_treewalk_visitor(void *obj, void *data) {
  * treewalk function, called from its wrappers below.
  *
  * it encapsulates the user visitor function, the filter and the userdata
- * into a treewalk_context structure and calls the rb treewalk function,
+ * into a treewalk_context structure and calls the table walk function,
  * which calls the local _csync_treewalk_visitor in this module.
  * The user visitor is called from there.
  */
-static int _csync_walk_tree(CSYNC *ctx, c_rbtree_t *tree, csync_treewalk_visit_func *visitor, int filter)
+static int _csync_walk_tree(CSYNC *ctx, c_htable_t *tree, csync_treewalk_visit_func *visitor, int filter)
 {
     _csync_treewalk_context tw_ctx;
     int rc = -1;
@@ -436,7 +448,7 @@ static int _csync_walk_tree(CSYNC *ctx, c_rbtree_t *tree, csync_treewalk_visit_f
 
     ctx->callbacks.userdata = &tw_ctx;
 
-    rc = c_rbtree_walk(tree, (void*) ctx, _csync_treewalk_visitor);
+    rc = c_htable_walk(tree, (void*) ctx, _csync_treewalk_visitor);
     if( rc < 0 ) {
       if( ctx->status_code == CSYNC_STATUS_OK )
           ctx->status_code = csync_errno_to_status(errno, CSYNC_STATUS_TREE_ERROR);
@@ -451,7 +463,7 @@ static int _csync_walk_tree(CSYNC *ctx, c_rbtree_t *tree, csync_treewalk_visit_f
  */
 int csync_walk_remote_tree(CSYNC *ctx,  csync_treewalk_visit_func *visitor, int filter)
 {
-    c_rbtree_t *tree = NULL;
+    c_htable_t *tree = NULL;
     int rc = -1;
 
     if(ctx != NULL) {
@@ -470,7 +482,7 @@ int csync_walk_remote_tree(CSYNC *ctx,  csync_treewalk_visit_func *visitor, int
  */
 int csync_walk_local_tree(CSYNC *ctx, csync_treewalk_visit_func *visitor, int filter)
 {
-    c_rbtree_t *tree = NULL;
+    c_htable_t *tree = NULL;
     int rc = -1;
 
     if (ctx != NULL) {
@@ -495,20 +507,21 @@ static void _tree_destructor(void *data) {
  * used by csync_commit and csync_destroy */
 static void _csync_clean_ctx(CSYNC *ctx)
 {
-    /* destroy the rbtrees */
-    if (c_rbtree_size(ctx->local.tree) > 0) {
-        c_rbtree_destroy(ctx->local.tree, _tree_destructor);
-    }
-
-    if (c_rbtree_size(ctx->remote.tree) > 0) {
-        c_rbtree_destroy(ctx->remote.tree, _tree_destructor);
-    }
+    /* destroy the trees */
+    c_htable_destroy(ctx->local.tree, _tree_destructor);
+    ctx->local.tree = NULL;
+    c_htable_destroy(ctx->remote.tree, _tree_destructor);
+    ctx->remote.tree = NULL;
 
     csync_rename_destroy(ctx);
+    csync_statedb_free_index(ctx);
 
-    /* free memory */
-    c_rbtree_free(ctx->local.tree);
-    c_rbtree_free(ctx->remote.tree);
+    /* the tree entries which came from the arena */
+    if (ctx->arena) {
+        CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG, "Releasing %zu kB of tree entries", c_arena_size(ctx->arena) / 1024);
+        c_arena_free(ctx->arena);
+        ctx->arena = NULL;
+    }
 
     SAFE_FREE(ctx->remote.root_perms);
 }
@@ -532,13 +545,15 @@ int csync_commit(CSYNC *ctx) {
   _csync_clean_ctx(ctx);
 
   ctx->remote.read_from_db = 0;
+  ctx->local.read_from_db = 0;
   ctx->read_remote_from_db = true;
   ctx->db_is_empty = false;
 
 
   /* Create new trees */
-  c_rbtree_create(&ctx->local.tree, _key_cmp, _data_cmp);
-  c_rbtree_create(&ctx->remote.tree, _key_cmp, _data_cmp);
+  c_htable_create(&ctx->local.tree, _tree_key);
+  c_htable_create(&ctx->remote.tree, _tree_key);
+  ctx->arena = c_arena_new(CSYNC_ARENA_BLOCK_SIZE);
 
 
   ctx->status = CSYNC_STATUS_INIT;
@@ -663,9 +678,31 @@ int  csync_abort_requested(CSYNC *ctx)
   }
 }
 
-void csync_file_stat_free(csync_file_stat_t *st)
+csync_file_stat_t *csync_file_stat_new(CSYNC *ctx, size_t pathlen)
 {
+  csync_file_stat_t *st = NULL;
+
+  st = c_arena_alloc(ctx->arena, sizeof(csync_file_stat_t) + pathlen + 1);
   if (st) {
+    st->in_arena = 1;
+  }
+  return st;
+}
+
+char *csync_file_stat_strdup(CSYNC *ctx, const csync_file_stat_t *st, const char *str)
+{
+  if (str == NULL) {
+    return NULL;
+  }
+  if (st->in_arena) {
+    return c_arena_strdup(ctx->arena, str);
+  }
+  return c_strdup(str);
+}
+
+void csync_file_stat_free(csync_file_stat_t *st)
+{
+  if (st && !st->in_arena) {
     SAFE_FREE(st->directDownloadUrl);
     SAFE_FREE(st->directDownloadCookies);
     SAFE_FREE(st->etag);
@@ -209,6 +209,9 @@ struct csync_vio_file_stat_s {
   time_t atime;
   time_t mtime;
   time_t ctime;
+  /* sub-second part of mtime and ctime, 0 if not known */
+  long mtime_nsec;
+  long ctime_nsec;
 
   int64_t size;
 
@@ -247,6 +250,9 @@ struct csync_tree_walk_file_s {
     int64_t     size;
     int64_t     inode;
     time_t      modtime;
+    int32_t     modtime_nsec;
+    time_t      ctime;
+    int32_t     ctime_nsec;
     mode_t      mode;
     enum csync_ftw_type_e     type;
     enum csync_instructions_e instruction;
@@ -267,6 +273,9 @@ struct csync_tree_walk_file_s {
     struct {
         int64_t     size;
         time_t      modtime;
+        int32_t     modtime_nsec;
+        time_t      ctime;
+        int32_t     ctime_nsec;
         const char *etag;
         const char *file_id;
         enum csync_instructions_e instruction;
@@ -0,0 +1,201 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+extern "C" {
+#include "csync_private.h"
+#include "csync_checksum_pool.h"
+
+#define CSYNC_LOG_CATEGORY_NAME "csync.checksums"
+#include "csync_log.h"
+}
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+
+namespace {
+
+struct Job {
+    Job() : st(NULL), checksumTypeId(0), checksum(NULL) {}
+    ~Job() { free(const_cast<char *>(checksum)); }
+
+    csync_file_stat_t *st; // only touched by the update phase
+    std::string file;
+    uint32_t checksumTypeId;
+    std::string expectedChecksum;
+    const char *checksum; // result of the checksum_hook
+};
+
+}
+
+struct csync_checksum_pool_s {
+    static csync_checksum_pool_s *get(CSYNC *ctx) {
+        return reinterpret_cast<csync_checksum_pool_s *>(ctx->local.checksum_pool);
+    }
+
+    CSYNC *ctx;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable spaceAvailable;
+    bool stopping;
+    bool finishing; // no more jobs are going to be queued
+
+    // All the jobs in the order they were queued, the ones not started yet are in the queue
+    std::vector<std::unique_ptr<Job>> jobs;
+    std::deque<Job *> queue;
+    size_t maxQueued;
+    std::vector<std::thread> threads;
+
+    // The log settings are thread local, the threads use the ones of the update phase
+    csync_log_callback logCallback;
+    int logLevel;
+    void *logUserdata;
+
+    void run();
+    void join();
+};
+
+void csync_checksum_pool_s::run()
+{
+    csync_set_log_callback(logCallback);
+    csync_set_log_level(logLevel);
+    csync_set_log_userdata(logUserdata);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        workAvailable.wait(lock, [this] { return stopping || finishing || !queue.empty(); });
+        if (stopping || queue.empty()) {
+            return;
+        }
+        Job *job = queue.front();
+        queue.pop_front();
+        spaceAvailable.notify_one();
+        if (ctx->abort) {
+            continue;
+        }
+
+        lock.unlock();
+        const char *checksum = ctx->callbacks.checksum_hook(job->file.c_str(), job->checksumTypeId,
+            ctx->callbacks.checksum_userdata);
+        lock.lock();
+        job->checksum = checksum;
+    }
+}
+
+void csync_checksum_pool_s::join()
+{
+    workAvailable.notify_all();
+    spaceAvailable.notify_all();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    threads.clear();
+}
+
+extern "C" {
+
+void csync_checksum_pool_start(CSYNC *ctx, int threads)
+{
+    if (ctx->local.checksum_pool || threads < 1 || !ctx->callbacks.checksum_hook) {
+        return;
+    }
+    csync_checksum_pool_s *pool = new csync_checksum_pool_s;
+    pool->ctx = ctx;
+    pool->stopping = false;
+    pool->finishing = false;
+    pool->maxQueued = 256 * threads;
+    pool->logCallback = csync_get_log_callback();
+    pool->logLevel = csync_get_log_level();
+    pool->logUserdata = csync_get_log_userdata();
+    ctx->local.checksum_pool = pool;
+
+    for (int i = 0; i < threads; ++i) {
+        pool->threads.push_back(std::thread(&csync_checksum_pool_s::run, pool));
+    }
+    CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG, "Computing checksums of local files with %d threads", threads);
+}
+
+void csync_checksum_pool_enqueue(CSYNC *ctx, csync_file_stat_t *st, const char *file,
+    uint32_t checksumTypeId, const char *expectedChecksum)
+{
+    csync_checksum_pool_s *pool = csync_checksum_pool_s::get(ctx);
+    std::unique_ptr<Job> job(new Job);
+    job->st = st;
+    job->file = file;
+    job->checksumTypeId = checksumTypeId;
+    job->expectedChecksum = expectedChecksum ? expectedChecksum : "";
+
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->spaceAvailable.wait(lock, [pool] {
+        return pool->queue.size() < pool->maxQueued || pool->ctx->abort;
+    });
+    pool->queue.push_back(job.get());
+    pool->jobs.push_back(std::move(job));
+    pool->workAvailable.notify_one();
+}
+
+int csync_checksum_pool_finish(CSYNC *ctx, csync_checksum_pool_result_fn fn)
+{
+    csync_checksum_pool_s *pool = csync_checksum_pool_s::get(ctx);
+    if (!pool) {
+        return 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->finishing = true;
+    }
+    pool->join();
+
+    int rc = 0;
+    if (ctx->abort) {
+        rc = -1;
+    } else {
+        CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG, "Computed the checksums of %zu local files", pool->jobs.size());
+        for (size_t i = 0; i < pool->jobs.size(); ++i) {
+            const Job &job = *pool->jobs[i];
+            fn(ctx, job.st, job.checksum, job.checksumTypeId, job.expectedChecksum.c_str());
+        }
+    }
+    ctx->local.checksum_pool = NULL;
+    delete pool;
+    return rc;
+}
+
+void csync_checksum_pool_stop(CSYNC *ctx)
+{
+    csync_checksum_pool_s *pool = csync_checksum_pool_s::get(ctx);
+    if (!pool) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->stopping = true;
+        pool->queue.clear();
+    }
+    pool->join();
+    ctx->local.checksum_pool = NULL;
+    delete pool;
+}
+
+}
@@ -0,0 +1,54 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "csync_private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Checksums of local files computed in the background of the update phase.
+ *
+ * Files whose modification time changed but not their size are hashed by a pool
+ * of threads through the checksum_hook while the update phase goes on. The entries
+ * are left alone by the threads: the results are handed back on the thread of the
+ * update phase by csync_checksum_pool_finish().
+ */
+
+/* Called by csync_checksum_pool_finish() for each queued file. checksum is NULL if
+ * it could not be computed, it is only valid during the call. */
+typedef void (*csync_checksum_pool_result_fn)(CSYNC *ctx, csync_file_stat_t *st,
+    const char *checksum, uint32_t checksumTypeId, const char *expectedChecksum);
+
+/* Start hashing the queued files with the given amount of threads */
+void OCSYNC_EXPORT csync_checksum_pool_start(CSYNC *ctx, int threads);
+/* Queue the local file for the entry st. Blocks while too many files are queued. */
+void csync_checksum_pool_enqueue(CSYNC *ctx, csync_file_stat_t *st, const char *file,
+    uint32_t checksumTypeId, const char *expectedChecksum);
+/* Wait for the queued files and pass their checksums to fn, in the order they were
+ * queued. Stops the pool. Returns -1 if the sync was aborted in the meantime. */
+int csync_checksum_pool_finish(CSYNC *ctx, csync_checksum_pool_result_fn fn);
+/* Stop and join the threads, drop the files not hashed yet */
+void OCSYNC_EXPORT csync_checksum_pool_stop(CSYNC *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -212,14 +212,318 @@ bool csync_is_windows_reserved_word(const char* filename) {
   return false;
 }
 
-static CSYNC_EXCLUDE_TYPE _csync_excluded_common(c_strlist_t *excludes, const char *path, int filetype, bool check_leading_dirs) {
+enum csync_exclude_pattern_kind_e {
+  CSYNC_EXCLUDE_PATTERN_LITERAL,       /* no wildcards */
+  CSYNC_EXCLUDE_PATTERN_PREFIX_SUFFIX, /* one '*', like "*.tmp" or "~$*" */
+  CSYNC_EXCLUDE_PATTERN_CONTAINS,      /* "*text*" */
+  CSYNC_EXCLUDE_PATTERN_GLOB           /* everything else, goes through csync_fnmatch() */
+};
+
+struct csync_exclude_pattern_s {
+  const char *pattern; /* without the leading ']' and the trailing '/' */
+  size_t len;
+  enum csync_exclude_pattern_kind_e kind;
+  /* literal text every match starts and ends with */
+  size_t prefix_len;
+  size_t suffix_len;
+  bool remove;    /* ']': excluded files may be removed */
+  bool dirs_only; /* trailing '/' */
+  bool has_slash; /* also matched against the whole path */
+};
+
+#define CSYNC_EXCLUDE_BUCKETS 256
+
+struct csync_exclude_matcher_s {
+  struct csync_exclude_pattern_s *patterns;
+  size_t count;
+  char *strings;
+  /* The indices of the patterns, each one in one of these groups:
+   * - the patterns starting with the byte b are in [by_first[b], by_first[b + 1]),
+   * - the others ending with the byte b are in [by_last[b], by_last[b + 1]),
+   * - and the rest, which can match any name, in [by_last[CSYNC_EXCLUDE_BUCKETS], count).
+   * So a name is only compared to the patterns of three groups. */
+  size_t *indices;
+  size_t by_first[CSYNC_EXCLUDE_BUCKETS + 1];
+  size_t by_last[CSYNC_EXCLUDE_BUCKETS + 1];
+};
+
+static void _csync_exclude_pattern_init(struct csync_exclude_pattern_s *pat, const char *pattern, size_t len) {
+  pat->pattern = pattern;
+  pat->len = len;
+  pat->has_slash = memchr(pattern, '/', len) != NULL;
+  pat->kind = CSYNC_EXCLUDE_PATTERN_GLOB;
+  pat->prefix_len = 0;
+  pat->suffix_len = 0;
+
+  /* Without fnmatch() the patterns go to PathMatchSpec(), which ignores the case:
+   * the fast paths would not match the same names. */
+#ifdef HAVE_FNMATCH
+  {
+    size_t i;
+    size_t stars = 0;
+    size_t last_star = 0;
+    bool only_stars = true;
+
+    pat->prefix_len = len;
+    for (i = 0; i < len; i++) {
+      switch (pattern[i]) {
+      case '*':
+        stars++;
+        last_star = i;
+        break;
+      case '?':
+      case '[':
+      case '\\':
+        only_stars = false;
+        break;
+      default:
+        continue;
+      }
+      if (pat->prefix_len == len) {
+        pat->prefix_len = i;
+      }
+    }
+
+    if (stars == 0 && only_stars) {
+      pat->kind = CSYNC_EXCLUDE_PATTERN_LITERAL;
+    } else if (only_stars) {
+      pat->suffix_len = len - last_star - 1;
+      if (stars == 1) {
+        pat->kind = CSYNC_EXCLUDE_PATTERN_PREFIX_SUFFIX;
+      } else if (stars == 2 && pattern[0] == '*' && pattern[len - 1] == '*') {
+        pat->kind = CSYNC_EXCLUDE_PATTERN_CONTAINS;
+      }
+    }
+  }
+#endif
+}
+
+static bool _csync_exclude_contains(const char *str, size_t len, const char *text, size_t text_len) {
+  const char *end = str + len;
+
+  if (text_len == 0) {
+    return true;
+  }
+  while ((size_t) (end - str) >= text_len) {
+    str = memchr(str, text[0], end - str - text_len + 1);
+    if (str == NULL) {
+      return false;
+    }
+    if (memcmp(str, text, text_len) == 0) {
+      return true;
+    }
+    str++;
+  }
+  return false;
+}
+
+/* str has to be null terminated at len */
+static bool _csync_exclude_pattern_match(const struct csync_exclude_pattern_s *pat, const char *str, size_t len, int flags) {
+  switch (pat->kind) {
+  case CSYNC_EXCLUDE_PATTERN_LITERAL:
+    return len == pat->len && memcmp(str, pat->pattern, len) == 0;
+  case CSYNC_EXCLUDE_PATTERN_CONTAINS:
+    if (flags == 0) {
+      return _csync_exclude_contains(str, len, pat->pattern + 1, pat->len - 2);
+    }
+    break;
+  default:
+    break;
+  }
+
+  if (len < pat->prefix_len + pat->suffix_len
+      || memcmp(str, pat->pattern, pat->prefix_len) != 0
+      || memcmp(str + len - pat->suffix_len, pat->pattern + pat->len - pat->suffix_len, pat->suffix_len) != 0) {
+    return false;
+  }
+  if (pat->kind == CSYNC_EXCLUDE_PATTERN_PREFIX_SUFFIX && flags == 0) {
+    return true;
+  }
+  return csync_fnmatch(pat->pattern, str, flags) == 0;
+}
+
+/* csync_fnmatch() for the built in patterns: most names can be rejected by their start */
+static bool _csync_exclude_builtin_match(const char *pattern, const char *name) {
+#ifdef HAVE_FNMATCH
+  size_t prefix_len = strcspn(pattern, "*?[\\");
+  if (strncmp(name, pattern, prefix_len) != 0) {
+    return false;
+  }
+#endif
+  return csync_fnmatch(pattern, name, 0) == 0;
+}
+
+/* Sort the pattern indices into the groups of the matcher, see csync_exclude_matcher_s */
+static void _csync_exclude_matcher_group(csync_exclude_matcher_t *matcher) {
+  size_t first_count[CSYNC_EXCLUDE_BUCKETS] = { 0 };
+  size_t last_count[CSYNC_EXCLUDE_BUCKETS] = { 0 };
+  size_t other = 0;
+  size_t i;
+  int b;
+
+  for (i = 0; i < matcher->count; i++) {
+    const struct csync_exclude_pattern_s *pat = &matcher->patterns[i];
+    if (pat->prefix_len > 0) {
+      first_count[(unsigned char) pat->pattern[0]]++;
+    } else if (pat->suffix_len > 0) {
+      last_count[(unsigned char) pat->pattern[pat->len - 1]]++;
+    }
+  }
+
+  matcher->by_first[0] = 0;
+  for (b = 0; b < CSYNC_EXCLUDE_BUCKETS; b++) {
+    matcher->by_first[b + 1] = matcher->by_first[b] + first_count[b];
+  }
+  matcher->by_last[0] = matcher->by_first[CSYNC_EXCLUDE_BUCKETS];
+  for (b = 0; b < CSYNC_EXCLUDE_BUCKETS; b++) {
+    matcher->by_last[b + 1] = matcher->by_last[b] + last_count[b];
+  }
+
+  /* fill the groups in order, so that each one is sorted */
+  other = matcher->by_last[CSYNC_EXCLUDE_BUCKETS];
+  for (i = 0; i < matcher->count; i++) {
+    const struct csync_exclude_pattern_s *pat = &matcher->patterns[i];
+    if (pat->prefix_len > 0) {
+      b = (unsigned char) pat->pattern[0];
+      matcher->indices[matcher->by_first[b + 1] - first_count[b]--] = i;
+    } else if (pat->suffix_len > 0) {
+      b = (unsigned char) pat->pattern[pat->len - 1];
+      matcher->indices[matcher->by_last[b + 1] - last_count[b]--] = i;
+    } else {
+      matcher->indices[other++] = i;
+    }
+  }
+}
+
+csync_exclude_matcher_t *csync_exclude_matcher_new(const c_strlist_t *excludes) {
+  csync_exclude_matcher_t *matcher = NULL;
+  size_t strings_size = 0;
+  char *strings = NULL;
+  size_t i;
+
+  matcher = c_malloc(sizeof(csync_exclude_matcher_t));
+  if (matcher == NULL || excludes == NULL || excludes->count == 0) {
+    return matcher;
+  }
+
+  for (i = 0; i < excludes->count; i++) {
+    strings_size += strlen(excludes->vector[i]) + 1;
+  }
+  matcher->patterns = c_malloc(excludes->count * sizeof(struct csync_exclude_pattern_s));
+  matcher->strings = c_malloc(strings_size);
+  matcher->indices = c_malloc(excludes->count * sizeof(size_t));
+  if (matcher->patterns == NULL || matcher->strings == NULL || matcher->indices == NULL) {
+    csync_exclude_matcher_free(matcher);
+    return NULL;
+  }
+
+  strings = matcher->strings;
+  for (i = 0; i < excludes->count; i++) {
+    struct csync_exclude_pattern_s *pat = &matcher->patterns[matcher->count];
+    const char *pattern = excludes->vector[i];
+    bool remove = false;
+    bool dirs_only = false;
+    size_t len;
+
+    if (!pattern[0]) { /* empty pattern */
+      continue;
+    }
+    /* Excludes starting with ']' means it can be cleanup */
+    if (pattern[0] == ']') {
+      ++pattern;
+      remove = true;
+    }
+    len = strlen(pattern);
+    /* Check if the pattern applies to pathes only. */
+    if (len > 0 && pattern[len - 1] == '/') {
+      dirs_only = true;
+      --len;
+    }
+
+    memcpy(strings, pattern, len);
+    strings[len] = '\0';
+    _csync_exclude_pattern_init(pat, strings, len);
+    pat->remove = remove;
+    pat->dirs_only = dirs_only;
+    strings += len + 1;
+    matcher->count++;
+  }
+
+  _csync_exclude_matcher_group(matcher);
+
+  return matcher;
+}
+
+void csync_exclude_matcher_free(csync_exclude_matcher_t *matcher) {
+  if (matcher == NULL) {
+    return;
+  }
+  SAFE_FREE(matcher->patterns);
+  SAFE_FREE(matcher->strings);
+  SAFE_FREE(matcher->indices);
+  SAFE_FREE(matcher);
+}
+
+/* Returns the index of the first of the patterns before best which matches the
+ * component, or best if none does. */
+static size_t _csync_exclude_match_component(const csync_exclude_matcher_t *matcher, size_t best,
+                                             const char *component, size_t len, bool skip_dirs_only) {
+    const size_t *pos[3];
+    const size_t *end[3];
+    int g;
+
+    /* The patterns which can match: merge the three groups in the order of the patterns */
+    pos[0] = end[0] = matcher->indices;
+    pos[1] = end[1] = matcher->indices;
+    if (len > 0) {
+        unsigned char first = component[0];
+        unsigned char last = component[len - 1];
+        pos[0] = matcher->indices + matcher->by_first[first];
+        end[0] = matcher->indices + matcher->by_first[first + 1];
+        pos[1] = matcher->indices + matcher->by_last[last];
+        end[1] = matcher->indices + matcher->by_last[last + 1];
+    }
+    pos[2] = matcher->indices + matcher->by_last[CSYNC_EXCLUDE_BUCKETS];
+    end[2] = matcher->indices + matcher->count;
+
+    for (;;) {
+        const struct csync_exclude_pattern_s *pat = NULL;
+        size_t i = best;
+        int next = -1;
+
+        for (g = 0; g < 3; g++) {
+            if (pos[g] != end[g] && *pos[g] < i) {
+                i = *pos[g];
+                next = g;
+            }
+        }
+        if (next < 0) {
+            return best;
+        }
+        pos[next]++;
+
+        pat = &matcher->patterns[i];
+        if (skip_dirs_only && pat->dirs_only) {
+            continue;
+        }
+        if (_csync_exclude_pattern_match(pat, component, len, 0)) {
+            return i;
+        }
+    }
+}
+
+static CSYNC_EXCLUDE_TYPE _csync_excluded_common(const csync_exclude_matcher_t *matcher, const char *path, int filetype, bool check_leading_dirs) {
     size_t i = 0;
     const char *bname = NULL;
     size_t blen = 0;
+    size_t len = 0;
+    const char *conflict_user = NULL;
     char *conflict = NULL;
     int rc = -1;
+    size_t best = 0;
+    char path_buf[1024];
+    char *path_split = NULL;
     CSYNC_EXCLUDE_TYPE match = CSYNC_NOT_EXCLUDED;
-    CSYNC_EXCLUDE_TYPE type  = CSYNC_NOT_EXCLUDED;
 
     /* split up the path */
     bname = strrchr(path, '/');
@@ -230,13 +534,11 @@ static CSYNC_EXCLUDE_TYPE _csync_excluded_common(c_strlist_t *excludes, const ch
     }
     blen = strlen(bname);
 
-    rc = csync_fnmatch("._sync_*.db*", bname, 0);
-    if (rc == 0) {
+    if (_csync_exclude_builtin_match("._sync_*.db*", bname)) {
         match = CSYNC_FILE_SILENTLY_EXCLUDED;
         goto out;
     }
-    rc = csync_fnmatch(".csync_journal.db*", bname, 0);
-    if (rc == 0) {
+    if (_csync_exclude_builtin_match(".csync_journal.db*", bname)) {
         match = CSYNC_FILE_SILENTLY_EXCLUDED;
         goto out;
     }
@@ -288,44 +590,71 @@ static CSYNC_EXCLUDE_TYPE _csync_excluded_common(c_strlist_t *excludes, const ch
     }
 #endif
 
-    rc = csync_fnmatch(".owncloudsync.log*", bname, 0);
-    if (rc == 0) {
+    if (_csync_exclude_builtin_match(".owncloudsync.log*", bname)) {
         match = CSYNC_FILE_SILENTLY_EXCLUDED;
         goto out;
     }
 
     /* Always ignore conflict files, not only via the exclude list */
-    rc = csync_fnmatch("*_conflict-*", bname, 0);
-    if (rc == 0) {
+    if (_csync_exclude_builtin_match("*_conflict-*", bname)) {
         match = CSYNC_FILE_SILENTLY_EXCLUDED;
         goto out;
     }
 
-    if (getenv("CSYNC_CONFLICT_FILE_USERNAME")) {
-        rc = asprintf(&conflict, "*_conflict_%s-*", getenv("CSYNC_CONFLICT_FILE_USERNAME"));
+    conflict_user = getenv("CSYNC_CONFLICT_FILE_USERNAME");
+    if (conflict_user && strstr(path, "_conflict_")) {
+        rc = asprintf(&conflict, "*_conflict_%s-*", conflict_user);
         if (rc < 0) {
             goto out;
         }
         rc = csync_fnmatch(conflict, path, 0);
+        SAFE_FREE(conflict);
         if (rc == 0) {
             match = CSYNC_FILE_SILENTLY_EXCLUDED;
-            SAFE_FREE(conflict);
             goto out;
         }
-        SAFE_FREE(conflict);
     }
 
-    if( ! excludes ) {
+    if (matcher == NULL || matcher->count == 0) {
         goto out;
     }
 
-    c_strlist_t *path_components = NULL;
-    if (check_leading_dirs) {
-        /* Build a list of path components to check. */
-        path_components = c_strlist_new(32);
-        char *path_split = strdup(path);
-        size_t len = strlen(path_split);
-        for (i = len; ; --i) {
+    /* The first matching pattern decides the type of the exclude, find its index */
+    best = matcher->count;
+    len = strlen(path);
+
+    /* Patterns which contain a / are compared to the whole path */
+    for (i = 0; i < best; i++) {
+        const struct csync_exclude_pattern_s *pat = &matcher->patterns[i];
+        if (!pat->has_slash) {
+            continue;
+        }
+        /* if the pattern requires a dir, but path is not, its still not excluded. */
+        if (pat->dirs_only && filetype != CSYNC_FTW_TYPE_DIR) {
+            continue;
+        }
+        if (_csync_exclude_pattern_match(pat, path, len, FNM_PATHNAME)) {
+            best = i;
+            break;
+        }
+    }
+
+    if (!check_leading_dirs) {
+        best = _csync_exclude_match_component(matcher, best, bname, blen, filetype == CSYNC_FTW_TYPE_FILE);
+    } else {
+        /* Check each component and leading directory of the path: for "/foo/bar/fi"
+         * that is 'fi', '/foo/bar', 'bar', '/foo', 'foo' and ''. They are cut off one
+         * after the other in a copy of the path. */
+        size_t end = len;
+        bool first = true;
+
+        path_split = len < sizeof(path_buf) ? path_buf : c_malloc(len + 1);
+        if (path_split == NULL) {
+            goto out;
+        }
+        memcpy(path_split, path, len + 1);
+
+        for (i = len; best > 0; --i) {
             // read backwards until a path separator is found
             if (i != 0 && path_split[i-1] != '/') {
                 continue;
@@ -333,7 +662,9 @@ static CSYNC_EXCLUDE_TYPE _csync_excluded_common(c_strlist_t *excludes, const ch
 
             // check 'basename', i.e. for "/foo/bar/fi" we'd check 'fi', 'bar', 'foo'
             if (path_split[i] != 0) {
-                c_strlist_add_grow(&path_components, path_split + i);
+                best = _csync_exclude_match_component(matcher, best, path_split + i, end - i,
+                                                      first && filetype == CSYNC_FTW_TYPE_FILE);
+                first = false;
             }
 
             if (i == 0) {
@@ -342,84 +673,46 @@ static CSYNC_EXCLUDE_TYPE _csync_excluded_common(c_strlist_t *excludes, const ch
 
             // check 'dirname', i.e. for "/foo/bar/fi" we'd check '/foo/bar', '/foo'
             path_split[i-1] = '\0';
-            c_strlist_add_grow(&path_components, path_split);
-        }
-        SAFE_FREE(path_split);
-    }
-
-    /* Loop over all exclude patterns and evaluate the given path */
-    for (i = 0; match == CSYNC_NOT_EXCLUDED && i < excludes->count; i++) {
-        bool match_dirs_only = false;
-        char *pattern = excludes->vector[i];
-
-        type = CSYNC_FILE_EXCLUDE_LIST;
-        if (!pattern[0]) { /* empty pattern */
-            continue;
+            end = i - 1;
+            best = _csync_exclude_match_component(matcher, best, path_split, end,
+                                                  first && filetype == CSYNC_FTW_TYPE_FILE);
+            first = false;
         }
-        /* Excludes starting with ']' means it can be cleanup */
-        if (pattern[0] == ']') {
-            ++pattern;
-            if (filetype == CSYNC_FTW_TYPE_FILE) {
-                type = CSYNC_FILE_EXCLUDE_AND_REMOVE;
-            }
-        }
-        /* Check if the pattern applies to pathes only. */
-        if (pattern[strlen(pattern)-1] == '/') {
-            if (!check_leading_dirs && filetype == CSYNC_FTW_TYPE_FILE) {
-                continue;
-            }
-            match_dirs_only = true;
-            pattern[strlen(pattern)-1] = '\0'; /* Cut off the slash */
-        }
-
-        /* check if the pattern contains a / and if, compare to the whole path */
-        if (strchr(pattern, '/')) {
-            rc = csync_fnmatch(pattern, path, FNM_PATHNAME);
-            if( rc == 0 ) {
-                match = type;
-            }
-            /* if the pattern requires a dir, but path is not, its still not excluded. */
-            if (match_dirs_only && filetype != CSYNC_FTW_TYPE_DIR) {
-                match = CSYNC_NOT_EXCLUDED;
-            }
+        if (path_split != path_buf) {
+            SAFE_FREE(path_split);
         }
+    }
 
-        /* if still not excluded, check each component and leading directory of the path */
-        if (match == CSYNC_NOT_EXCLUDED && check_leading_dirs) {
-            size_t j = 0;
-            if (match_dirs_only && filetype == CSYNC_FTW_TYPE_FILE) {
-                j = 1; // skip the first entry, which is bname
-            }
-            for (; j < path_components->count; ++j) {
-                rc = csync_fnmatch(pattern, path_components->vector[j], 0);
-                if (rc == 0) {
-                    match = type;
-                    break;
-                }
-            }
-        } else if (match == CSYNC_NOT_EXCLUDED && !check_leading_dirs) {
-            rc = csync_fnmatch(pattern, bname, 0);
-            if (rc == 0) {
-                match = type;
-            }
-        }
-        if (match_dirs_only) {
-            /* restore the '/' */
-            pattern[strlen(pattern)] = '/';
+    if (best < matcher->count) {
+        match = CSYNC_FILE_EXCLUDE_LIST;
+        if (matcher->patterns[best].remove && filetype == CSYNC_FTW_TYPE_FILE) {
+            match = CSYNC_FILE_EXCLUDE_AND_REMOVE;
         }
     }
-    c_strlist_destroy(path_components);
 
   out:
 
     return match;
 }
 
+CSYNC_EXCLUDE_TYPE csync_exclude_match_traversal(const csync_exclude_matcher_t *matcher, const char *path, int filetype) {
+  return _csync_excluded_common(matcher, path, filetype, false);
+}
+
+CSYNC_EXCLUDE_TYPE csync_exclude_match_no_ctx(const csync_exclude_matcher_t *matcher, const char *path, int filetype) {
+  return _csync_excluded_common(matcher, path, filetype, true);
+}
+
 CSYNC_EXCLUDE_TYPE csync_excluded_traversal(c_strlist_t *excludes, const char *path, int filetype) {
-  return _csync_excluded_common(excludes, path, filetype, false);
+  csync_exclude_matcher_t *matcher = csync_exclude_matcher_new(excludes);
+  CSYNC_EXCLUDE_TYPE match = _csync_excluded_common(matcher, path, filetype, false);
+  csync_exclude_matcher_free(matcher);
+  return match;
 }
 
 CSYNC_EXCLUDE_TYPE csync_excluded_no_ctx(c_strlist_t *excludes, const char *path, int filetype) {
-  return _csync_excluded_common(excludes, path, filetype, true);
+  csync_exclude_matcher_t *matcher = csync_exclude_matcher_new(excludes);
+  CSYNC_EXCLUDE_TYPE match = _csync_excluded_common(matcher, path, filetype, true);
+  csync_exclude_matcher_free(matcher);
+  return match;
 }
-
@@ -36,6 +36,8 @@ enum csync_exclude_type_e {
 };
 typedef enum csync_exclude_type_e CSYNC_EXCLUDE_TYPE;
 
+typedef struct csync_exclude_matcher_s csync_exclude_matcher_t;
+
 #ifdef WITH_TESTING
 int OCSYNC_EXPORT _csync_exclude_add(c_strlist_t **inList, const char *string);
 #endif
@@ -50,6 +52,41 @@ int OCSYNC_EXPORT _csync_exclude_add(c_strlist_t **inList, const char *string);
  */
 int OCSYNC_EXPORT csync_exclude_load(const char *fname, c_strlist_t **list);
 
+/**
+ * @brief Compile exclude patterns for matching
+ *
+ * The functions taking the exclude list interpret every pattern on every call.
+ * A matcher does that once; it is not changed by the matching and can be used
+ * from several threads at the same time.
+ *
+ * @param excludes  The exclude patterns, may be NULL.
+ *
+ * @return  The matcher, to be freed with csync_exclude_matcher_free(), or NULL
+ *          if the memory could not be allocated.
+ */
+csync_exclude_matcher_t OCSYNC_EXPORT *csync_exclude_matcher_new(const c_strlist_t *excludes);
+
+/**
+ * @brief Free a matcher created by csync_exclude_matcher_new()
+ *
+ * @param matcher  The matcher to free, may be NULL.
+ */
+void OCSYNC_EXPORT csync_exclude_matcher_free(csync_exclude_matcher_t *matcher);
+
+/**
+ * @brief csync_excluded_traversal() with compiled patterns
+ *
+ * @param matcher  The compiled exclude patterns, may be NULL for none.
+ */
+CSYNC_EXCLUDE_TYPE csync_exclude_match_traversal(const csync_exclude_matcher_t *matcher, const char *path, int filetype);
+
+/**
+ * @brief csync_excluded_no_ctx() with compiled patterns
+ *
+ * @param matcher  The compiled exclude patterns, may be NULL for none.
+ */
+CSYNC_EXCLUDE_TYPE OCSYNC_EXPORT csync_exclude_match_no_ctx(const csync_exclude_matcher_t *matcher, const char *path, int filetype);
+
 /**
  * @brief Check if the given path should be excluded in a traversal situation.
  *
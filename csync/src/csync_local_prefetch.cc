@@ -0,0 +1,340 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+extern "C" {
+#include "csync_private.h"
+#include "csync_local_prefetch.h"
+#include "vio/csync_vio_local.h"
+
+#define CSYNC_LOG_CATEGORY_NAME "csync.prefetch"
+#include "csync_log.h"
+}
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <string.h>
+
+namespace {
+
+struct Entry {
+    csync_vio_file_stat_t *stat;
+    int rc; // result of the stat of the entry
+    int error; // errno of a failed stat
+};
+
+struct Listing {
+    Listing() : done(false), abandoned(false), error(0), next(0) {}
+    ~Listing() {
+        for (size_t i = next; i < entries.size(); ++i) {
+            csync_vio_file_stat_destroy(entries[i].stat);
+        }
+    }
+
+    bool done;
+    bool abandoned; // the walk went past this directory before it was listed
+    int error; // errno if the directory could not be opened
+    std::vector<Entry> entries;
+    size_t next;
+};
+
+struct Handle {
+    std::string path;
+    std::unique_ptr<Listing> listing;
+};
+
+bool startsWith(const std::string &path, const std::string &prefix) {
+    return path.compare(0, prefix.size(), prefix) == 0;
+}
+
+}
+
+struct csync_local_prefetch_s {
+    static csync_local_prefetch_s *get(CSYNC *ctx) {
+        return reinterpret_cast<csync_local_prefetch_s *>(ctx->local.prefetch);
+    }
+
+    CSYNC *ctx;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable listingDone;
+    bool stopping;
+
+    // Directories to list, the one the walk will open first is at the front
+    std::deque<std::string> queue;
+    // Listings done or in progress that the walk did not take yet
+    std::map<std::string, std::unique_ptr<Listing>> listings;
+    size_t maxListings;
+    std::vector<std::thread> threads;
+
+    // The log settings are thread local, the threads use the ones of the walk
+    csync_log_callback logCallback;
+    int logLevel;
+    void *logUserdata;
+
+    // The stat result of the entry last returned by readdir
+    const csync_vio_file_stat_t *lastEntry;
+    int lastRc;
+    int lastError;
+
+    void run();
+    void list(const std::string &path, Listing *listing);
+    std::vector<std::string> subDirectories(const std::string &path, const Listing *listing);
+    void enqueue(const std::vector<std::string> &paths);
+};
+
+void csync_local_prefetch_s::list(const std::string &path, Listing *listing)
+{
+    csync_vio_handle_t *dh = csync_vio_local_opendir(path.c_str());
+    if (!dh) {
+        listing->error = errno ? errno : EIO;
+        return;
+    }
+
+    while (csync_vio_file_stat_t *dirent = csync_vio_local_readdir(dh)) {
+        Entry entry = { dirent, 0, 0 };
+        const char *name = dirent->name;
+        if (name) {
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                csync_vio_file_stat_destroy(dirent);
+                continue;
+            }
+            std::string filename = path + '/' + name;
+            errno = 0;
+            entry.rc = csync_vio_local_stat(filename.c_str(), dirent);
+            entry.error = errno;
+        }
+        listing->entries.push_back(entry);
+    }
+    csync_vio_local_closedir(dh);
+}
+
+/* The sub directories of a listing the walk is likely to open, in the order it will open them.
+ * The exclude patterns are left to the walk thread: an excluded directory only costs a
+ * listing nobody takes. */
+std::vector<std::string> csync_local_prefetch_s::subDirectories(const std::string &path, const Listing *listing)
+{
+    std::vector<std::string> result;
+    size_t rootLength = strlen(ctx->local.uri) + 1;
+    for (size_t i = 0; i < listing->entries.size(); ++i) {
+        const Entry &entry = listing->entries[i];
+        if (entry.rc < 0 || !entry.stat->name || entry.stat->type != CSYNC_VIO_FILE_TYPE_DIRECTORY) {
+            continue;
+        }
+        std::string filename = path + '/' + entry.stat->name;
+        const char *relative = filename.c_str() + std::min(rootLength, filename.size());
+        if (ctx->callbacks.checkSyncScopeHook
+                && ctx->callbacks.checkSyncScopeHook(ctx->callbacks.update_callback_userdata, relative, CSYNC_FTW_TYPE_DIR)) {
+            continue;
+        }
+        if (ctx->callbacks.checkLocalDirectoryDirtyHook
+                && !ctx->callbacks.checkLocalDirectoryDirtyHook(ctx->callbacks.update_callback_userdata, relative)) {
+            continue;
+        }
+        result.push_back(filename);
+    }
+    return result;
+}
+
+/* must be called with the mutex locked */
+void csync_local_prefetch_s::enqueue(const std::vector<std::string> &paths)
+{
+    if (stopping || paths.empty()) {
+        return;
+    }
+    queue.insert(queue.begin(), paths.begin(), paths.end());
+    workAvailable.notify_all();
+}
+
+void csync_local_prefetch_s::run()
+{
+    csync_set_log_callback(logCallback);
+    csync_set_log_level(logLevel);
+    csync_set_log_userdata(logUserdata);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        workAvailable.wait(lock, [this] {
+            return stopping || (!queue.empty() && listings.size() < maxListings);
+        });
+        if (stopping) {
+            return;
+        }
+        std::string path = queue.front();
+        queue.pop_front();
+        Listing *listing = new Listing;
+        listings[path].reset(listing);
+
+        lock.unlock();
+        list(path, listing);
+        std::vector<std::string> subDirs = subDirectories(path, listing);
+        lock.lock();
+
+        if (listing->abandoned) {
+            listings.erase(path);
+            workAvailable.notify_all();
+            continue;
+        }
+        listing->done = true;
+        listingDone.notify_all();
+        enqueue(subDirs);
+    }
+}
+
+extern "C" {
+
+void csync_local_prefetch_start(CSYNC *ctx, int threads)
+{
+    if (ctx->local.prefetch || threads < 1) {
+        return;
+    }
+    csync_local_prefetch_s *prefetch = new csync_local_prefetch_s;
+    prefetch->ctx = ctx;
+    prefetch->stopping = false;
+    prefetch->maxListings = 32 * threads;
+    prefetch->logCallback = csync_get_log_callback();
+    prefetch->logLevel = csync_get_log_level();
+    prefetch->logUserdata = csync_get_log_userdata();
+    prefetch->lastEntry = NULL;
+    prefetch->lastRc = 0;
+    prefetch->lastError = 0;
+    ctx->local.prefetch = prefetch;
+
+    for (int i = 0; i < threads; ++i) {
+        prefetch->threads.push_back(std::thread(&csync_local_prefetch_s::run, prefetch));
+    }
+    CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG, "Listing local directories with %d threads", threads);
+}
+
+void csync_local_prefetch_stop(CSYNC *ctx)
+{
+    csync_local_prefetch_s *prefetch = csync_local_prefetch_s::get(ctx);
+    if (!prefetch) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(prefetch->mutex);
+        prefetch->stopping = true;
+        prefetch->queue.clear();
+    }
+    prefetch->workAvailable.notify_all();
+    for (size_t i = 0; i < prefetch->threads.size(); ++i) {
+        prefetch->threads[i].join();
+    }
+    ctx->local.prefetch = NULL;
+    delete prefetch;
+}
+
+csync_vio_handle_t *csync_local_prefetch_opendir(CSYNC *ctx, const char *name)
+{
+    csync_local_prefetch_s *prefetch = csync_local_prefetch_s::get(ctx);
+    std::unique_ptr<Handle> handle(new Handle);
+    handle->path = name;
+
+    std::unique_lock<std::mutex> lock(prefetch->mutex);
+    auto it = prefetch->listings.find(handle->path);
+    if (it != prefetch->listings.end()) {
+        Listing *listing = it->second.get();
+        prefetch->listingDone.wait(lock, [listing] { return listing->done; });
+        // the iterator is still valid: only the walk removes listings that are done
+        handle->listing = std::move(it->second);
+        prefetch->listings.erase(it);
+        prefetch->workAvailable.notify_all();
+    } else {
+        // Not listed ahead, do it here and let the threads continue with the sub directories
+        prefetch->queue.erase(std::remove(prefetch->queue.begin(), prefetch->queue.end(), handle->path),
+            prefetch->queue.end());
+        lock.unlock();
+        handle->listing.reset(new Listing);
+        prefetch->list(handle->path, handle->listing.get());
+        std::vector<std::string> subDirs = prefetch->subDirectories(handle->path, handle->listing.get());
+        lock.lock();
+        prefetch->enqueue(subDirs);
+    }
+    lock.unlock();
+
+    if (handle->listing->error) {
+        errno = handle->listing->error;
+        return NULL;
+    }
+    return handle.release();
+}
+
+csync_vio_file_stat_t *csync_local_prefetch_readdir(CSYNC *ctx, csync_vio_handle_t *dhandle)
+{
+    csync_local_prefetch_s *prefetch = csync_local_prefetch_s::get(ctx);
+    Listing *listing = static_cast<Handle *>(dhandle)->listing.get();
+    if (listing->next >= listing->entries.size()) {
+        prefetch->lastEntry = NULL;
+        return NULL;
+    }
+    Entry &entry = listing->entries[listing->next++];
+    prefetch->lastEntry = entry.stat;
+    prefetch->lastRc = entry.rc;
+    prefetch->lastError = entry.error;
+    return entry.stat;
+}
+
+int csync_local_prefetch_closedir(CSYNC *ctx, csync_vio_handle_t *dhandle)
+{
+    csync_local_prefetch_s *prefetch = csync_local_prefetch_s::get(ctx);
+    Handle *handle = static_cast<Handle *>(dhandle);
+    prefetch->lastEntry = NULL;
+
+    // The walk is done with this directory, nothing below it is going to be opened anymore
+    const std::string prefix = handle->path + '/';
+    {
+        std::lock_guard<std::mutex> lock(prefetch->mutex);
+        prefetch->queue.erase(std::remove_if(prefetch->queue.begin(), prefetch->queue.end(),
+                                  [&prefix](const std::string &path) { return startsWith(path, prefix); }),
+            prefetch->queue.end());
+        auto it = prefetch->listings.lower_bound(prefix);
+        while (it != prefetch->listings.end() && startsWith(it->first, prefix)) {
+            if (it->second->done) {
+                it = prefetch->listings.erase(it);
+            } else {
+                it->second->abandoned = true;
+                ++it;
+            }
+        }
+    }
+    prefetch->workAvailable.notify_all();
+
+    delete handle;
+    return 0;
+}
+
+int csync_local_prefetch_stat(CSYNC *ctx, const char *uri, csync_vio_file_stat_t *buf)
+{
+    csync_local_prefetch_s *prefetch = csync_local_prefetch_s::get(ctx);
+    if (buf && buf == prefetch->lastEntry) {
+        errno = prefetch->lastError;
+        return prefetch->lastRc;
+    }
+    return csync_vio_local_stat(uri, buf);
+}
+
+}
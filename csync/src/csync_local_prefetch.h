@@ -0,0 +1,49 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "csync.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Listing of local directories ahead of the update phase.
+ *
+ * While csync_ftw walks the local tree depth first, a pool of threads reads and
+ * stats the sub directories it is going to open next. The walk itself, and so the
+ * local tree, stays on the calling thread and is built in the same order as without
+ * the pool. The opendir, readdir, closedir and stat functions below replace the
+ * local vio functions while the pool is running.
+ */
+
+/* Start listing ahead of the walk with the given amount of threads */
+void OCSYNC_EXPORT csync_local_prefetch_start(CSYNC *ctx, int threads);
+/* Stop and join the threads, drop the listings not used by the walk */
+void OCSYNC_EXPORT csync_local_prefetch_stop(CSYNC *ctx);
+
+csync_vio_handle_t *csync_local_prefetch_opendir(CSYNC *ctx, const char *name);
+csync_vio_file_stat_t *csync_local_prefetch_readdir(CSYNC *ctx, csync_vio_handle_t *dhandle);
+int csync_local_prefetch_closedir(CSYNC *ctx, csync_vio_handle_t *dhandle);
+int csync_local_prefetch_stat(CSYNC *ctx, const char *uri, csync_vio_file_stat_t *buf);
+
+#ifdef __cplusplus
+}
+#endif
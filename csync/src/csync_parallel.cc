@@ -0,0 +1,103 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+extern "C" {
+#include "csync.h"
+#include "csync_parallel.h"
+}
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Ranges are taken one after the other by the threads, several per thread so
+// that a slow range does not leave the other threads idle
+const size_t rangesPerThread = 8;
+const size_t minRangeSize = 1024;
+
+struct ParallelFor {
+    size_t count;
+    size_t rangeSize;
+    std::atomic<size_t> next;
+    csync_parallel_fn fn;
+    void *data;
+
+    // The log settings are thread local, the threads use the ones of the caller
+    csync_log_callback logCallback;
+    int logLevel;
+    void *logUserdata;
+
+    void run(bool setupLog)
+    {
+        if (setupLog) {
+            csync_set_log_callback(logCallback);
+            csync_set_log_level(logLevel);
+            csync_set_log_userdata(logUserdata);
+        }
+        for (;;) {
+            size_t begin = next.fetch_add(rangeSize);
+            if (begin >= count) {
+                return;
+            }
+            fn(begin, std::min(begin + rangeSize, count), data);
+        }
+    }
+};
+
+}
+
+extern "C" {
+
+void csync_parallel_for(int threads, size_t count, csync_parallel_fn fn, void *data)
+{
+    // More threads than cores would only add overhead
+    int cores = std::thread::hardware_concurrency();
+    if (cores > 0) {
+        threads = std::min(threads, cores);
+    }
+    if (threads < 2 || count <= minRangeSize) {
+        if (count > 0) {
+            fn(0, count, data);
+        }
+        return;
+    }
+
+    ParallelFor job;
+    job.count = count;
+    job.rangeSize = std::max(minRangeSize, count / (threads * rangesPerThread) + 1);
+    job.next = 0;
+    job.fn = fn;
+    job.data = data;
+    job.logCallback = csync_get_log_callback();
+    job.logLevel = csync_get_log_level();
+    job.logUserdata = csync_get_log_userdata();
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.push_back(std::thread(&ParallelFor::run, &job, true));
+    }
+    job.run(false);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+}
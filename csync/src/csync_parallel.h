@@ -0,0 +1,40 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called for the items [begin, end) of a csync_parallel_for() */
+typedef void (*csync_parallel_fn)(size_t begin, size_t end, void *data);
+
+/*
+ * Split [0, count) in consecutive ranges and call fn for them from up to the given
+ * amount of threads, the calling one included, and at most one per core. Returns once
+ * all the ranges are done.
+ * The threads log like the calling thread.
+ */
+void csync_parallel_for(int threads, size_t count, csync_parallel_fn fn, void *data);
+
+#ifdef __cplusplus
+}
+#endif
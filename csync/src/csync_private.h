@@ -91,18 +91,33 @@ struct csync_s {
       int (*checkSelectiveSyncBlackListHook)(void*, const char*);
       int (*checkSelectiveSyncNewFolderHook)(void*, const char* /* path */, const char* /* remotePerm */);
 
+      /* hook telling whether a local directory may have changed since the last sync.
+       * Unchanged directories are read from the database instead of the file system.
+       * If not set, the whole local tree is walked. (uses the update_callback_userdata)
+       * It may be called from the threads of csync_local_prefetch_start() too. */
+      int (*checkLocalDirectoryDirtyHook)(void*, const char* /* path */);
+
+      /* hook telling whether an entry is outside of the part of the tree that is synced.
+       * Such entries are skipped on both replicas, as if they did not exist. If not set,
+       * the whole tree is synced. (uses the update_callback_userdata)
+       * It may be called from the threads of csync_local_prefetch_start() too. */
+      int (*checkSyncScopeHook)(void*, const char* /* path */, int /* type */);
+
 
       csync_vio_opendir_hook remote_opendir_hook;
       csync_vio_readdir_hook remote_readdir_hook;
       csync_vio_closedir_hook remote_closedir_hook;
       void *vio_userdata;
 
-      /* hook for comparing checksums of files during discovery */
+      /* hook for comparing checksums of files during discovery.
+       * It may be called from the threads of csync_checksum_pool_start() too. */
       csync_checksum_hook checksum_hook;
       void *checksum_userdata;
 
   } callbacks;
   c_strlist_t *excludes;
+  /* compiled from excludes for the duration of csync_update() */
+  struct csync_exclude_matcher_s *exclude_matcher;
   
   struct {
     char *file;
@@ -114,16 +129,29 @@ struct csync_s {
     sqlite3_stmt* by_inode_stmt;
 
     int lastReturnValue;
+
+    /* In-memory copy of the metadata table, see csync_statedb_load_index() */
+    struct csync_statedb_index_s *index;
+    /* Maximum number of rows to load in the index, 0 disables it (default) */
+    int64_t index_max_entries;
   } statedb;
 
   struct {
     char *uri;
-    c_rbtree_t *tree;
+    c_htable_t *tree;
     enum csync_replica_e type;
+    int  read_from_db;
+    /* Number of threads listing directories ahead of the update phase, 0 or 1 to not use any */
+    int  prefetch_threads;
+    void *prefetch; /* see csync_local_prefetch.h */
+    /* Number of threads comparing the checksums of all the files that were touched
+     * but kept their size, 0 to only compare them for .eml files, on the update thread */
+    int  checksum_threads;
+    void *checksum_pool; /* see csync_checksum_pool.h */
   } local;
 
   struct {
-    c_rbtree_t *tree;
+    c_htable_t *tree;
     enum csync_replica_e type;
     int  read_from_db;
     const char *root_perms; /* Permission of the root folder. (Since the root folder is not in the db tree, we need to keep a separate entry.) */
@@ -146,6 +174,10 @@ struct csync_s {
      parent directories */
   csync_file_stat_t *current_fs;
 
+  /* Memory of the tree entries and their strings, released at once when the trees
+   * are destroyed. See csync_file_stat_new() */
+  c_arena_t *arena;
+
   /* csync error code */
   enum csync_status_codes_e status_code;
 
@@ -166,6 +198,12 @@ struct csync_s {
    */
   bool db_is_empty;
 
+  /**
+   * Number of threads reconciling the entries of a replica, 0 or 1 to reconcile them
+   * on the calling thread only (default). See csync_reconcile_updates().
+   */
+  int reconcile_threads;
+
   bool ignore_hidden_files;
 };
 
@@ -176,13 +214,18 @@ struct csync_s {
 struct csync_file_stat_s {
   uint64_t phash;   /* u64 */
   time_t modtime;   /* u64 */
+  time_t ctime;     /* u64 */
   int64_t size;       /* u64 */
   size_t pathlen;   /* u64 */
   uint64_t inode;   /* u64 */
   mode_t mode;      /* u32 */
+  int32_t modtime_nsec; /* u32, sub-second part of modtime, 0 if not known */
+  int32_t ctime_nsec;   /* u32 */
   unsigned int type                   : 4;
   unsigned int child_modified         : 1;
   unsigned int has_ignored_files      : 1; /* specify that a directory, or child directory contains ignored files */
+  unsigned int in_arena               : 1; /* allocated with csync_file_stat_new(), its strings too */
+  unsigned int checksum_pending       : 1; /* the instruction waits for checksums, see csync_checksum_pool.h */
 
   char *destpath;   /* for renames */
   const char *etag;
@@ -209,6 +252,12 @@ __attribute__ ((packed))
 
 OCSYNC_EXPORT void csync_file_stat_free(csync_file_stat_t *st);
 
+/* Allocate a zeroed entry for a path of the given length from the arena of the sync.
+ * csync_file_stat_free() does nothing for it, the arena is released with the trees. */
+csync_file_stat_t *csync_file_stat_new(CSYNC *ctx, size_t pathlen);
+/* Copy a string to be stored in the given entry, from the arena if the entry is in it */
+char *csync_file_stat_strdup(CSYNC *ctx, const csync_file_stat_t *st, const char *str);
+
 /*
  * context for the treewalk function
  */
@@ -26,6 +26,7 @@
 #include "csync_util.h"
 #include "csync_statedb.h"
 #include "csync_rename.h"
+#include "csync_parallel.h"
 #include "c_jhash.h"
 
 #define CSYNC_LOG_CATEGORY_NAME "csync.reconciler"
@@ -34,10 +35,10 @@
 #include "inttypes.h"
 
 /* Check if a file is ignored because one parent is ignored.
- * return the node of the ignored directoy if it's the case, or NULL if it is not ignored */
-static c_rbnode_t *_csync_check_ignored(c_rbtree_t *tree, const char *path, int pathlen) {
+ * return the entry of the ignored directoy if it's the case, or NULL if it is not ignored */
+static csync_file_stat_t *_csync_check_ignored(c_htable_t *tree, const char *path, int pathlen) {
     uint64_t h = 0;
-    c_rbnode_t *node = NULL;
+    csync_file_stat_t *n = NULL;
 
     /* compute the size of the parent directory */
     int parentlen = pathlen - 1;
@@ -49,12 +50,11 @@ static c_rbnode_t *_csync_check_ignored(c_rbtree_t *tree, const char *path, int
     }
 
     h = c_jhash64((uint8_t *) path, parentlen, 0);
-    node = c_rbtree_find(tree, &h);
-    if (node) {
-        csync_file_stat_t *n = (csync_file_stat_t*)node->data;
+    n = c_htable_find(tree, h);
+    if (n) {
         if (n->instruction == CSYNC_INSTRUCTION_IGNORE) {
             /* Yes, we are ignored */
-            return node;
+            return n;
         } else {
             /* Not ignored */
             return NULL;
@@ -68,7 +68,7 @@ static c_rbnode_t *_csync_check_ignored(c_rbtree_t *tree, const char *path, int
 /**
  * The main function in the reconcile pass.
  *
- * It's called for each entry in the local and remote rbtrees by
+ * It's called for each entry in the local and remote trees by
  * csync_reconcile()
  *
  * Before the reconcile phase the trees already know about changes
@@ -100,8 +100,8 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
     int len = 0;
 
     CSYNC *ctx = NULL;
-    c_rbtree_t *tree = NULL;
-    c_rbnode_t *node = NULL;
+    c_htable_t *tree = NULL;
+    csync_file_stat_t *node = NULL;
 
     cur = (csync_file_stat_t *) obj;
     ctx = (CSYNC *) data;
@@ -118,7 +118,7 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
         break;
     }
 
-    node = c_rbtree_find(tree, &cur->phash);
+    node = c_htable_find(tree, cur->phash);
 
     if (!node) {
         /* Check the renamed path as well. */
@@ -126,7 +126,7 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
         if (!c_streq(renamed_path, cur->path)) {
             len = strlen( renamed_path );
             h = c_jhash64((uint8_t *) renamed_path, len, 0);
-            node = c_rbtree_find(tree, &h);
+            node = c_htable_find(tree, h);
         }
         SAFE_FREE(renamed_path);
     }
@@ -176,16 +176,16 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
                 if( len > 0 ) {
                     h = c_jhash64((uint8_t *) tmp->path, len, 0);
                     /* First, check that the file is NOT in our tree (another file with the same name was added) */
-                    node = c_rbtree_find(ctx->current == REMOTE_REPLICA ? ctx->remote.tree : ctx->local.tree, &h);
+                    node = c_htable_find(ctx->current == REMOTE_REPLICA ? ctx->remote.tree : ctx->local.tree, h);
                     if (node) {
                         CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "Origin found in our tree : %s", tmp->path);
                     } else {
                         /* Find the temporar file in the other tree. */
-                        node = c_rbtree_find(tree, &h);
+                        node = c_htable_find(tree, h);
                         CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "PHash of temporary opposite (%s): %" PRIu64 " %s",
                                 tmp->path , h, node ? "found": "not found" );
                         if (node) {
-                            other = (csync_file_stat_t*)node->data;
+                            other = node;
                         } else {
                             /* the renamed file could not be found in the opposite tree. That is because it
                             * is not longer existing there, maybe because it was renamed or deleted.
@@ -201,7 +201,7 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
                            || other->instruction == CSYNC_INSTRUCTION_UPDATE_METADATA
                            || cur->type == CSYNC_FTW_TYPE_DIR) {
                     other->instruction = CSYNC_INSTRUCTION_RENAME;
-                    other->destpath = c_strdup( cur->path );
+                    other->destpath = csync_file_stat_strdup(ctx, other, cur->path);
                     if( !c_streq(cur->file_id, "") ) {
                         csync_vio_set_file_id( other->file_id, cur->file_id );
                     }
@@ -209,7 +209,7 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
                     cur->instruction = CSYNC_INSTRUCTION_NONE;
                 } else if (other->instruction == CSYNC_INSTRUCTION_REMOVE) {
                     other->instruction = CSYNC_INSTRUCTION_RENAME;
-                    other->destpath = c_strdup( cur->path );
+                    other->destpath = csync_file_stat_strdup(ctx, other, cur->path);
 
                     if( !c_streq(cur->file_id, "") ) {
                         csync_vio_set_file_id( other->file_id, cur->file_id );
@@ -236,7 +236,7 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
         /*
      * file found on the other replica
      */
-        other = (csync_file_stat_t *) node->data;
+        other = node;
 
         switch (cur->instruction) {
         case CSYNC_INSTRUCTION_UPDATE_METADATA:
@@ -360,26 +360,79 @@ static int _csync_merge_algorithm_visitor(void *obj, void *data) {
     return 0;
 }
 
+struct _csync_reconcile_job_s {
+  CSYNC *ctx;
+  c_htable_t *tree;
+  c_htable_t *other_tree;
+  char *deferred; /* per entry of tree */
+};
+
+/* An entry found at the same path in the other tree only changes itself and that
+ * other entry, none of the entries of the other threads. The renamed entries and the
+ * ones not found, which look at the renames and at their parents in the other tree,
+ * are left to _csync_reconcile_deferred(). */
+static void _csync_reconcile_range(size_t begin, size_t end, void *data) {
+  struct _csync_reconcile_job_s *job = (struct _csync_reconcile_job_s *) data;
+  size_t i;
+
+  for (i = begin; i < end; i++) {
+    csync_file_stat_t *cur = (csync_file_stat_t *) job->tree->entries[i];
+    if (cur->instruction == CSYNC_INSTRUCTION_EVAL_RENAME
+        || c_htable_find(job->other_tree, cur->phash) == NULL) {
+      job->deferred[i] = 1;
+      continue;
+    }
+    _csync_merge_algorithm_visitor(cur, job->ctx);
+  }
+}
+
+static void _csync_reconcile_deferred(struct _csync_reconcile_job_s *job) {
+  size_t i;
+
+  for (i = 0; i < c_htable_size(job->tree); i++) {
+    if (job->deferred[i]) {
+      _csync_merge_algorithm_visitor(job->tree->entries[i], job->ctx);
+    }
+  }
+}
+
 int csync_reconcile_updates(CSYNC *ctx) {
   int rc;
-  c_rbtree_t *tree = NULL;
+  c_htable_t *tree = NULL;
+  c_htable_t *other_tree = NULL;
+  struct _csync_reconcile_job_s job;
 
   switch (ctx->current) {
     case LOCAL_REPLICA:
       tree = ctx->local.tree;
+      other_tree = ctx->remote.tree;
       break;
     case REMOTE_REPLICA:
       tree = ctx->remote.tree;
+      other_tree = ctx->local.tree;
       break;
     default:
       break;
   }
 
-  rc = c_rbtree_walk(tree, (void *) ctx, _csync_merge_algorithm_visitor);
-  if( rc < 0 ) {
-    ctx->status_code = CSYNC_STATUS_RECONCILE_ERROR;
+  if (ctx->reconcile_threads < 2 || tree == NULL) {
+    rc = c_htable_walk(tree, (void *) ctx, _csync_merge_algorithm_visitor);
+    if( rc < 0 ) {
+      ctx->status_code = CSYNC_STATUS_RECONCILE_ERROR;
+    }
+    return rc;
   }
-  return rc;
+
+  job.ctx = ctx;
+  job.tree = tree;
+  job.other_tree = other_tree;
+  job.deferred = c_calloc(c_htable_size(tree) + 1, 1);
+
+  csync_parallel_for(ctx->reconcile_threads, c_htable_size(tree), _csync_reconcile_range, &job);
+  _csync_reconcile_deferred(&job);
+
+  SAFE_FREE(job.deferred);
+  return 0;
 }
 
 /* vim: set ts=8 sw=2 et cindent: */
@@ -44,6 +44,10 @@
 /**
  * @brief Reconcile the files.
  *
+ * The entries of the current replica are reconciled from ctx->reconcile_threads
+ * threads, except the ones involved in a rename or missing in the other replica.
+ * Those are reconciled afterwards, one after the other in the tree order.
+ *
  * @param  ctx          The csync context to use.
  *
  * @return 0 on success, < 0 on error.
@@ -225,13 +225,18 @@ int csync_statedb_close(CSYNC *ctx) {
   return rc;
 }
 
-#define METADATA_COLUMNS "phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId"
+#define METADATA_COLUMNS "phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, modtimeNsec, ctime, ctimeNsec"
 
 // This funciton parses a line from the metadata table into the given csync_file_stat
-// structure which it is also allocating.
+// structure which it is also allocating, from the arena if one is given.
 // Note that this function calls laso sqlite3_step to actually get the info from db and
 // returns the sqlite return type.
-static int _csync_file_stat_from_metadata_table( csync_file_stat_t **st, sqlite3_stmt *stmt )
+static char *_csync_statedb_strdup(c_arena_t *arena, const char *str)
+{
+    return arena ? c_arena_strdup(arena, str) : c_strdup(str);
+}
+
+static int _csync_file_stat_from_metadata_table( csync_file_stat_t **st, sqlite3_stmt *stmt, c_arena_t *arena )
 {
     int rc = SQLITE_ERROR;
     int column_count;
@@ -252,9 +257,18 @@ static int _csync_file_stat_from_metadata_table( csync_file_stat_t **st, sqlite3
 
             /* phash, pathlen, path, inode, uid, gid, mode, modtime */
             len = sqlite3_column_int(stmt, 1);
-            *st = c_malloc(sizeof(csync_file_stat_t) + len + 1);
-            /* clear the whole structure */
-            ZERO_STRUCTP(*st);
+            if (arena) {
+                *st = c_arena_alloc(arena, sizeof(csync_file_stat_t) + len + 1);
+                if (*st) {
+                    (*st)->in_arena = 1;
+                }
+            } else {
+                *st = c_malloc(sizeof(csync_file_stat_t) + len + 1);
+            }
+            if (*st == NULL) {
+                CSYNC_LOG(CSYNC_LOG_PRIORITY_ERROR, "Fatal: Could not allocate the entry of a metadata row.");
+                return SQLITE_NOMEM;
+            }
 
             /* The query suceeded so use the phash we pass to the function. */
             (*st)->phash = sqlite3_column_int64(stmt, 0);
@@ -271,7 +285,7 @@ static int _csync_file_stat_from_metadata_table( csync_file_stat_t **st, sqlite3
             }
 
             if(column_count > 9 && sqlite3_column_text(stmt, 9)) {
-                (*st)->etag = c_strdup( (char*) sqlite3_column_text(stmt, 9) );
+                (*st)->etag = _csync_statedb_strdup(arena, (char*) sqlite3_column_text(stmt, 9));
             }
             if(column_count > 10 && sqlite3_column_text(stmt,10)) {
                 csync_vio_set_file_id((*st)->file_id, (char*) sqlite3_column_text(stmt, 10));
@@ -288,9 +302,14 @@ static int _csync_file_stat_from_metadata_table( csync_file_stat_t **st, sqlite3
                 (*st)->has_ignored_files = sqlite3_column_int(stmt, 13);
             }
             if(column_count > 15 && sqlite3_column_int(stmt, 15)) {
-                (*st)->checksum = c_strdup( (char*) sqlite3_column_text(stmt, 14));
+                (*st)->checksum = _csync_statedb_strdup(arena, (char*) sqlite3_column_text(stmt, 14));
                 (*st)->checksumTypeId = sqlite3_column_int(stmt, 15);
             }
+            if(column_count > 18) {
+                (*st)->modtime_nsec = sqlite3_column_int(stmt, 16);
+                (*st)->ctime = sqlite3_column_int64(stmt, 17);
+                (*st)->ctime_nsec = sqlite3_column_int(stmt, 18);
+            }
 
         }
     } else {
@@ -301,6 +320,262 @@ static int _csync_file_stat_from_metadata_table( csync_file_stat_t **st, sqlite3
     return rc;
 }
 
+/*
+ * The in-memory index of the metadata table.
+ *
+ * by_hash owns all the entries, by_inode and by_file_id only point to the
+ * entries that have an inode, respectively a file id. All three arrays are
+ * sorted so the lookups can use a binary search.
+ */
+struct csync_statedb_index_s {
+  c_arena_t *arena; /* the entries */
+  csync_file_stat_t **by_hash;
+  size_t count;
+  csync_file_stat_t **by_inode;
+  size_t inode_count;
+  csync_file_stat_t **by_file_id;
+  size_t file_id_count;
+};
+
+static int _index_cmp_hash(const void *a, const void *b) {
+  const csync_file_stat_t *sa = *(csync_file_stat_t * const *) a;
+  const csync_file_stat_t *sb = *(csync_file_stat_t * const *) b;
+
+  if (sa->phash < sb->phash) {
+    return -1;
+  }
+  return sa->phash > sb->phash;
+}
+
+static int _index_cmp_inode(const void *a, const void *b) {
+  const csync_file_stat_t *sa = *(csync_file_stat_t * const *) a;
+  const csync_file_stat_t *sb = *(csync_file_stat_t * const *) b;
+
+  if (sa->inode != sb->inode) {
+    return sa->inode < sb->inode ? -1 : 1;
+  }
+  return _index_cmp_hash(a, b);
+}
+
+static int _index_cmp_file_id(const void *a, const void *b) {
+  const csync_file_stat_t *sa = *(csync_file_stat_t * const *) a;
+  const csync_file_stat_t *sb = *(csync_file_stat_t * const *) b;
+  int cmp = strcmp(sa->file_id, sb->file_id);
+
+  if (cmp != 0) {
+    return cmp;
+  }
+  return _index_cmp_hash(a, b);
+}
+
+/* Position of the first entry of the sorted array which is not less than key */
+static size_t _index_lower_bound(csync_file_stat_t **array, size_t count,
+                                 const csync_file_stat_t *key,
+                                 int (*cmp)(const void *, const void *)) {
+  size_t lo = 0;
+  size_t hi = count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cmp(&array[mid], &key) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/*
+ * The key used for the lookups has a phash of 0, so with the ties broken by phash
+ * the lower bound is the first of the entries sharing the inode or the file id.
+ */
+static const csync_file_stat_t *_index_find_hash(const struct csync_statedb_index_s *index, uint64_t phash) {
+  csync_file_stat_t key;
+  size_t pos;
+
+  ZERO_STRUCT(key);
+  key.phash = phash;
+  pos = _index_lower_bound(index->by_hash, index->count, &key, _index_cmp_hash);
+  if (pos < index->count && index->by_hash[pos]->phash == phash) {
+    return index->by_hash[pos];
+  }
+  return NULL;
+}
+
+static const csync_file_stat_t *_index_find_inode(const struct csync_statedb_index_s *index, uint64_t inode) {
+  csync_file_stat_t key;
+  size_t pos;
+
+  ZERO_STRUCT(key);
+  key.inode = inode;
+  pos = _index_lower_bound(index->by_inode, index->inode_count, &key, _index_cmp_inode);
+  if (pos < index->inode_count && index->by_inode[pos]->inode == inode) {
+    return index->by_inode[pos];
+  }
+  return NULL;
+}
+
+static const csync_file_stat_t *_index_find_file_id(const struct csync_statedb_index_s *index, const char *file_id) {
+  csync_file_stat_t key;
+  size_t pos;
+
+  ZERO_STRUCT(key);
+  csync_vio_set_file_id(key.file_id, file_id);
+  pos = _index_lower_bound(index->by_file_id, index->file_id_count, &key, _index_cmp_file_id);
+  if (pos < index->file_id_count && c_streq(index->by_file_id[pos]->file_id, key.file_id)) {
+    return index->by_file_id[pos];
+  }
+  return NULL;
+}
+
+/* The lookups hand out copies which the caller frees, as for the query results */
+static csync_file_stat_t *_csync_file_stat_copy(const csync_file_stat_t *st) {
+  csync_file_stat_t *copy = NULL;
+  size_t size;
+
+  if (st == NULL) {
+    return NULL;
+  }
+
+  size = sizeof(csync_file_stat_t) + st->pathlen + 1;
+  copy = c_malloc(size);
+  memcpy(copy, st, size);
+  copy->in_arena = 0;
+  copy->etag = st->etag ? c_strdup(st->etag) : NULL;
+  copy->checksum = st->checksum ? c_strdup(st->checksum) : NULL;
+
+  return copy;
+}
+
+int csync_statedb_load_index(CSYNC *ctx) {
+  struct csync_statedb_index_s *index = NULL;
+  c_strlist_t *result = NULL;
+  sqlite3_stmt *stmt = NULL;
+  const char *query = "SELECT " METADATA_COLUMNS " FROM metadata";
+  int64_t rows = 0;
+  size_t allocated = 0;
+  size_t memory = 0;
+  size_t i;
+  int rc;
+
+  if (ctx == NULL || ctx->statedb.db == NULL) {
+    return -1;
+  }
+
+  /* An index left over from an aborted sync could be outdated */
+  csync_statedb_free_index(ctx);
+
+  if (ctx->db_is_empty || ctx->statedb.index_max_entries <= 0) {
+    return 0;
+  }
+
+  result = csync_statedb_query(ctx->statedb.db, "SELECT COUNT(*) FROM metadata;");
+  if (result == NULL || result->count < 1) {
+    c_strlist_destroy(result);
+    return -1;
+  }
+  rows = strtoll(result->vector[0], NULL, 10);
+  c_strlist_destroy(result);
+
+  if (rows > ctx->statedb.index_max_entries) {
+    CSYNC_LOG(CSYNC_LOG_PRIORITY_INFO,
+              "Statedb has %" PRId64 " entries, more than %" PRId64 ": not loading it in memory",
+              rows, ctx->statedb.index_max_entries);
+    return 0;
+  }
+
+  SQLITE_BUSY_HANDLED(sqlite3_prepare_v2(ctx->statedb.db, query, strlen(query), &stmt, NULL));
+  ctx->statedb.lastReturnValue = rc;
+  if (rc != SQLITE_OK) {
+    CSYNC_LOG(CSYNC_LOG_PRIORITY_ERROR, "WRN: Unable to create stmt for the index query.");
+    return -1;
+  }
+
+  index = c_malloc(sizeof(struct csync_statedb_index_s));
+  ZERO_STRUCTP(index);
+  index->arena = c_arena_new(256 * 1024);
+
+  /* The table can still change between the count and this query, so grow as needed */
+  allocated = rows > 0 ? (size_t) rows : 16;
+  index->by_hash = c_malloc(allocated * sizeof(csync_file_stat_t *));
+
+  do {
+    csync_file_stat_t *st = NULL;
+
+    rc = _csync_file_stat_from_metadata_table(&st, stmt, index->arena);
+    if (st == NULL) {
+      continue;
+    }
+    if (index->count == allocated) {
+      allocated *= 2;
+      index->by_hash = c_realloc(index->by_hash, allocated * sizeof(csync_file_stat_t *));
+    }
+    index->by_hash[index->count++] = st;
+    if (st->inode != 0) {
+      index->inode_count++;
+    }
+    if (st->file_id[0] != '\0') {
+      index->file_id_count++;
+    }
+  } while (rc == SQLITE_ROW);
+
+  sqlite3_finalize(stmt);
+  ctx->statedb.lastReturnValue = rc;
+
+  if (rc != SQLITE_DONE) {
+    CSYNC_LOG(CSYNC_LOG_PRIORITY_ERROR, "WRN: Could not load the metadata table in memory: %d!", rc);
+    ctx->statedb.index = index;
+    csync_statedb_free_index(ctx);
+    return -1;
+  }
+
+  index->by_inode = c_malloc((index->inode_count + 1) * sizeof(csync_file_stat_t *));
+  index->by_file_id = c_malloc((index->file_id_count + 1) * sizeof(csync_file_stat_t *));
+  index->inode_count = 0;
+  index->file_id_count = 0;
+  for (i = 0; i < index->count; i++) {
+    csync_file_stat_t *st = index->by_hash[i];
+    if (st->inode != 0) {
+      index->by_inode[index->inode_count++] = st;
+    }
+    if (st->file_id[0] != '\0') {
+      index->by_file_id[index->file_id_count++] = st;
+    }
+  }
+
+  qsort(index->by_hash, index->count, sizeof(csync_file_stat_t *), _index_cmp_hash);
+  qsort(index->by_inode, index->inode_count, sizeof(csync_file_stat_t *), _index_cmp_inode);
+  qsort(index->by_file_id, index->file_id_count, sizeof(csync_file_stat_t *), _index_cmp_file_id);
+
+  memory = c_arena_size(index->arena)
+      + (allocated + index->inode_count + index->file_id_count + 2) * sizeof(csync_file_stat_t *);
+
+  ctx->statedb.index = index;
+
+  CSYNC_LOG(CSYNC_LOG_PRIORITY_INFO, "Loaded %zu statedb entries in memory, using %zu kB",
+            index->count, memory / 1024);
+
+  return 0;
+}
+
+void csync_statedb_free_index(CSYNC *ctx) {
+  struct csync_statedb_index_s *index = NULL;
+
+  if (ctx == NULL || ctx->statedb.index == NULL) {
+    return;
+  }
+
+  index = ctx->statedb.index;
+  c_arena_free(index->arena);
+  SAFE_FREE(index->by_hash);
+  SAFE_FREE(index->by_inode);
+  SAFE_FREE(index->by_file_id);
+  SAFE_FREE(index);
+
+  ctx->statedb.index = NULL;
+}
+
 /* caller must free the memory */
 csync_file_stat_t *csync_statedb_get_stat_by_hash(CSYNC *ctx,
                                                   uint64_t phash)
@@ -312,6 +587,12 @@ csync_file_stat_t *csync_statedb_get_stat_by_hash(CSYNC *ctx,
       return NULL;
   }
 
+  if( ctx->statedb.index ) {
+      st = _csync_file_stat_copy(_index_find_hash(ctx->statedb.index, phash));
+      ctx->statedb.lastReturnValue = st ? SQLITE_ROW : SQLITE_DONE;
+      return st;
+  }
+
   if( ctx->statedb.by_hash_stmt == NULL ) {
       const char *hash_query = "SELECT " METADATA_COLUMNS " FROM metadata WHERE phash=?1";
 
@@ -329,7 +610,7 @@ csync_file_stat_t *csync_statedb_get_stat_by_hash(CSYNC *ctx,
 
   sqlite3_bind_int64(ctx->statedb.by_hash_stmt, 1, (long long signed int)phash);
 
-  rc = _csync_file_stat_from_metadata_table(&st, ctx->statedb.by_hash_stmt);
+  rc = _csync_file_stat_from_metadata_table(&st, ctx->statedb.by_hash_stmt, NULL);
   ctx->statedb.lastReturnValue = rc;
   if( !(rc == SQLITE_ROW || rc == SQLITE_DONE) )  {
       CSYNC_LOG(CSYNC_LOG_PRIORITY_ERROR, "WRN: Could not get line from metadata: %d!", rc);
@@ -355,6 +636,12 @@ csync_file_stat_t *csync_statedb_get_stat_by_file_id(CSYNC *ctx,
         return NULL;
     }
 
+    if( ctx->statedb.index ) {
+        st = _csync_file_stat_copy(_index_find_file_id(ctx->statedb.index, file_id));
+        ctx->statedb.lastReturnValue = st ? SQLITE_ROW : SQLITE_DONE;
+        return st;
+    }
+
     if( ctx->statedb.by_fileid_stmt == NULL ) {
         const char *query = "SELECT " METADATA_COLUMNS " FROM metadata WHERE fileid=?1";
 
@@ -369,7 +656,7 @@ csync_file_stat_t *csync_statedb_get_stat_by_file_id(CSYNC *ctx,
     /* bind the query value */
     sqlite3_bind_text(ctx->statedb.by_fileid_stmt, 1, file_id, -1, SQLITE_STATIC);
 
-    rc = _csync_file_stat_from_metadata_table(&st, ctx->statedb.by_fileid_stmt);
+    rc = _csync_file_stat_from_metadata_table(&st, ctx->statedb.by_fileid_stmt, NULL);
     ctx->statedb.lastReturnValue = rc;
     if( !(rc == SQLITE_ROW || rc == SQLITE_DONE) ) {
         CSYNC_LOG(CSYNC_LOG_PRIORITY_ERROR, "WRN: Could not get line from metadata: %d!", rc);
@@ -395,6 +682,12 @@ csync_file_stat_t *csync_statedb_get_stat_by_inode(CSYNC *ctx,
       return NULL;
   }
 
+  if( ctx->statedb.index ) {
+      st = _csync_file_stat_copy(_index_find_inode(ctx->statedb.index, inode));
+      ctx->statedb.lastReturnValue = st ? SQLITE_ROW : SQLITE_DONE;
+      return st;
+  }
+
   if( ctx->statedb.by_inode_stmt == NULL ) {
       const char *inode_query = "SELECT " METADATA_COLUMNS " FROM metadata WHERE inode=?1";
 
@@ -412,7 +705,7 @@ csync_file_stat_t *csync_statedb_get_stat_by_inode(CSYNC *ctx,
 
   sqlite3_bind_int64(ctx->statedb.by_inode_stmt, 1, (long long signed int)inode);
 
-  rc = _csync_file_stat_from_metadata_table(&st, ctx->statedb.by_inode_stmt);
+  rc = _csync_file_stat_from_metadata_table(&st, ctx->statedb.by_inode_stmt, NULL);
   ctx->statedb.lastReturnValue = rc;
   if( !(rc == SQLITE_ROW || rc == SQLITE_DONE) ) {
       CSYNC_LOG(CSYNC_LOG_PRIORITY_ERROR, "WRN: Could not get line from metadata by inode: %d!", rc);
@@ -460,12 +753,12 @@ int csync_statedb_get_below_path( CSYNC *ctx, const char *path ) {
     do {
         csync_file_stat_t *st = NULL;
 
-        rc = _csync_file_stat_from_metadata_table( &st, stmt);
+        rc = _csync_file_stat_from_metadata_table(&st, stmt, ctx->arena);
         if( st ) {
             /* Check for exclusion from the tree.
              * Note that this is only a safety net in case the ignore list changes
              * without a full remote discovery being triggered. */
-            CSYNC_EXCLUDE_TYPE excluded = csync_excluded_traversal(ctx->excludes, st->path, st->type);
+            CSYNC_EXCLUDE_TYPE excluded = csync_exclude_match_traversal(ctx->exclude_matcher, st->path, st->type);
             if (excluded != CSYNC_NOT_EXCLUDED) {
                 CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "%s excluded (%d)", st->path, excluded);
 
@@ -478,8 +771,13 @@ int csync_statedb_get_below_path( CSYNC *ctx, const char *path ) {
                 st->instruction = CSYNC_INSTRUCTION_IGNORE;
             }
 
+            if (ctx->current == LOCAL_REPLICA && st->type == CSYNC_FTW_TYPE_DIR) {
+                /* See _csync_detect_update: the local ignored files are not in the database */
+                st->has_ignored_files = true;
+            }
+
             /* store into result list. */
-            if (c_rbtree_insert(ctx->remote.tree, (void *) st) < 0) {
+            if (c_htable_insert(ctx->current == LOCAL_REPLICA ? ctx->local.tree : ctx->remote.tree, (void *) st) < 0) {
                 csync_file_stat_free(st);
                 ctx->status_code = CSYNC_STATUS_TREE_ERROR;
                 break;
@@ -60,6 +60,24 @@ OCSYNC_EXPORT int csync_statedb_load(CSYNC *ctx, const char *statedb, sqlite3 **
 
 OCSYNC_EXPORT int csync_statedb_close(CSYNC *ctx);
 
+/**
+ * @brief Load the whole metadata table in memory.
+ *
+ * The lookups by hash, inode and file id are then answered from memory instead of
+ * running one query each. Nothing is loaded if the table has more rows than
+ * ctx->statedb.index_max_entries, the lookups then keep querying the database.
+ *
+ * The statedb needs to be loaded. The index stays valid until
+ * csync_statedb_free_index() is called, even if the statedb is closed meanwhile.
+ *
+ * @param ctx      The csync context.
+ *
+ * @return 0 on success or if the index is not used, less than 0 on error.
+ */
+OCSYNC_EXPORT int csync_statedb_load_index(CSYNC *ctx);
+
+OCSYNC_EXPORT void csync_statedb_free_index(CSYNC *ctx);
+
 OCSYNC_EXPORT csync_file_stat_t *csync_statedb_get_stat_by_hash(CSYNC *ctx, uint64_t phash);
 
 OCSYNC_EXPORT csync_file_stat_t *csync_statedb_get_stat_by_inode(CSYNC *ctx, uint64_t inode);
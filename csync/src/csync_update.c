@@ -47,6 +47,7 @@
 #define CSYNC_LOG_CATEGORY_NAME "csync.updater"
 #include "csync_log.h"
 #include "csync_rename.h"
+#include "csync_checksum_pool.h"
 
 /* calculate the hash of a given uri */
 static uint64_t _hash_of_file(CSYNC *ctx, const char *file) {
@@ -145,6 +146,46 @@ static bool _csync_mtime_equal(time_t a, time_t b)
     return false;
 }
 
+/* Return true if the local file still has the modification time recorded in the
+ * database. The sub-second parts are only compared when both are known: the
+ * database of older versions and some file systems do not have them. */
+static bool _csync_local_mtime_equal(const csync_vio_file_stat_t *fs, const csync_file_stat_t *tmp)
+{
+    if (fs->mtime == tmp->modtime && fs->mtime_nsec && tmp->modtime_nsec) {
+        return fs->mtime_nsec == tmp->modtime_nsec;
+    }
+    return _csync_mtime_equal(fs->mtime, tmp->modtime);
+}
+
+/* Return true if the status of the local file did not change since it was recorded
+ * in the database, or if that is not known */
+static bool _csync_local_ctime_equal(const csync_vio_file_stat_t *fs, const csync_file_stat_t *tmp)
+{
+    if (!tmp->ctime) {
+        return true;
+    }
+    if (fs->ctime != tmp->ctime) {
+        return false;
+    }
+    return !fs->ctime_nsec || !tmp->ctime_nsec || fs->ctime_nsec == tmp->ctime_nsec;
+}
+
+/* Hash the local file in the background, csync_update_resolve_checksums() then decides
+ * between EVAL and UPDATE_METADATA. Returns false if that cannot be done for this file. */
+static bool _csync_queue_checksum(CSYNC *ctx, csync_file_stat_t *st, const char *file,
+    const csync_vio_file_stat_t *fs, const csync_file_stat_t *tmp, const int type)
+{
+    if (!ctx->local.checksum_pool || type != CSYNC_FTW_TYPE_FILE
+            || fs->size != tmp->size || !tmp->checksumTypeId
+            || _csync_filetype_different(tmp, fs)) {
+        return false;
+    }
+    csync_checksum_pool_enqueue(ctx, st, file, tmp->checksumTypeId, tmp->checksum);
+    st->checksum_pending = 1;
+    st->instruction = CSYNC_INSTRUCTION_EVAL;
+    return true;
+}
+
 /**
  * The main function of the discovery/update pass.
  *
@@ -162,7 +203,6 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
     const csync_vio_file_stat_t *fs, const int type) {
   uint64_t h = 0;
   size_t len = 0;
-  size_t size = 0;
   const char *path = NULL;
   csync_file_stat_t *st = NULL;
   csync_file_stat_t *tmp = NULL;
@@ -189,7 +229,7 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
       excluded =CSYNC_FILE_EXCLUDE_STAT_FAILED;
   } else {
     /* Check if file is excluded */
-    excluded = csync_excluded_traversal(ctx->excludes, path, type);
+    excluded = csync_exclude_match_traversal(ctx->exclude_matcher, path, type);
   }
 
   if( excluded == CSYNC_NOT_EXCLUDED ) {
@@ -212,6 +252,11 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
       }
   }
 
+  if (ctx->callbacks.checkSyncScopeHook
+          && ctx->callbacks.checkSyncScopeHook(ctx->callbacks.update_callback_userdata, path, type)) {
+      return 1;
+  }
+
   if (ctx->current == REMOTE_REPLICA && ctx->callbacks.checkSelectiveSyncBlackListHook) {
       if (ctx->callbacks.checkSelectiveSyncBlackListHook(ctx->callbacks.update_callback_userdata, path)) {
           return 1;
@@ -222,9 +267,11 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
   if( h == 0 ) {
     return -1;
   }
-  size = sizeof(csync_file_stat_t) + len + 1;
-
-  st = c_malloc(size);
+  st = csync_file_stat_new(ctx, len);
+  if (st == NULL) {
+    ctx->status_code = CSYNC_STATUS_MEMORY_ERROR;
+    return -1;
+  }
 
   /* Set instruction by default to none */
   st->instruction = CSYNC_INSTRUCTION_NONE;
@@ -280,18 +327,24 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
             goto out;
         }
         if (ctx->current == LOCAL_REPLICA &&
-                (!_csync_mtime_equal(fs->mtime, tmp->modtime)
+                (!_csync_local_mtime_equal(fs, tmp)
                  // zero size in statedb can happen during migration
                  || (tmp->size != 0 && fs->size != tmp->size))) {
 
-            // Checksum comparison at this stage is only enabled for .eml files,
+            if (_csync_queue_checksum(ctx, st, file, fs, tmp, type)) {
+                goto out;
+            }
+
+            // Otherwise checksum comparison at this stage is only enabled for .eml files,
             // check #4754 #4755
             bool isEmlFile = csync_fnmatch("*.eml", file, FNM_CASEFOLD) == 0;
             if (isEmlFile && fs->size == tmp->size && tmp->checksumTypeId) {
                 if (ctx->callbacks.checksum_hook) {
-                    st->checksum = ctx->callbacks.checksum_hook(
+                    const char *checksum = ctx->callbacks.checksum_hook(
                                 file, tmp->checksumTypeId,
                                 ctx->callbacks.checksum_userdata);
+                    st->checksum = csync_file_stat_strdup(ctx, st, checksum);
+                    SAFE_FREE(checksum);
                 }
                 bool checksumIdentical = false;
                 if (st->checksum) {
@@ -313,6 +366,14 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
             st->instruction = CSYNC_INSTRUCTION_EVAL;
             goto out;
         }
+        if (ctx->current == LOCAL_REPLICA && !_csync_local_ctime_equal(fs, tmp)
+                && _csync_queue_checksum(ctx, st, file, fs, tmp, type)) {
+            /* Same size and modification time, but the status of the file changed: it may
+             * have been written with its modification time restored (touch -r, rsync -t...),
+             * or only its permissions or attributes changed. The checksum tells. */
+            CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "ctime changed, comparing the checksum: %s", path);
+            goto out;
+        }
         bool metadata_differ = (ctx->current == REMOTE_REPLICA && (!c_streq(fs->file_id, tmp->file_id)
                                                             || !c_streq(fs->remotePerm, tmp->remotePerm)))
                              || (ctx->current == LOCAL_REPLICA && fs->inode != tmp->inode);
@@ -326,6 +387,20 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
             CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "Reading from database: %s", path);
             ctx->remote.read_from_db = true;
         }
+        if (type == CSYNC_FTW_TYPE_DIR && ctx->current == LOCAL_REPLICA
+                && !metadata_differ && ctx->callbacks.checkLocalDirectoryDirtyHook
+                && !ctx->callbacks.checkLocalDirectoryDirtyHook(ctx->callbacks.update_callback_userdata, path)) {
+            /* The mtime and inode of the directory are unchanged and nothing was
+             * reported as changed inside of it: take its contents from the database.
+             */
+            CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "Reading local directory from database: %s", path);
+            ctx->local.read_from_db = true;
+            /* The database only knows about the files ignored on the server. Assume there
+             * are ignored files here, so the directory is not removed together with them
+             * if it was removed on the server. The next full local discovery cleans up.
+             */
+            st->has_ignored_files = true;
+        }
         /* If it was remembered in the db that the remote dir has ignored files, store
          * that so that the reconciler can make advantage of.
          */
@@ -383,9 +458,11 @@ static int _csync_detect_update(CSYNC *ctx, const char *file,
             // Verify the checksum where possible
             if (isRename && tmp->checksumTypeId && ctx->callbacks.checksum_hook
                     && fs->type == CSYNC_VIO_FILE_TYPE_REGULAR) {
-                st->checksum = ctx->callbacks.checksum_hook(
+                const char *checksum = ctx->callbacks.checksum_hook(
                             file, tmp->checksumTypeId,
                             ctx->callbacks.checksum_userdata);
+                st->checksum = csync_file_stat_strdup(ctx, st, checksum);
+                SAFE_FREE(checksum);
                 if (st->checksum) {
                     CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "checking checksum of potential rename %s %s <-> %s", path, st->checksum, tmp->checksum);
                     st->checksumTypeId = tmp->checksumTypeId;
@@ -477,6 +554,7 @@ out:
   if (st->instruction != CSYNC_INSTRUCTION_NONE
       && st->instruction != CSYNC_INSTRUCTION_IGNORE
       && st->instruction != CSYNC_INSTRUCTION_UPDATE_METADATA
+      && !st->checksum_pending
       && type != CSYNC_FTW_TYPE_DIR) {
     st->child_modified = 1;
   }
@@ -487,20 +565,20 @@ out:
   st->mode  = fs->mode;
   st->size  = fs->size;
   st->modtime = fs->mtime;
+  st->modtime_nsec = fs->mtime_nsec;
+#ifndef _WIN32
+  /* On Windows ctime is the creation time, it does not tell about changes */
+  st->ctime = fs->ctime;
+  st->ctime_nsec = fs->ctime_nsec;
+#endif
   st->type  = type;
-  st->etag   = NULL;
-  if( fs->etag ) {
-      SAFE_FREE(st->etag);
-      st->etag  = c_strdup(fs->etag);
-  }
+  st->etag = csync_file_stat_strdup(ctx, st, fs->etag);
   csync_vio_set_file_id(st->file_id, fs->file_id);
   if (fs->fields & CSYNC_VIO_FILE_STAT_FIELDS_DIRECTDOWNLOADURL) {
-      SAFE_FREE(st->directDownloadUrl);
-      st->directDownloadUrl = c_strdup(fs->directDownloadUrl);
+      st->directDownloadUrl = csync_file_stat_strdup(ctx, st, fs->directDownloadUrl);
   }
   if (fs->fields & CSYNC_VIO_FILE_STAT_FIELDS_DIRECTDOWNLOADCOOKIES) {
-      SAFE_FREE(st->directDownloadCookies);
-      st->directDownloadCookies = c_strdup(fs->directDownloadCookies);
+      st->directDownloadCookies = csync_file_stat_strdup(ctx, st, fs->directDownloadCookies);
   }
   if (fs->fields & CSYNC_VIO_FILE_STAT_FIELDS_PERM) {
       strncpy(st->remotePerm, fs->remotePerm, REMOTE_PERM_BUF_SIZE);
@@ -512,14 +590,14 @@ out:
 
   switch (ctx->current) {
     case LOCAL_REPLICA:
-      if (c_rbtree_insert(ctx->local.tree, (void *) st) < 0) {
+      if (c_htable_insert(ctx->local.tree, (void *) st) < 0) {
         csync_file_stat_free(st);
         ctx->status_code = CSYNC_STATUS_TREE_ERROR;
         return -1;
       }
       break;
     case REMOTE_REPLICA:
-      if (c_rbtree_insert(ctx->remote.tree, (void *) st) < 0) {
+      if (c_htable_insert(ctx->remote.tree, (void *) st) < 0) {
         csync_file_stat_free(st);
         ctx->status_code = CSYNC_STATUS_TREE_ERROR;
         return -1;
@@ -603,6 +681,11 @@ int csync_walker(CSYNC *ctx, const char *file, const csync_vio_file_stat_t *fs,
 
 static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
 {
+    /* The database contains paths relative to the root of the sync folder */
+    if (ctx->current == LOCAL_REPLICA) {
+        uri += strlen(ctx->local.uri) + 1;
+    }
+
     if( csync_statedb_get_below_path(ctx, uri) < 0 ) {
         CSYNC_LOG(CSYNC_LOG_PRIORITY_ERROR, "StateDB could not be read!");
         return false;
@@ -640,12 +723,15 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
   csync_vio_file_stat_t *dirent = NULL;
   csync_file_stat_t *previous_fs = NULL;
   int read_from_db = 0;
+  int local_read_from_db = 0;
   int rc = 0;
   int res = 0;
 
-  bool do_read_from_db = (ctx->current == REMOTE_REPLICA && ctx->remote.read_from_db);
+  bool do_read_from_db = (ctx->current == REMOTE_REPLICA && ctx->remote.read_from_db)
+          || (ctx->current == LOCAL_REPLICA && ctx->local.read_from_db);
 
   read_from_db = ctx->remote.read_from_db;
+  local_read_from_db = ctx->local.read_from_db;
 
   // if the etag of this dir is still the same, its content is restored from the
   // database.
@@ -806,7 +892,7 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
         goto error;
       }
 
-      if (ctx->current_fs && !ctx->current_fs->child_modified
+      if (ctx->current_fs && !ctx->current_fs->child_modified && !ctx->current_fs->checksum_pending
           && ctx->current_fs->instruction == CSYNC_INSTRUCTION_EVAL) {
           if (ctx->current == REMOTE_REPLICA) {
               ctx->current_fs->instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
@@ -826,8 +912,14 @@ int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
         previous_fs->child_modified = ctx->current_fs->child_modified;
     }
 
+    if (ctx->current_fs && previous_fs && ctx->current_fs->checksum_pending) {
+        /* The parent directory cannot be settled before the checksums either */
+        previous_fs->checksum_pending = 1;
+    }
+
     ctx->current_fs = previous_fs;
     ctx->remote.read_from_db = read_from_db;
+    ctx->local.read_from_db = local_read_from_db;
     SAFE_FREE(filename);
     csync_vio_file_stat_destroy(dirent);
     dirent = NULL;
@@ -842,6 +934,7 @@ done:
   return rc;
 error:
   ctx->remote.read_from_db = read_from_db;
+  ctx->local.read_from_db = local_read_from_db;
   if (dh != NULL) {
     csync_vio_closedir(ctx, dh);
   }
@@ -849,4 +942,63 @@ error:
   return -1;
 }
 
+static void _csync_checksum_result(CSYNC *ctx, csync_file_stat_t *st,
+    const char *checksum, uint32_t checksumTypeId, const char *expectedChecksum) {
+  bool checksumIdentical = false;
+
+  if (checksum) {
+    st->checksum = csync_file_stat_strdup(ctx, st, checksum);
+    st->checksumTypeId = checksumTypeId;
+    checksumIdentical = strncmp(st->checksum, expectedChecksum, 1000) == 0;
+  }
+  if (checksumIdentical) {
+    CSYNC_LOG(CSYNC_LOG_PRIORITY_TRACE, "NOTE: Checksums are identical, file did not actually change: %s", st->path);
+    st->instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
+  } else {
+    st->instruction = CSYNC_INSTRUCTION_EVAL;
+    st->child_modified = 1;
+  }
+}
+
+int csync_update_resolve_checksums(CSYNC *ctx) {
+  c_htable_t *tree = ctx->local.tree;
+  size_t i;
+
+  if (!ctx->local.checksum_pool) {
+    return 0;
+  }
+  if (csync_checksum_pool_finish(ctx, _csync_checksum_result) < 0) {
+    ctx->status_code = CSYNC_STATUS_ABORTED;
+    return -1;
+  }
+
+  /* Children come after their parent in the tree, so going backwards settles all
+   * the children of a directory before the directory itself */
+  for (i = c_htable_size(tree); i > 0; i--) {
+    csync_file_stat_t *st = tree->entries[i - 1];
+    csync_file_stat_t *parent = NULL;
+    const char *slash = NULL;
+
+    if (!st->checksum_pending) {
+      continue;
+    }
+    st->checksum_pending = 0;
+
+    if (st->type == CSYNC_FTW_TYPE_DIR && !st->child_modified
+        && st->instruction == CSYNC_INSTRUCTION_EVAL) {
+      st->instruction = CSYNC_INSTRUCTION_NONE;
+    }
+
+    slash = strrchr(st->path, '/');
+    if (st->child_modified && slash) {
+      parent = c_htable_find(tree, c_jhash64((uint8_t *) st->path, slash - st->path, 0));
+      if (parent) {
+        parent->child_modified = 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
 /* vim: set ts=8 sw=2 et cindent: */
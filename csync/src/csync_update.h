@@ -94,6 +94,19 @@ int csync_walker(CSYNC *ctx, const char *file, const csync_vio_file_stat_t *fs,
 int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
     unsigned int depth);
 
+/**
+ * @brief Set the instructions that wait for the checksums of local files.
+ *
+ * The local files that were touched without changing their size are hashed in the
+ * background of the update phase, see csync_checksum_pool.h. This waits for them and
+ * sets their instruction, and the one of their parent directories.
+ *
+ * @param  ctx          The csync context to use.
+ *
+ * @return 0 on success, < 0 if the sync was aborted.
+ */
+int csync_update_resolve_checksums(CSYNC *ctx);
+
 #endif /* _CSYNC_UPDATE_H */
 
 /* vim: set ft=c.doxygen ts=8 sw=2 et cindent: */
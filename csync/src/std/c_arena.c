@@ -0,0 +1,138 @@
+/*
+ * cynapses libc functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "c_macro.h"
+#include "c_alloc.h"
+#include "c_arena.h"
+
+/* Allocations are aligned like the ones of malloc on 64 bit systems */
+#define C_ARENA_ALIGNMENT 16
+#define C_ARENA_ALIGN(x) (((x) + C_ARENA_ALIGNMENT - 1) & ~((size_t) C_ARENA_ALIGNMENT - 1))
+
+struct c_arena_block_s {
+  struct c_arena_block_s *next;
+  size_t size;
+  size_t used;
+};
+
+struct c_arena_s {
+  struct c_arena_block_s *blocks; /* the current block first */
+  size_t block_size;
+  size_t total_size;
+};
+
+#define C_ARENA_HEADER_SIZE C_ARENA_ALIGN(sizeof(struct c_arena_block_s))
+
+c_arena_t *c_arena_new(size_t block_size) {
+  c_arena_t *arena = c_malloc(sizeof(c_arena_t));
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->block_size = block_size > C_ARENA_HEADER_SIZE ? block_size : 4096;
+  return arena;
+}
+
+static struct c_arena_block_s *_c_arena_add_block(c_arena_t *arena, size_t size) {
+  struct c_arena_block_s *block = NULL;
+  size_t block_size = arena->block_size;
+
+  if (size + C_ARENA_HEADER_SIZE > block_size) {
+    block_size = size + C_ARENA_HEADER_SIZE;
+  }
+  /* c_malloc zeroes the block, and so the allocations taken from it */
+  block = c_malloc(block_size);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->size = block_size;
+  block->used = C_ARENA_HEADER_SIZE;
+
+  if (block_size > arena->block_size && arena->blocks != NULL) {
+    /* A big allocation, keep filling the current block */
+    block->next = arena->blocks->next;
+    arena->blocks->next = block;
+  } else {
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  arena->total_size += block_size;
+
+  return block;
+}
+
+void *c_arena_alloc(c_arena_t *arena, size_t size) {
+  struct c_arena_block_s *block = NULL;
+  void *ptr = NULL;
+
+  if (arena == NULL || size == 0) {
+    return NULL;
+  }
+  size = C_ARENA_ALIGN(size);
+
+  block = arena->blocks;
+  if (block == NULL || block->size - block->used < size) {
+    block = _c_arena_add_block(arena, size);
+    if (block == NULL) {
+      return NULL;
+    }
+  }
+
+  ptr = (char *) block + block->used;
+  block->used += size;
+
+  return ptr;
+}
+
+char *c_arena_strdup(c_arena_t *arena, const char *str) {
+  char *ret = NULL;
+  size_t len;
+
+  if (str == NULL) {
+    return NULL;
+  }
+  len = strlen(str);
+  ret = c_arena_alloc(arena, len + 1);
+  if (ret == NULL) {
+    return NULL;
+  }
+  memcpy(ret, str, len + 1);
+
+  return ret;
+}
+
+size_t c_arena_size(const c_arena_t *arena) {
+  return arena ? arena->total_size : 0;
+}
+
+void c_arena_free(c_arena_t *arena) {
+  struct c_arena_block_s *block = NULL;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  block = arena->blocks;
+  while (block != NULL) {
+    struct c_arena_block_s *next = block->next;
+    SAFE_FREE(block);
+    block = next;
+  }
+  SAFE_FREE(arena);
+}
@@ -0,0 +1,91 @@
+/*
+ * cynapses libc functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file c_arena.h
+ *
+ * @brief Interface of the cynapses libc arena allocator
+ *
+ * An arena hands out memory from big blocks and releases all of it at once.
+ * There is no way to free a single allocation.
+ *
+ * @defgroup cynArenaInternals cynapses libc arena functions
+ * @ingroup cynLibraryAPI
+ *
+ * @{
+ */
+
+#ifndef _C_ARENA_H
+#define _C_ARENA_H
+
+#include <stdlib.h>
+
+typedef struct c_arena_s c_arena_t;
+
+/**
+ * @brief Create a new arena.
+ *
+ * @param block_size  Size in bytes of the blocks the memory is taken from.
+ *                    Bigger allocations get a block of their own.
+ *
+ * @return The new arena, to be released with c_arena_free().
+ */
+c_arena_t *c_arena_new(size_t block_size);
+
+/**
+ * @brief Allocate memory from the arena.
+ *
+ * The memory is set to zero and aligned for any type.
+ *
+ * @param arena  The arena to allocate from.
+ * @param size   Size in bytes to allocate.
+ *
+ * @return A pointer valid until the arena is freed. If size is 0, NULL is returned.
+ */
+void *c_arena_alloc(c_arena_t *arena, size_t size);
+
+/**
+ * @brief Duplicate a string into the arena.
+ *
+ * @param arena  The arena to allocate from.
+ * @param str    String to duplicate.
+ *
+ * @return The copy, valid until the arena is freed, or NULL if str is NULL.
+ */
+char *c_arena_strdup(c_arena_t *arena, const char *str);
+
+/**
+ * @brief Get the amount of memory the arena took from the system.
+ *
+ * @param arena  The arena to check.
+ *
+ * @return The size of all blocks in bytes.
+ */
+size_t c_arena_size(const c_arena_t *arena);
+
+/**
+ * @brief Release the arena and all memory allocated from it.
+ *
+ * @param arena  The arena to free, may be NULL.
+ */
+void c_arena_free(c_arena_t *arena);
+
+/**
+ * }@
+ */
+#endif /* _C_ARENA_H */
@@ -0,0 +1,172 @@
+/*
+ * cynapses libc functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+
+#include "c_macro.h"
+#include "c_alloc.h"
+#include "c_htable.h"
+
+#define C_HTABLE_MIN_SLOTS 64
+
+/* The keys may be anything, spread them over the slots (finalizer of MurmurHash3) */
+static size_t _c_htable_slot_of(const c_htable_t *table, uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (size_t) key & (table->slot_count - 1);
+}
+
+static struct c_htable_slot_s *_c_htable_lookup(const c_htable_t *table, uint64_t key) {
+  size_t i = _c_htable_slot_of(table, key);
+
+  /* linear probing, there always are empty slots */
+  while (table->slots[i].index != 0 && table->slots[i].key != key) {
+    i = (i + 1) & (table->slot_count - 1);
+  }
+  return &table->slots[i];
+}
+
+static int _c_htable_rehash(c_htable_t *table, size_t slot_count) {
+  struct c_htable_slot_s *old_slots = table->slots;
+  size_t old_count = table->slot_count;
+  size_t i;
+
+  table->slots = c_calloc(slot_count, sizeof(struct c_htable_slot_s));
+  if (table->slots == NULL) {
+    table->slots = old_slots;
+    errno = ENOMEM;
+    return -1;
+  }
+  table->slot_count = slot_count;
+
+  for (i = 0; i < old_count; i++) {
+    if (old_slots[i].index != 0) {
+      *_c_htable_lookup(table, old_slots[i].key) = old_slots[i];
+    }
+  }
+  SAFE_FREE(old_slots);
+
+  return 0;
+}
+
+int c_htable_create(c_htable_t **table, c_htable_key_func *key) {
+  if (table == NULL || key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *table = c_malloc(sizeof(c_htable_t));
+  if (*table == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+  (*table)->key = key;
+
+  return 0;
+}
+
+void c_htable_destroy(c_htable_t *table, void (*destructor)(void *)) {
+  size_t i;
+
+  if (table == NULL) {
+    return;
+  }
+
+  if (destructor != NULL) {
+    for (i = 0; i < table->size; i++) {
+      destructor(table->entries[i]);
+    }
+  }
+  SAFE_FREE(table->entries);
+  SAFE_FREE(table->slots);
+  SAFE_FREE(table);
+}
+
+int c_htable_insert(c_htable_t *table, void *data) {
+  struct c_htable_slot_s *slot = NULL;
+  uint64_t key;
+
+  if (table == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* keep the load below 70%, the probe sequences stay short */
+  if ((table->size + 1) * 10 > table->slot_count * 7) {
+    size_t slot_count = table->slot_count ? table->slot_count * 2 : C_HTABLE_MIN_SLOTS;
+    if (_c_htable_rehash(table, slot_count) < 0) {
+      return -1;
+    }
+  }
+
+  key = table->key(data);
+  slot = _c_htable_lookup(table, key);
+  if (slot->index != 0) {
+    return 1;
+  }
+
+  if (table->size == table->allocated) {
+    size_t allocated = table->allocated ? table->allocated * 2 : C_HTABLE_MIN_SLOTS;
+    void **entries = c_realloc(table->entries, allocated * sizeof(void *));
+    if (entries == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    table->entries = entries;
+    table->allocated = allocated;
+  }
+
+  table->entries[table->size++] = data;
+  slot->key = key;
+  slot->index = table->size;
+
+  return 0;
+}
+
+void *c_htable_find(const c_htable_t *table, uint64_t key) {
+  const struct c_htable_slot_s *slot = NULL;
+
+  if (table == NULL || table->size == 0) {
+    return NULL;
+  }
+
+  slot = _c_htable_lookup(table, key);
+  if (slot->index == 0) {
+    return NULL;
+  }
+  return table->entries[slot->index - 1];
+}
+
+int c_htable_walk(c_htable_t *table, void *data, c_htable_visit_func *visitor) {
+  size_t i;
+
+  if (table == NULL || data == NULL || visitor == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* by index: the visitor may insert */
+  for (i = 0; i < table->size; i++) {
+    if ((*visitor)(table->entries[i], data) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
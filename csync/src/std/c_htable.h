@@ -0,0 +1,137 @@
+/*
+ * cynapses libc functions
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file c_htable.h
+ *
+ * @brief Interface of the cynapses libc hash table
+ *
+ * A hash table of pointers keyed by a 64 bit integer which is derived from
+ * the data, like the path hash of a file. The keys are kept in an open
+ * addressing table next to the index of their data, so a lookup only touches
+ * the data it returns. The data is kept in insertion order, which is also
+ * the order c_htable_walk() visits it in.
+ *
+ * There is no way to remove a single entry.
+ *
+ * @defgroup cynHashTableInternals cynapses libc hash table functions
+ * @ingroup cynLibraryAPI
+ *
+ * @{
+ */
+
+#ifndef _C_HTABLE_H
+#define _C_HTABLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief Callback function returning the key of the data of an entry.
+ */
+typedef uint64_t c_htable_key_func(const void *data);
+
+/**
+ * @brief Visit function for the c_htable_walk() function.
+ *
+ * @param obj    The data of the entry.
+ * @param data   The generic pointer passed to c_htable_walk().
+ *
+ * @return 0 on success, < 0 to stop the walk with an error.
+ */
+typedef int c_htable_visit_func(void *obj, void *data);
+
+struct c_htable_slot_s {
+  uint64_t key;
+  size_t index; /* index in entries plus one, 0 for an empty slot */
+};
+
+/**
+ * Structure that represents a hash table
+ */
+struct c_htable_s {
+  c_htable_key_func *key;
+  void **entries; /* the data in insertion order */
+  size_t size;
+  size_t allocated;
+  struct c_htable_slot_s *slots;
+  size_t slot_count; /* a power of two */
+};
+typedef struct c_htable_s c_htable_t;
+
+/**
+ * @brief Create a hash table.
+ *
+ * @param table  The pointer to assign the allocated table to.
+ * @param key    Callback function returning the key of the data.
+ *
+ * @return 0 on success, less than 0 with errno set if an error occurred.
+ */
+int c_htable_create(c_htable_t **table, c_htable_key_func *key);
+
+/**
+ * @brief Destroy the content of a hash table and free it.
+ *
+ * @param table       The table to destroy, may be NULL.
+ * @param destructor  Called for the data of each entry, may be NULL.
+ */
+void c_htable_destroy(c_htable_t *table, void (*destructor)(void *));
+
+/**
+ * @brief Insert data into the hash table.
+ *
+ * @param table  The table to insert the data to.
+ * @param data   The data to insert.
+ *
+ * @return  0 on success, 1 if there already is data with the same key and
+ *          < 0 if an error occurred with errno set.
+ */
+int c_htable_insert(c_htable_t *table, void *data);
+
+/**
+ * @brief Find data in the hash table.
+ *
+ * @param table  The table to search, may be NULL.
+ * @param key    The key to search for.
+ *
+ * @return The data with that key, NULL if there is none.
+ */
+void *c_htable_find(const c_htable_t *table, uint64_t key);
+
+/**
+ * @brief Walk over the hash table.
+ *
+ * Call a visitor function for the data of each entry, in insertion order.
+ *
+ * @param table    Table to walk.
+ * @param data     Data which should be passed to the visitor function.
+ * @param visitor  Visitor function.
+ *
+ * @return 0 on success, less than 0 if an error occurred.
+ */
+int c_htable_walk(c_htable_t *table, void *data, c_htable_visit_func *visitor);
+
+/**
+ * @brief Get the number of entries of the hash table.
+ */
+#define c_htable_size(T) ((T) == NULL ? 0 : (T)->size)
+
+/**
+ * }@
+ */
+#endif /* _C_HTABLE_H */
@@ -24,7 +24,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "c_private.h"
 #include "c_lib.h"
@@ -44,6 +46,8 @@ typedef struct dhandle_s {
   char *path;
 } dhandle_t;
 
+static void _csync_vio_local_fill_file_stat(const csync_stat_t *sb, csync_vio_file_stat_t *buf);
+
 csync_vio_handle_t *csync_vio_local_opendir(const char *name) {
   dhandle_t *handle = NULL;
   mbchar_t *dirname = NULL;
@@ -83,6 +87,105 @@ int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
   return rc;
 }
 
+#ifdef HAVE_FSTATAT
+#ifdef HAVE_STATX
+/* Only ask for what csync uses, the access time is not needed */
+#define CSYNC_VIO_LOCAL_STATX_MASK \
+  (STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME)
+
+static pthread_once_t _csync_vio_local_statx_once = PTHREAD_ONCE_INIT;
+static int _csync_vio_local_statx_unsupported = 0;
+
+/* Probed once, before the first use from any of the prefetch threads */
+static void _csync_vio_local_statx_probe(void) {
+  struct statx stx;
+
+  if (statx(AT_FDCWD, "/", 0, STATX_TYPE, &stx) < 0 && (errno == ENOSYS || errno == EPERM)) {
+    /* Kernel older than 4.11, or a sandbox filtering the system call */
+    _csync_vio_local_statx_unsupported = 1;
+  }
+}
+
+static int _csync_vio_local_statx(int dirfd, const char *name, csync_stat_t *sb) {
+  struct statx stx;
+
+  pthread_once(&_csync_vio_local_statx_once, _csync_vio_local_statx_probe);
+  if (_csync_vio_local_statx_unsupported) {
+    return fstatat(dirfd, name, sb, AT_SYMLINK_NOFOLLOW);
+  }
+  if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, CSYNC_VIO_LOCAL_STATX_MASK, &stx) < 0) {
+    return -1;
+  }
+  if ((stx.stx_mask & CSYNC_VIO_LOCAL_STATX_MASK) != CSYNC_VIO_LOCAL_STATX_MASK) {
+    /* The file system could not tell some of the fields */
+    return fstatat(dirfd, name, sb, AT_SYMLINK_NOFOLLOW);
+  }
+
+  ZERO_STRUCTP(sb);
+  sb->st_mode = stx.stx_mode;
+  sb->st_ino = stx.stx_ino;
+  sb->st_size = stx.stx_size;
+  sb->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+  sb->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+  sb->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+  sb->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+  return 0;
+}
+#endif
+
+/*
+ * Stat the entry relative to the open directory, so the kernel does not resolve
+ * the whole path again for every file. csync_vio_local_stat() then has nothing
+ * left to do. If it fails, the entry is left as is and csync_vio_local_stat()
+ * tries again with the full path and reports the error.
+ */
+static void _csync_vio_local_stat_entry(dhandle_t *handle, const struct _tdirent *dirent,
+                                        csync_vio_file_stat_t *file_stat) {
+  csync_stat_t sb;
+  int saved_errno = errno;
+  int rc = -1;
+
+#if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__)
+  /* Special files are not synced, their type is all csync needs */
+  switch (dirent->d_type) {
+    case DT_FIFO:
+      file_stat->type = CSYNC_VIO_FILE_TYPE_FIFO;
+      file_stat->mode = S_IFIFO;
+      break;
+    case DT_SOCK:
+      file_stat->type = CSYNC_VIO_FILE_TYPE_SOCKET;
+      file_stat->mode = S_IFSOCK;
+      break;
+    case DT_CHR:
+      file_stat->type = CSYNC_VIO_FILE_TYPE_CHARACTER_DEVICE;
+      file_stat->mode = S_IFCHR;
+      break;
+    case DT_BLK:
+      file_stat->type = CSYNC_VIO_FILE_TYPE_BLOCK_DEVICE;
+      file_stat->mode = S_IFBLK;
+      break;
+    default:
+      file_stat->mode = 0;
+      break;
+  }
+  if (file_stat->mode != 0) {
+    file_stat->fields |= CSYNC_VIO_FILE_STAT_FIELDS_TYPE | CSYNC_VIO_FILE_STAT_FIELDS_MODE;
+    return;
+  }
+#endif
+
+#ifdef HAVE_STATX
+  rc = _csync_vio_local_statx(dirfd(handle->dh), dirent->d_name, &sb);
+#else
+  rc = fstatat(dirfd(handle->dh), dirent->d_name, &sb, AT_SYMLINK_NOFOLLOW);
+#endif
+  if (rc == 0) {
+    _csync_vio_local_fill_file_stat(&sb, file_stat);
+  }
+  errno = saved_errno;
+}
+#endif
+
 csync_vio_file_stat_t *csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
 
   dhandle_t *handle = NULL;
@@ -138,6 +241,13 @@ csync_vio_file_stat_t *csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
   }
 #endif
 
+#ifdef HAVE_FSTATAT
+  if (file_stat->name != NULL
+      && strcmp(dirent->d_name, ".") != 0 && strcmp(dirent->d_name, "..") != 0) {
+    _csync_vio_local_stat_entry(handle, dirent, file_stat);
+  }
+#endif
+
   return file_stat;
 
 err:
@@ -150,6 +260,11 @@ err:
 int csync_vio_local_stat(const char *uri, csync_vio_file_stat_t *buf) {
   csync_stat_t sb;
 
+  /* Already done by csync_vio_local_readdir(), the mode is only known from a stat */
+  if (buf->fields & CSYNC_VIO_FILE_STAT_FIELDS_MODE) {
+    return 0;
+  }
+
   mbchar_t *wuri = c_utf8_path_to_locale( uri );
 
   if( _tstat(wuri, &sb) < 0) {
@@ -157,9 +272,16 @@ int csync_vio_local_stat(const char *uri, csync_vio_file_stat_t *buf) {
     return -1;
   }
 
+  _csync_vio_local_fill_file_stat(&sb, buf);
+
+  c_free_locale_string(wuri);
+  return 0;
+}
+
+static void _csync_vio_local_fill_file_stat(const csync_stat_t *sb, csync_vio_file_stat_t *buf) {
   buf->fields = CSYNC_VIO_FILE_STAT_FIELDS_NONE;
 
-  switch(sb.st_mode & S_IFMT) {
+  switch(sb->st_mode & S_IFMT) {
     case S_IFBLK:
       buf->type = CSYNC_VIO_FILE_TYPE_BLOCK_DEVICE;
       break;
@@ -187,7 +309,7 @@ int csync_vio_local_stat(const char *uri, csync_vio_file_stat_t *buf) {
   }
   buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_TYPE;
 
-  buf->mode = sb.st_mode;
+  buf->mode = sb->st_mode;
   buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_MODE;
 
   if (buf->type == CSYNC_VIO_FILE_TYPE_SYMBOLIC_LINK) {
@@ -197,27 +319,32 @@ int csync_vio_local_stat(const char *uri, csync_vio_file_stat_t *buf) {
     buf->flags = CSYNC_VIO_FILE_FLAGS_NONE;
   }
 #ifdef __APPLE__
-  if (sb.st_flags & UF_HIDDEN) {
+  if (sb->st_flags & UF_HIDDEN) {
       buf->flags |= CSYNC_VIO_FILE_FLAGS_HIDDEN;
   }
 #endif
   buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_FLAGS;
 
-  buf->inode = sb.st_ino;
+  buf->inode = sb->st_ino;
   buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_INODE;
 
-  buf->atime = sb.st_atime;
+  buf->atime = sb->st_atime;
   buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_ATIME;
 
-  buf->mtime = sb.st_mtime;
+  buf->mtime = sb->st_mtime;
   buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_MTIME;
 
-  buf->ctime = sb.st_ctime;
+  buf->ctime = sb->st_ctime;
   buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_CTIME;
 
-  buf->size = sb.st_size;
-  buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_SIZE;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+  buf->mtime_nsec = sb->st_mtim.tv_nsec;
+  buf->ctime_nsec = sb->st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+  buf->mtime_nsec = sb->st_mtimespec.tv_nsec;
+  buf->ctime_nsec = sb->st_ctimespec.tv_nsec;
+#endif
 
-  c_free_locale_string(wuri);
-  return 0;
+  buf->size = sb->st_size;
+  buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_SIZE;
 }
@@ -205,6 +205,7 @@ csync_vio_file_stat_t *csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
     file_stat->fields |= CSYNC_VIO_FILE_STAT_FIELDS_ATIME;
 
     file_stat->mtime = FileTimeToUnixTime(&handle->ffd.ftLastWriteTime, &rem);
+    file_stat->mtime_nsec = rem * 100;
       /* CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG, "Local File MTime: %llu", (unsigned long long) buf->mtime ); */
     file_stat->fields |= CSYNC_VIO_FILE_STAT_FIELDS_MTIME;
 
@@ -265,6 +266,7 @@ int csync_vio_local_stat(const char *uri, csync_vio_file_stat_t *buf) {
     if (!(buf->fields & CSYNC_VIO_FILE_STAT_FIELDS_MTIME)) {
         DWORD rem;
         buf->mtime = FileTimeToUnixTime(&fileInfo.ftLastWriteTime, &rem);
+        buf->mtime_nsec = rem * 100;
         /* CSYNC_LOG(CSYNC_LOG_PRIORITY_DEBUG, "Local File MTime: %llu", (unsigned long long) buf->mtime ); */
         buf->fields |= CSYNC_VIO_FILE_STAT_FIELDS_MTIME;
     }
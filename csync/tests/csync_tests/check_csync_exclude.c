@@ -310,6 +310,56 @@ static void check_csync_pathes(void **state)
     assert_int_equal(rc, CSYNC_FILE_EXCLUDE_LIST);
 }
 
+static void check_csync_exclude_matcher(void **state)
+{
+    CSYNC *csync = *state;
+    csync_exclude_matcher_t *matcher;
+    int rc;
+
+    _csync_exclude_add(&(csync->excludes), "]*.tmp");
+    _csync_exclude_add(&(csync->excludes), "build/");
+    _csync_exclude_add(&(csync->excludes), "*cache*");
+    _csync_exclude_add(&(csync->excludes), "]foo*");
+
+    matcher = csync_exclude_matcher_new(csync->excludes);
+    assert_non_null(matcher);
+
+    /* the first matching pattern decides */
+    rc = csync_exclude_match_no_ctx(matcher, "dir/foo.tmp", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, CSYNC_FILE_EXCLUDE_AND_REMOVE);
+    rc = csync_exclude_match_no_ctx(matcher, "dir/foo.cache", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, CSYNC_FILE_EXCLUDE_LIST);
+    rc = csync_exclude_match_no_ctx(matcher, "dir/foobar", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, CSYNC_FILE_EXCLUDE_AND_REMOVE);
+    rc = csync_exclude_match_no_ctx(matcher, "dir/foobar", CSYNC_FTW_TYPE_DIR);
+    assert_int_equal(rc, CSYNC_FILE_EXCLUDE_LIST);
+
+    /* dir-only patterns */
+    rc = csync_exclude_match_traversal(matcher, "src/build", CSYNC_FTW_TYPE_DIR);
+    assert_int_equal(rc, CSYNC_FILE_EXCLUDE_LIST);
+    rc = csync_exclude_match_traversal(matcher, "src/build", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, CSYNC_NOT_EXCLUDED);
+    rc = csync_exclude_match_no_ctx(matcher, "src/build/main.o", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, CSYNC_FILE_EXCLUDE_LIST);
+
+    /* same answers as the exclude list itself */
+    rc = csync_excluded_no_ctx(csync->excludes, "mozilla/.htaccess", CSYNC_FTW_TYPE_DIR);
+    assert_int_equal(csync_exclude_match_no_ctx(matcher, "mozilla/.htaccess", CSYNC_FTW_TYPE_DIR), rc);
+    rc = csync_excluded_traversal(csync->excludes, "latex/songbook/my_manuscript.tex.tmp", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(csync_exclude_match_traversal(matcher, "latex/songbook/my_manuscript.tex.tmp", CSYNC_FTW_TYPE_FILE), rc);
+
+    /* the patterns are left alone */
+    assert_string_equal(csync->excludes->vector[csync->excludes->count - 3], "build/");
+
+    csync_exclude_matcher_free(matcher);
+
+    /* no patterns, only the built in ones */
+    rc = csync_exclude_match_no_ctx(NULL, ".csync_journal.db", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, CSYNC_FILE_SILENTLY_EXCLUDED);
+    rc = csync_exclude_match_no_ctx(NULL, "file.tmp", CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, CSYNC_NOT_EXCLUDED);
+}
+
 static void check_csync_is_windows_reserved_word() {
     assert_true(csync_is_windows_reserved_word("CON"));
     assert_true(csync_is_windows_reserved_word("con"));
@@ -372,6 +422,45 @@ static void check_csync_excluded_performance(void **state)
         const double perCallMs = total / 2 / N * 1000;
         printf("csync_excluded_traversal: %f ms per call\n", perCallMs);
     }
+
+    /* The same with the patterns compiled once, as the sync and ExcludedFiles do */
+    csync_exclude_matcher_t *matcher = csync_exclude_matcher_new(csync->excludes);
+    {
+        struct timeval before, after;
+        gettimeofday(&before, 0);
+
+        for (i = 0; i < N; ++i) {
+            totalRc += csync_exclude_match_no_ctx(matcher, "/this/is/quite/a/long/path/with/many/components", CSYNC_FTW_TYPE_DIR);
+            totalRc += csync_exclude_match_no_ctx(matcher, "/1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/27/29", CSYNC_FTW_TYPE_FILE);
+        }
+        assert_int_equal(totalRc, CSYNC_NOT_EXCLUDED); // mainly to avoid optimization
+
+        gettimeofday(&after, 0);
+
+        const double total = (after.tv_sec - before.tv_sec)
+                + (after.tv_usec - before.tv_usec) / 1.0e6;
+        const double perCallMs = total / 2 / N * 1000;
+        printf("csync_exclude_match_no_ctx: %f ms per call\n", perCallMs);
+    }
+
+    {
+        struct timeval before, after;
+        gettimeofday(&before, 0);
+
+        for (i = 0; i < N; ++i) {
+            totalRc += csync_exclude_match_traversal(matcher, "/this/is/quite/a/long/path/with/many/components", CSYNC_FTW_TYPE_DIR);
+            totalRc += csync_exclude_match_traversal(matcher, "/1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/27/29", CSYNC_FTW_TYPE_FILE);
+        }
+        assert_int_equal(totalRc, CSYNC_NOT_EXCLUDED); // mainly to avoid optimization
+
+        gettimeofday(&after, 0);
+
+        const double total = (after.tv_sec - before.tv_sec)
+                + (after.tv_usec - before.tv_usec) / 1.0e6;
+        const double perCallMs = total / 2 / N * 1000;
+        printf("csync_exclude_match_traversal: %f ms per call\n", perCallMs);
+    }
+    csync_exclude_matcher_free(matcher);
 }
 
 static void check_csync_exclude_expand_escapes(void **state)
@@ -401,6 +490,7 @@ int torture_run_tests(void)
         cmocka_unit_test_setup_teardown(check_csync_excluded, setup_init, teardown),
         cmocka_unit_test_setup_teardown(check_csync_excluded_traversal, setup_init, teardown),
         cmocka_unit_test_setup_teardown(check_csync_pathes, setup_init, teardown),
+        cmocka_unit_test_setup_teardown(check_csync_exclude_matcher, setup_init, teardown),
         cmocka_unit_test_setup_teardown(check_csync_is_windows_reserved_word, setup_init, teardown),
         cmocka_unit_test_setup_teardown(check_csync_excluded_performance, setup_init, teardown),
         cmocka_unit_test(check_csync_exclude_expand_escapes),
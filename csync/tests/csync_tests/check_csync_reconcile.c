@@ -0,0 +1,166 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include <stdio.h>
+
+#include "torture.h"
+
+#include "csync_private.h"
+#include "csync_reconcile.h"
+#include "c_jhash.h"
+
+#define TESTDB "/tmp/check_csync/journal.db"
+
+/* Enough entries for the reconcile to be split between the threads */
+#define DIR_COUNT 40
+#define FILES_PER_DIR 100
+
+static csync_file_stat_t *add_entry(c_htable_t *tree, const char *path, int type,
+    enum csync_instructions_e instruction)
+{
+    size_t len = strlen(path);
+    csync_file_stat_t *st = c_malloc(sizeof(csync_file_stat_t) + len + 1);
+
+    memcpy(st->path, path, len + 1);
+    st->pathlen = len;
+    st->phash = c_jhash64((uint8_t *) path, len, 0);
+    st->type = type;
+    st->instruction = instruction;
+    st->modtime = 42;
+    st->size = 42;
+    assert_int_equal(c_htable_insert(tree, st), 0);
+    return st;
+}
+
+/* The same trees for every context: a mix of unchanged, changed, new, removed
+ * and ignored entries on both sides */
+static void fill_trees(CSYNC *ctx)
+{
+    char path[64];
+    int d, f;
+
+    for (d = 0; d < DIR_COUNT; d++) {
+        snprintf(path, sizeof(path), "dir%d", d);
+        add_entry(ctx->local.tree, path, CSYNC_FTW_TYPE_DIR,
+            d % 7 == 0 ? CSYNC_INSTRUCTION_IGNORE : CSYNC_INSTRUCTION_NONE);
+        if (d % 5 != 0) {
+            add_entry(ctx->remote.tree, path, CSYNC_FTW_TYPE_DIR, CSYNC_INSTRUCTION_NONE);
+        }
+
+        for (f = 0; f < FILES_PER_DIR; f++) {
+            snprintf(path, sizeof(path), "dir%d/file%d", d, f);
+            switch (f % 6) {
+            case 0: /* unchanged */
+                add_entry(ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+                add_entry(ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+                break;
+            case 1: /* changed locally */
+                add_entry(ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL);
+                add_entry(ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+                break;
+            case 2: /* changed on both sides, a conflict every other time */
+                add_entry(ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL)->size = f;
+                add_entry(ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL)->size = f % 4 ? f : 0;
+                break;
+            case 3: /* new locally */
+                add_entry(ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL);
+                break;
+            case 4: /* removed on the server */
+                add_entry(ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+                break;
+            case 5: /* changed on the server */
+                add_entry(ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+                add_entry(ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL);
+                break;
+            }
+        }
+    }
+}
+
+static CSYNC *create_context(int threads)
+{
+    CSYNC *ctx;
+
+    csync_create(&ctx, "/tmp/check_csync1");
+    csync_init(ctx, TESTDB);
+    ctx->reconcile_threads = threads;
+    fill_trees(ctx);
+    return ctx;
+}
+
+static int reconcile(CSYNC *ctx)
+{
+    int rc;
+
+    ctx->current = LOCAL_REPLICA;
+    rc = csync_reconcile_updates(ctx);
+    if (rc < 0) {
+        return rc;
+    }
+    ctx->current = REMOTE_REPLICA;
+    return csync_reconcile_updates(ctx);
+}
+
+static void assert_same_instructions(c_htable_t *a, c_htable_t *b)
+{
+    size_t i;
+
+    assert_int_equal(c_htable_size(a), c_htable_size(b));
+    for (i = 0; i < c_htable_size(a); i++) {
+        csync_file_stat_t *sa = a->entries[i];
+        csync_file_stat_t *sb = b->entries[i];
+        assert_string_equal(sa->path, sb->path);
+        assert_int_equal(sa->instruction, sb->instruction);
+    }
+}
+
+static void check_csync_reconcile_threads(void **state)
+{
+    CSYNC *serial = create_context(1);
+    CSYNC *parallel = create_context(4);
+    csync_file_stat_t *st;
+
+    (void) state; /* unused */
+
+    assert_int_equal(reconcile(serial), 0);
+    assert_int_equal(reconcile(parallel), 0);
+
+    assert_same_instructions(serial->local.tree, parallel->local.tree);
+    assert_same_instructions(serial->remote.tree, parallel->remote.tree);
+
+    /* a few spot checks of the result itself */
+    st = c_htable_find(parallel->local.tree, c_jhash64((uint8_t *) "dir1/file3", 10, 0));
+    assert_int_equal(st->instruction, CSYNC_INSTRUCTION_NEW);
+    st = c_htable_find(parallel->local.tree, c_jhash64((uint8_t *) "dir1/file4", 10, 0));
+    assert_int_equal(st->instruction, CSYNC_INSTRUCTION_REMOVE);
+    st = c_htable_find(parallel->local.tree, c_jhash64((uint8_t *) "dir1/file1", 10, 0));
+    assert_int_equal(st->instruction, CSYNC_INSTRUCTION_SYNC);
+    st = c_htable_find(parallel->remote.tree, c_jhash64((uint8_t *) "dir1/file2", 10, 0));
+    assert_int_equal(st->instruction, CSYNC_INSTRUCTION_UPDATE_METADATA);
+
+    assert_int_equal(csync_destroy(serial), 0);
+    assert_int_equal(csync_destroy(parallel), 0);
+}
+
+int torture_run_tests(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(check_csync_reconcile_threads),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
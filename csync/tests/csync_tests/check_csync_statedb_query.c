@@ -96,6 +96,57 @@ static int setup_db(void **state)
 
 }
 
+static int setup_db_full(void **state)
+{
+    char *errmsg;
+    int rc = 0;
+    sqlite3 *db = NULL;
+
+    const char *sql = "CREATE TABLE IF NOT EXISTS metadata ("
+        "phash INTEGER(8),"
+        "pathlen INTEGER,"
+        "path VARCHAR(4096),"
+        "inode INTEGER,"
+        "uid INTEGER,"
+        "gid INTEGER,"
+        "mode INTEGER,"
+        "modtime INTEGER(8),"
+        "type INTEGER,"
+        "md5 VARCHAR(32),"
+        "fileid VARCHAR(128),"
+        "remotePerm VARCHAR(128),"
+        "filesize BIGINT,"
+        "ignoredChildrenRemote INT,"
+        "contentChecksum TEXT,"
+        "contentChecksumTypeId INTEGER,"
+        "modtimeNsec INTEGER,"
+        "ctime INTEGER(8),"
+        "ctimeNsec INTEGER,"
+        "PRIMARY KEY(phash)"
+        ");";
+
+    const char *sql2 = "INSERT INTO metadata"
+                       "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5,"
+                       " fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId) VALUES"
+                       "(42, 7, 'A/file1', 23, 0, 0, 0, 66, 0, 'etag1', 'id1', 'WDNV', 1024, 0, 'abcd', 1),"
+                       "(7, 1, 'A', 24, 0, 0, 0, 67, 2, 'etag2', 'id2', 'WDNVCK', 0, 0, NULL, 0),"
+                       "(1234, 7, 'A/file2', 0, 0, 0, 0, 68, 0, 'etag3', '', '', 2048, 0, NULL, 0);";
+
+    setup(state);
+    rc = sqlite3_open( TESTDB, &db);
+    assert_int_equal(rc, SQLITE_OK);
+
+    rc = sqlite3_exec( db, sql, NULL, NULL, &errmsg );
+    assert_int_equal(rc, SQLITE_OK);
+
+    rc = sqlite3_exec( db, sql2, NULL, NULL, &errmsg );
+    assert_int_equal(rc, SQLITE_OK);
+
+    sqlite3_close(db);
+
+    return 0;
+}
+
 static int teardown(void **state) {
     CSYNC *csync = *state;
     int rc = 0;
@@ -159,7 +210,7 @@ static void check_csync_statedb_insert_metadata(void **state)
         snprintf(st->path, 29, "file_%d" , i );
         st->phash = i;
 
-        rc = c_rbtree_insert(csync->local.tree, (void *) st);
+        rc = c_htable_insert(csync->local.tree, (void *) st);
         assert_int_equal(rc, 0);
     }
 
@@ -178,7 +229,7 @@ static void check_csync_statedb_write(void **state)
         snprintf(st->path, 29, "file_%d" , i );
         st->phash = i;
 
-        rc = c_rbtree_insert(csync->local.tree, (void *) st);
+        rc = c_htable_insert(csync->local.tree, (void *) st);
         assert_int_equal(rc, 0);
     }
 
@@ -208,6 +259,86 @@ static void check_csync_statedb_get_stat_by_inode_not_found(void **state)
     assert_null(tmp);
 }
 
+static void check_csync_statedb_index_lookups(void **state)
+{
+    CSYNC *csync = *state;
+    csync_file_stat_t *tmp;
+    int rc;
+
+    csync->statedb.index_max_entries = 10;
+    rc = csync_statedb_load_index(csync);
+    assert_int_equal(rc, 0);
+    assert_non_null(csync->statedb.index);
+    assert_int_equal(csync->statedb.index->count, 3);
+
+    tmp = csync_statedb_get_stat_by_hash(csync, (uint64_t) 42);
+    assert_non_null(tmp);
+    assert_int_equal(csync->statedb.lastReturnValue, SQLITE_ROW);
+    assert_string_equal(tmp->path, "A/file1");
+    assert_int_equal(tmp->inode, 23);
+    assert_int_equal(tmp->modtime, 66);
+    assert_string_equal(tmp->etag, "etag1");
+    assert_string_equal(tmp->file_id, "id1");
+    assert_string_equal(tmp->remotePerm, "WDNV");
+    assert_int_equal(tmp->size, 1024);
+    assert_string_equal(tmp->checksum, "abcd");
+    assert_int_equal(tmp->checksumTypeId, 1);
+    csync_file_stat_free(tmp);
+
+    tmp = csync_statedb_get_stat_by_inode(csync, (uint64_t) 24);
+    assert_non_null(tmp);
+    assert_int_equal(tmp->phash, 7);
+    assert_string_equal(tmp->path, "A");
+    assert_null(tmp->checksum);
+    csync_file_stat_free(tmp);
+
+    tmp = csync_statedb_get_stat_by_file_id(csync, "id1");
+    assert_non_null(tmp);
+    assert_int_equal(tmp->phash, 42);
+    csync_file_stat_free(tmp);
+
+    tmp = csync_statedb_get_stat_by_hash(csync, (uint64_t) 1234);
+    assert_non_null(tmp);
+    assert_string_equal(tmp->path, "A/file2");
+    csync_file_stat_free(tmp);
+
+    tmp = csync_statedb_get_stat_by_hash(csync, (uint64_t) 666);
+    assert_null(tmp);
+    assert_int_equal(csync->statedb.lastReturnValue, SQLITE_DONE);
+    tmp = csync_statedb_get_stat_by_inode(csync, (uint64_t) 666);
+    assert_null(tmp);
+    tmp = csync_statedb_get_stat_by_file_id(csync, "id666");
+    assert_null(tmp);
+
+    /* The index outlives the database connection */
+    csync_statedb_close(csync);
+    tmp = csync_statedb_get_stat_by_hash(csync, (uint64_t) 7);
+    assert_non_null(tmp);
+    assert_string_equal(tmp->etag, "etag2");
+    csync_file_stat_free(tmp);
+
+    csync_statedb_free_index(csync);
+    assert_null(csync->statedb.index);
+}
+
+static void check_csync_statedb_index_too_many_entries(void **state)
+{
+    CSYNC *csync = *state;
+    csync_file_stat_t *tmp;
+    int rc;
+
+    csync->statedb.index_max_entries = 2;
+    rc = csync_statedb_load_index(csync);
+    assert_int_equal(rc, 0);
+    assert_null(csync->statedb.index);
+
+    /* The lookups fall back to the queries */
+    tmp = csync_statedb_get_stat_by_hash(csync, (uint64_t) 42);
+    assert_non_null(tmp);
+    assert_string_equal(tmp->path, "A/file1");
+    csync_file_stat_free(tmp);
+}
+
 int torture_run_tests(void)
 {
     const struct CMUnitTest tests[] = {
@@ -217,6 +348,8 @@ int torture_run_tests(void)
         cmocka_unit_test_setup_teardown(check_csync_statedb_write, setup, teardown),
         cmocka_unit_test_setup_teardown(check_csync_statedb_get_stat_by_hash_not_found, setup_db, teardown),
         cmocka_unit_test_setup_teardown(check_csync_statedb_get_stat_by_inode_not_found, setup_db, teardown),
+        cmocka_unit_test_setup_teardown(check_csync_statedb_index_lookups, setup_db_full, teardown),
+        cmocka_unit_test_setup_teardown(check_csync_statedb_index_too_many_entries, setup_db_full, teardown),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -47,6 +47,9 @@ static void statedb_create_metadata_table(sqlite3 *db)
                           "ignoredChildrenRemote INT,"
                           "contentChecksum TEXT,"
                           "contentChecksumTypeId INTEGER,"
+                          "modtimeNsec INTEGER,"
+                          "ctime INTEGER(8),"
+                          "ctimeNsec INTEGER,"
                           "PRIMARY KEY(phash));";
 
         rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
@@ -254,7 +257,7 @@ static void check_csync_detect_update(void **state)
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
-    st = c_rbtree_node_data(csync->local.tree->root);
+    st = csync->local.tree->entries[0];
     assert_int_equal(st->instruction, CSYNC_INSTRUCTION_NEW);
 
     /* create a statedb */
@@ -283,7 +286,7 @@ static void check_csync_detect_update_db_none(void **state)
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
-    st = c_rbtree_node_data(csync->local.tree->root);
+    st = csync->local.tree->entries[0];
     assert_int_equal(st->instruction, CSYNC_INSTRUCTION_NEW);
 
 
@@ -310,7 +313,7 @@ static void check_csync_detect_update_db_eval(void **state)
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
-    st = c_rbtree_node_data(csync->local.tree->root);
+    st = csync->local.tree->entries[0];
     assert_int_equal(st->instruction, CSYNC_INSTRUCTION_NEW);
 
     /* create a statedb */
@@ -341,7 +344,7 @@ static void check_csync_detect_update_db_rename(void **state)
     /* the instruction should be set to rename */
     /*
      * temporarily broken.
-    st = c_rbtree_node_data(csync->local.tree->root);
+    st = csync->local.tree->entries[0];
     assert_int_equal(st->instruction, CSYNC_INSTRUCTION_RENAME);
 
     st->instruction = CSYNC_INSTRUCTION_UPDATED;
@@ -369,7 +372,7 @@ static void check_csync_detect_update_db_new(void **state)
     assert_int_equal(rc, 0);
 
     /* the instruction should be set to new  */
-    st = c_rbtree_node_data(csync->local.tree->root);
+    st = csync->local.tree->entries[0];
     assert_int_equal(st->instruction, CSYNC_INSTRUCTION_NEW);
 
 
@@ -379,6 +382,72 @@ static void check_csync_detect_update_db_new(void **state)
     csync_vio_file_stat_destroy(fs);
 }
 
+/* insert a file recorded with the given modification time */
+static void statedb_insert_file(sqlite3 *db, const char *path, time_t mtime, int mtime_nsec)
+{
+    char *stmt = sqlite3_mprintf("INSERT INTO metadata"
+                                 "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, filesize, modtimeNsec) VALUES"
+                                 "(%lld, %d, '%q', %d, 0, 0, 0, %lld, %d, '', %d, %d);",
+                                 (long long signed int) c_jhash64((uint8_t *) path, strlen(path), 0),
+                                 (int) strlen(path),
+                                 path,
+                                 619070,
+                                 (long long signed int) mtime,
+                                 CSYNC_FTW_TYPE_FILE,
+                                 157459,
+                                 mtime_nsec);
+    int rc = sqlite3_exec(db, stmt, NULL, NULL, NULL);
+    sqlite3_free(stmt);
+    assert_int_equal(rc, SQLITE_OK);
+}
+
+static enum csync_instructions_e detect_update_nsec(CSYNC *csync, const char *name, int mtime_nsec)
+{
+    csync_vio_file_stat_t *fs;
+    csync_file_stat_t *st;
+    char *file = NULL;
+    int rc;
+
+    fs = create_fstat(name, 0, 1217597845);
+    assert_non_null(fs);
+    fs->mtime_nsec = mtime_nsec;
+
+    assert_int_not_equal(asprintf(&file, "/tmp/check_csync1/%s", name), -1);
+    rc = _csync_detect_update(csync, file, fs, CSYNC_FTW_TYPE_FILE);
+    assert_int_equal(rc, 0);
+    SAFE_FREE(file);
+    csync_vio_file_stat_destroy(fs);
+
+    st = c_htable_find(csync->local.tree, c_jhash64((uint8_t *) name, strlen(name), 0));
+    assert_non_null(st);
+    return st->instruction;
+}
+
+/* the sub-second part of the modification time is compared when both sides know it */
+static void check_csync_detect_update_db_nsec(void **state)
+{
+    CSYNC *csync = *state;
+
+    sqlite3 *db = NULL;
+    int rc;
+
+    /* the connection of csync is read only */
+    rc = sqlite3_open(TESTDB, &db);
+    assert_int_equal(rc, SQLITE_OK);
+    statedb_insert_file(db, "same.txt", 1217597845, 500);
+    statedb_insert_file(db, "changed.txt", 1217597845, 500);
+    statedb_insert_file(db, "unknown_fs.txt", 1217597845, 500);
+    statedb_insert_file(db, "unknown_db.txt", 1217597845, 0);
+    sqlite3_close(db);
+    csync_set_statedb_exists(csync, 1);
+    csync->current = LOCAL_REPLICA;
+
+    assert_int_equal(detect_update_nsec(csync, "same.txt", 500), CSYNC_INSTRUCTION_NONE);
+    assert_int_equal(detect_update_nsec(csync, "changed.txt", 600), CSYNC_INSTRUCTION_EVAL);
+    assert_int_equal(detect_update_nsec(csync, "unknown_fs.txt", 0), CSYNC_INSTRUCTION_NONE);
+    assert_int_equal(detect_update_nsec(csync, "unknown_db.txt", 600), CSYNC_INSTRUCTION_NONE);
+}
+
 static void check_csync_detect_update_null(void **state)
 {
     CSYNC *csync = *state;
@@ -438,6 +507,7 @@ int torture_run_tests(void)
         cmocka_unit_test_setup_teardown(check_csync_detect_update_db_eval, setup, teardown),
         cmocka_unit_test_setup_teardown(check_csync_detect_update_db_rename, setup, teardown),
         cmocka_unit_test_setup_teardown(check_csync_detect_update_db_new, setup, teardown_rm),
+        cmocka_unit_test_setup_teardown(check_csync_detect_update_db_nsec, setup, teardown_rm),
         cmocka_unit_test_setup_teardown(check_csync_detect_update_null, setup, teardown_rm),
 
         cmocka_unit_test_setup_teardown(check_csync_ftw, setup_ftw, teardown_rm),
@@ -0,0 +1,156 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Compares the red-black tree the csync trees used to be kept in with the
+ * hash table they are kept in now: insert, lookup in random order and walk,
+ * with entries of about the size of a csync_file_stat_t keyed by the hash of
+ * a path.
+ *
+ * Usage: bench_std_c_htable [count...]   (default: 100000 1000000 5000000)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "std/c_alloc.h"
+#include "std/c_htable.h"
+#include "std/c_jhash.h"
+#include "std/c_rbtree.h"
+#include "std/c_time.h"
+
+typedef struct bench_entry_s {
+  uint64_t phash;
+  char payload[160]; /* the rest of a csync_file_stat_t and its path */
+} bench_entry_t;
+
+static uint64_t entry_key(const void *data) {
+  return ((const bench_entry_t *) data)->phash;
+}
+
+static int key_cmp(const void *key, const void *data) {
+  uint64_t a = *(const uint64_t *) key;
+  uint64_t b = ((const bench_entry_t *) data)->phash;
+  return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int data_cmp(const void *key, const void *data) {
+  return key_cmp(&((const bench_entry_t *) key)->phash, data);
+}
+
+static int count_visitor(void *obj, void *data) {
+  size_t *count = (size_t *) data;
+  *count += ((bench_entry_t *) obj)->payload[0] != 0;
+  return 0;
+}
+
+static void no_destructor(void *data) {
+  (void) data;
+}
+
+static double now_diff(struct timespec *start) {
+  struct timespec finish;
+  double diff;
+
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  diff = c_secdiff(finish, *start);
+  *start = finish;
+  return diff;
+}
+
+static void run(size_t count) {
+  bench_entry_t **entries = c_malloc(count * sizeof(bench_entry_t *));
+  uint64_t *lookups = c_malloc(count * sizeof(uint64_t));
+  c_rbtree_t *tree = NULL;
+  c_htable_t *table = NULL;
+  struct timespec start;
+  size_t i, found, visited;
+  char path[64];
+
+  /* like the update phase: directories of 100 files, parents first */
+  for (i = 0; i < count; i++) {
+    int len = snprintf(path, sizeof(path), "dir_%zu/file_%zu", i / 100, i % 100);
+    entries[i] = c_malloc(sizeof(bench_entry_t));
+    entries[i]->phash = c_jhash64((uint8_t *) path, len, 0);
+    entries[i]->payload[0] = 1;
+    lookups[i] = entries[i]->phash;
+  }
+  for (i = count - 1; i > 0; i--) {
+    size_t j = (size_t) rand() % (i + 1);
+    uint64_t tmp = lookups[i];
+    lookups[i] = lookups[j];
+    lookups[j] = tmp;
+  }
+
+  printf("%zu entries\n", count);
+
+  c_rbtree_create(&tree, key_cmp, data_cmp);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < count; i++) {
+    c_rbtree_insert(tree, entries[i]);
+  }
+  printf("  c_rbtree  insert %8.3f s", now_diff(&start));
+  for (i = 0, found = 0; i < count; i++) {
+    found += c_rbtree_find(tree, &lookups[i]) != NULL;
+  }
+  printf("  find %8.3f s", now_diff(&start));
+  visited = 0;
+  c_rbtree_walk(tree, &visited, count_visitor);
+  printf("  walk %8.3f s  (%zu/%zu)\n", now_diff(&start), found, visited);
+  c_rbtree_destroy(tree, no_destructor);
+
+  c_htable_create(&table, entry_key);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < count; i++) {
+    c_htable_insert(table, entries[i]);
+  }
+  printf("  c_htable  insert %8.3f s", now_diff(&start));
+  for (i = 0, found = 0; i < count; i++) {
+    found += c_htable_find(table, lookups[i]) != NULL;
+  }
+  printf("  find %8.3f s", now_diff(&start));
+  visited = 0;
+  c_htable_walk(table, &visited, count_visitor);
+  printf("  walk %8.3f s  (%zu/%zu)\n", now_diff(&start), found, visited);
+  c_htable_destroy(table, NULL);
+
+  for (i = 0; i < count; i++) {
+    SAFE_FREE(entries[i]);
+  }
+  SAFE_FREE(entries);
+  SAFE_FREE(lookups);
+}
+
+int main(int argc, char **argv) {
+  int i;
+
+  srand(42);
+
+  if (argc < 2) {
+    run(100000);
+    run(1000000);
+    run(5000000);
+    return 0;
+  }
+  for (i = 1; i < argc; i++) {
+    run(strtoul(argv[i], NULL, 10));
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include <stdint.h>
+
+#include "torture.h"
+
+#include "std/c_arena.h"
+
+struct test_s {
+  int answer;
+  char name[13];
+};
+
+static void check_c_arena_alloc(void **state)
+{
+  c_arena_t *arena = NULL;
+  struct test_s *p = NULL;
+  struct test_s *q = NULL;
+
+  (void) state; /* unused */
+
+  arena = c_arena_new(1024);
+  assert_non_null(arena);
+
+  p = c_arena_alloc(arena, sizeof(struct test_s));
+  assert_non_null(p);
+  assert_int_equal(p->answer, 0);
+  p->answer = 42;
+
+  q = c_arena_alloc(arena, sizeof(struct test_s));
+  assert_non_null(q);
+  assert_true(q != p);
+  assert_int_equal(q->answer, 0);
+  assert_int_equal((uintptr_t) q % 16, 0);
+  assert_int_equal(p->answer, 42);
+
+  assert_null(c_arena_alloc(arena, 0));
+
+  c_arena_free(arena);
+}
+
+static void check_c_arena_blocks(void **state)
+{
+  c_arena_t *arena = NULL;
+  char *small = NULL;
+  char *big = NULL;
+  int i;
+
+  (void) state; /* unused */
+
+  arena = c_arena_new(1024);
+
+  /* spans several blocks */
+  for (i = 0; i < 100; i++) {
+    small = c_arena_alloc(arena, 100);
+    assert_non_null(small);
+    memset(small, 'x', 100);
+  }
+  assert_true(c_arena_size(arena) >= 100 * 100);
+
+  /* bigger than a block */
+  big = c_arena_alloc(arena, 10000);
+  assert_non_null(big);
+  memset(big, 'y', 10000);
+  assert_true(c_arena_size(arena) >= 100 * 100 + 10000);
+
+  c_arena_free(arena);
+}
+
+static void check_c_arena_strdup(void **state)
+{
+  c_arena_t *arena = NULL;
+  char *tdup = NULL;
+
+  (void) state; /* unused */
+
+  arena = c_arena_new(64);
+
+  tdup = c_arena_strdup(arena, "test");
+  assert_string_equal(tdup, "test");
+
+  tdup = c_arena_strdup(arena, "a string which is longer than one block of the arena");
+  assert_string_equal(tdup, "a string which is longer than one block of the arena");
+
+  assert_null(c_arena_strdup(arena, NULL));
+
+  c_arena_free(arena);
+  c_arena_free(NULL);
+}
+
+int torture_run_tests(void)
+{
+  const UnitTest tests[] = {
+      unit_test(check_c_arena_alloc),
+      unit_test(check_c_arena_blocks),
+      unit_test(check_c_arena_strdup),
+  };
+
+  return run_tests(tests);
+}
@@ -0,0 +1,212 @@
+/*
+ * libcsync -- a library to sync a directory with another
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include <errno.h>
+
+#include "torture.h"
+
+#include "std/c_alloc.h"
+#include "std/c_htable.h"
+
+typedef struct test_s {
+  uint64_t key;
+  int number;
+} test_t;
+
+static uint64_t test_key(const void *data) {
+  return ((const test_t *) data)->key;
+}
+
+static int visitor(void *obj, void *data) {
+  test_t *a = (test_t *) obj;
+  int *expected = (int *) data;
+
+  /* insertion order */
+  assert_int_equal(a->number, *expected);
+  (*expected)++;
+
+  return 0;
+}
+
+static int failing_visitor(void *obj, void *data) {
+  (void) obj;
+  (void) data;
+  return -1;
+}
+
+static void destructor(void *data) {
+  test_t *freedata = (test_t *) data;
+  SAFE_FREE(freedata);
+}
+
+static void setup(void **state) {
+  c_htable_t *table = NULL;
+  int rc;
+
+  rc = c_htable_create(&table, test_key);
+  assert_int_equal(rc, 0);
+
+  *state = table;
+}
+
+static void setup_filled(void **state) {
+  c_htable_t *table = NULL;
+  test_t *testdata = NULL;
+  int i, rc;
+
+  setup(state);
+  table = *state;
+
+  /* enough to grow the slots a few times */
+  for (i = 0; i < 1000; i++) {
+    testdata = c_malloc(sizeof(test_t));
+    testdata->key = (uint64_t) i * 0x100000001ULL;
+    testdata->number = i;
+    rc = c_htable_insert(table, testdata);
+    assert_int_equal(rc, 0);
+  }
+}
+
+static void teardown(void **state) {
+  c_htable_t *table = *state;
+
+  c_htable_destroy(table, destructor);
+
+  *state = NULL;
+}
+
+static void check_c_htable_create_null(void **state)
+{
+  c_htable_t *table = NULL;
+  int rc;
+
+  (void) state; /* unused */
+
+  rc = c_htable_create(NULL, test_key);
+  assert_int_equal(rc, -1);
+  assert_int_equal(errno, EINVAL);
+
+  rc = c_htable_create(&table, NULL);
+  assert_int_equal(rc, -1);
+  assert_int_equal(errno, EINVAL);
+  assert_null(table);
+
+  c_htable_destroy(NULL, destructor);
+}
+
+static void check_c_htable_insert_find(void **state)
+{
+  c_htable_t *table = *state;
+  test_t *testdata = NULL;
+  test_t *found = NULL;
+  int rc;
+
+  assert_int_equal(c_htable_size(table), 0);
+  assert_null(c_htable_find(table, 42));
+
+  testdata = c_malloc(sizeof(test_t));
+  testdata->key = 42;
+  rc = c_htable_insert(table, testdata);
+  assert_int_equal(rc, 0);
+  assert_int_equal(c_htable_size(table), 1);
+
+  found = c_htable_find(table, 42);
+  assert_true(found == testdata);
+  assert_null(c_htable_find(table, 23));
+}
+
+static void check_c_htable_insert_duplicate(void **state)
+{
+  c_htable_t *table = *state;
+  test_t *testdata = NULL;
+  test_t duplicate;
+  int rc;
+
+  testdata = c_malloc(sizeof(test_t));
+  testdata->key = 42;
+  rc = c_htable_insert(table, testdata);
+  assert_int_equal(rc, 0);
+
+  duplicate.key = 42;
+  rc = c_htable_insert(table, &duplicate);
+  assert_int_equal(rc, 1);
+  assert_int_equal(c_htable_size(table), 1);
+  assert_true(c_htable_find(table, 42) == testdata);
+}
+
+static void check_c_htable_find_many(void **state)
+{
+  c_htable_t *table = *state;
+  test_t *found = NULL;
+  int i;
+
+  assert_int_equal(c_htable_size(table), 1000);
+
+  for (i = 0; i < 1000; i++) {
+    found = c_htable_find(table, (uint64_t) i * 0x100000001ULL);
+    assert_non_null(found);
+    assert_int_equal(found->number, i);
+  }
+  assert_null(c_htable_find(table, 1));
+}
+
+static void check_c_htable_walk(void **state)
+{
+  c_htable_t *table = *state;
+  int expected = 0;
+  int rc;
+
+  rc = c_htable_walk(table, &expected, visitor);
+  assert_int_equal(rc, 0);
+  assert_int_equal(expected, 1000);
+
+  rc = c_htable_walk(table, &expected, failing_visitor);
+  assert_int_equal(rc, -1);
+}
+
+static void check_c_htable_walk_null(void **state)
+{
+  c_htable_t *table = *state;
+  int expected = 0;
+  int rc;
+
+  rc = c_htable_walk(NULL, &expected, visitor);
+  assert_int_equal(rc, -1);
+  assert_int_equal(errno, EINVAL);
+
+  rc = c_htable_walk(table, NULL, visitor);
+  assert_int_equal(rc, -1);
+  assert_int_equal(errno, EINVAL);
+
+  rc = c_htable_walk(table, &expected, NULL);
+  assert_int_equal(rc, -1);
+  assert_int_equal(errno, EINVAL);
+}
+
+int torture_run_tests(void)
+{
+  const UnitTest tests[] = {
+      unit_test(check_c_htable_create_null),
+      unit_test_setup_teardown(check_c_htable_insert_find, setup, teardown),
+      unit_test_setup_teardown(check_c_htable_insert_duplicate, setup, teardown),
+      unit_test_setup_teardown(check_c_htable_find_many, setup_filled, teardown),
+      unit_test_setup_teardown(check_c_htable_walk, setup_filled, teardown),
+      unit_test_setup_teardown(check_c_htable_walk_null, setup_filled, teardown),
+  };
+
+  return run_tests(tests);
+}
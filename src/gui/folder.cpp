@@ -19,6 +19,7 @@
 #include "accountstate.h"
 #include "folder.h"
 #include "folderman.h"
+#include "folderwatcher.h"
 #include "logger.h"
 #include "configfile.h"
 #include "networkjobs.h"
@@ -57,6 +58,7 @@ Folder::Folder(const FolderDefinition& definition,
       , _lastSyncDuration(0)
       , _consecutiveFailingSyncs(0)
       , _consecutiveFollowUpSyncs(0)
+      , _excludesRevision(0)
       , _journal(_definition.absoluteJournalPath())
       , _fileLog(new SyncRunFileLog)
       , _saveBackwardsCompatible(false)
@@ -195,6 +197,10 @@ bool Folder::ignoreHiddenFiles()
 
 void Folder::setIgnoreHiddenFiles(bool ignore)
 {
+    if (ignore != _definition.ignoreHiddenFiles) {
+        // The hidden files may be in directories the next sync would read from the journal
+        slotNextSyncFullLocalDiscovery();
+    }
     _definition.ignoreHiddenFiles = ignore;
 }
 
@@ -449,6 +455,15 @@ int Folder::slotWipeErrorBlacklist()
 
 void Folder::slotWatchedPathChanged(const QString& path)
 {
+    // Remember the path for the local discovery of the next sync, even if it
+    // turns out to be our own change: it is cheap to look at it again.
+    if (path.startsWith(this->path())) {
+        _localDiscoveryPaths.insert(path.mid(this->path().size()));
+    } else {
+        // The folder itself
+        _timeSinceLastFullLocalDiscovery.invalidate();
+    }
+
     // The folder watcher fires a lot of bogus notifications during
     // a sync operation, both for actual user files and the database
     // and log. Therefore we check notifications against operations
@@ -602,7 +617,15 @@ bool Folder::setIgnoredFiles()
         _engine->excludedFiles().addExcludeFilePath(userList);
     }
 
-    return _engine->excludedFiles().reloadExcludes();
+    bool ok = _engine->excludedFiles().reloadExcludes();
+
+    // The files that are no longer excluded may be in directories the next sync
+    // would read from the journal
+    if (_engine->excludedFiles().revision() != _excludesRevision) {
+        _excludesRevision = _engine->excludedFiles().revision();
+        slotNextSyncFullLocalDiscovery();
+    }
+    return ok;
 }
 
 void Folder::setProxyDirty(bool value)
@@ -651,8 +674,29 @@ void Folder::startSync(const QStringList &pathList)
     auto newFolderLimit = cfgFile.newBigFolderSizeLimit();
     opt._newBigFolderSizeLimit = newFolderLimit.first ? newFolderLimit.second * 1000LL * 1000LL : -1; // convert from MB to B
     opt._confirmExternalStorage = cfgFile.confirmExternalStorage();
+    opt._parallelDiscoveryJobs = cfgFile.parallelDiscoveryJobs();
+    opt._localDiscoveryThreads = cfgFile.localDiscoveryThreads();
+    opt._discoveryChecksumThreads = cfgFile.discoveryChecksumThreads();
+    opt._reconcileThreads = cfgFile.reconcileThreads();
+    opt._localDiscoveryFromJournal = cfgFile.localDiscoveryFromJournal();
+    opt._streamInitialSync = cfgFile.streamInitialSync();
+    opt._memoryBudget = cfgFile.syncMemoryBudget() * 1000LL * 1000LL; // convert from MB to B
     _engine->setSyncOptions(opt);
 
+    bool fullLocalDiscovery = !opt._localDiscoveryFromJournal
+            || !_folderWatcher || !_folderWatcher->isReliable()
+            || !_timeSinceLastFullLocalDiscovery.isValid()
+            || quint64(_timeSinceLastFullLocalDiscovery.elapsed()) > cfgFile.fullLocalDiscoveryInterval();
+    if (fullLocalDiscovery) {
+        _engine->setLocalDiscoveryOptions(FilesystemOnly);
+        _localDiscoveryPathsInSync.clear();
+    } else {
+        qDebug() << "Local discovery limited to" << _localDiscoveryPaths.size() << "changed paths";
+        _engine->setLocalDiscoveryOptions(DatabaseAndFilesystem, _localDiscoveryPaths.toList());
+        _localDiscoveryPathsInSync = _localDiscoveryPaths;
+    }
+    _localDiscoveryPaths.clear();
+
     _engine->setIgnoreHiddenFiles(_definition.ignoreHiddenFiles);
 
     QMetaObject::invokeMethod(_engine.data(), "startSync", Qt::QueuedConnection);
@@ -660,6 +704,18 @@ void Folder::startSync(const QStringList &pathList)
     emit syncStarted();
 }
 
+void Folder::setFolderWatcher(FolderWatcher *watcher)
+{
+    _folderWatcher = watcher;
+    connect(watcher, SIGNAL(lostChanges()), this, SLOT(slotNextSyncFullLocalDiscovery()));
+}
+
+void Folder::slotNextSyncFullLocalDiscovery()
+{
+    _timeSinceLastFullLocalDiscovery.invalidate();
+    scheduleThisFolderSoon();
+}
+
 void Folder::setDirtyNetworkLimits()
 {
     ConfigFile cfg;
@@ -747,6 +803,19 @@ void Folder::slotSyncFinished(bool success)
         qDebug() << "the last" << _consecutiveFailingSyncs << "syncs failed";
     }
 
+    if (_engine->lastLocalDiscoveryStyle() == FilesystemOnly) {
+        if (_syncResult.status() == SyncResult::Success
+                || _syncResult.status() == SyncResult::Problem) {
+            _timeSinceLastFullLocalDiscovery.start();
+        } else {
+            _timeSinceLastFullLocalDiscovery.invalidate();
+        }
+    } else if (_syncResult.status() != SyncResult::Success) {
+        // What could not be synced needs to be discovered again
+        _localDiscoveryPaths.unite(_localDiscoveryPathsInSync);
+    }
+    _localDiscoveryPathsInSync.clear();
+
     if (_syncResult.status() == SyncResult::Success && success) {
         // Clear the white list as all the folders that should be on that list are sync-ed
         journalDb()->setSelectiveSyncList(SyncJournalDb::SelectiveSyncWhiteList, QStringList());
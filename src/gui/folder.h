@@ -27,6 +27,7 @@
 
 #include <QObject>
 #include <QStringList>
+#include <QSet>
 
 class QThread;
 class QSettings;
@@ -35,6 +36,7 @@ namespace OCC {
 
 class SyncEngine;
 class AccountState;
+class FolderWatcher;
 class SyncRunFileLog;
 
 /**
@@ -217,6 +219,13 @@ public:
       */
      void scheduleThisFolderSoon();
 
+     /**
+      * Sets the watcher of the local folder. While it is reliable, the syncs only
+      * read the local directories it reported changes in from the file system, and
+      * take the others from the journal. The whole tree is still walked regularly.
+      */
+     void setFolderWatcher(FolderWatcher *watcher);
+
      /**
       * Migration: When this flag is true, this folder will save to
       * the backwards-compatible 'Folders' section in the config file.
@@ -290,6 +299,9 @@ private slots:
 
     void slotNewBigFolderDiscovered(const QString &, bool isExternal);
 
+    /** The next sync walks the whole local tree, the watcher missed changes */
+    void slotNextSyncFullLocalDiscovery();
+
     void slotLogPropagationStart();
 
     /** Adds this folder to the list of scheduled folders in the
@@ -339,12 +351,26 @@ private:
     /// Reset when no follow-up is requested.
     int           _consecutiveFollowUpSyncs;
 
+    /// The ExcludedFiles::revision() of the patterns the last sync used
+    int           _excludesRevision;
+
     SyncJournalDb _journal;
 
     ClientProxy   _clientProxy;
 
     QScopedPointer<SyncRunFileLog> _fileLog;
 
+    QPointer<FolderWatcher> _folderWatcher;
+
+    /// Paths, relative to the folder, the watcher reported as changed since the last sync started
+    QSet<QString> _localDiscoveryPaths;
+
+    /// The changed paths given to the running sync, to look at them again if it fails
+    QSet<QString> _localDiscoveryPathsInSync;
+
+    /// Invalid if the next sync has to walk the whole local tree
+    QElapsedTimer _timeSinceLastFullLocalDiscovery;
+
     QTimer _scheduleSelfTimer;
 
     /**
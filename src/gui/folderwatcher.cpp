@@ -40,7 +40,8 @@ namespace OCC {
 
 FolderWatcher::FolderWatcher(const QString &root, Folder* folder)
     : QObject(folder),
-      _folder(folder)
+      _folder(folder),
+      _isReliable(true)
 {
     _d.reset(new FolderWatcherPrivate(this, root));
 
@@ -69,6 +69,13 @@ public:
     /* Check if the path is ignored. */
     bool pathIsIgnored( const QString& path );
 
+    /**
+     * Returns false if the watcher may have missed changes: it could not be set up
+     * for every directory. In that case the pathChanged() signals can't be relied on
+     * to know what changed and the local tree needs to be walked completely.
+     */
+    bool isReliable() const { return _isReliable; }
+
 signals:
     /** Emitted when one of the watched directories or one
      *  of the contained files is changed. */
@@ -77,6 +84,12 @@ signals:
     /** Emitted if an error occurs */
     void error(const QString& error);
 
+    /**
+     * Emitted when changes were lost, for instance because the event queue of the
+     * backend overflowed. Any file below the root may have changed.
+     */
+    void lostChanges();
+
 protected slots:
     // called from the implementations to indicate a change in path
     void changeDetected( const QString& path);
@@ -90,6 +103,7 @@ private:
     QTime _timer;
     QSet<QString> _lastPaths;
     Folder* _folder;
+    bool _isReliable;
 
     friend class FolderWatcherPrivate;
 };
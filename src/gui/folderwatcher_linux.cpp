@@ -38,6 +38,7 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString& path
         connect(_socket.data(), SIGNAL(activated(int)), SLOT(slotReceivedNotification(int)));
     } else {
         qDebug() << Q_FUNC_INFO << "notify_init() failed: " << strerror(errno);
+        _parent->_isReliable = false;
     }
 
     QMetaObject::invokeMethod(this, "slotAddFolderRecursive", Q_ARG(QString, path));
@@ -83,7 +84,11 @@ void FolderWatcherPrivate::inotifyRegisterPath(const QString& path)
                                    IN_MOVE_SELF |IN_UNMOUNT |IN_ONLYDIR);
         if( wd > -1 ) {
             _watches.insert(wd, path);
-         }
+        } else {
+            // Most likely the limit of fs.inotify.max_user_watches was reached
+            qDebug() << Q_FUNC_INFO << "inotify_add_watch failed for" << path << strerror(errno);
+            _parent->_isReliable = false;
+        }
     }
 }
 
@@ -165,6 +170,11 @@ void FolderWatcherPrivate::slotReceivedNotification(int fd)
             continue;
         }
 
+        if (event->mask & IN_Q_OVERFLOW) {
+            qDebug() << Q_FUNC_INFO << "inotify event queue overflowed, changes were lost";
+            emit _parent->lostChanges();
+        }
+
         // Fire event for the path that was changed.
         if (event->len > 0 && event->wd > -1) {
             QByteArray fileName(event->name);
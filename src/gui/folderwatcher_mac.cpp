@@ -65,6 +65,12 @@ static void callback(
     QStringList paths;
     CFArrayRef eventPaths = (CFArrayRef)eventPathsVoid;
     for (int i = 0; i < static_cast<int>(numEvents); ++i) {
+        if (eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs) {
+            // Events were coalesced or dropped, we don't know what changed below this path
+            qDebug() << "FSEvents asked for a rescan, changes were lost";
+            reinterpret_cast<FolderWatcherPrivate*>(clientCallBackInfo)->doNotifyLostChanges();
+        }
+
         CFStringRef path = reinterpret_cast<CFStringRef>(CFArrayGetValueAtIndex(eventPaths, i));
 
         QString qstring;
@@ -114,6 +120,11 @@ void FolderWatcherPrivate::doNotifyParent(const QStringList &paths) {
     _parent->changeDetected(paths);
 }
 
+void FolderWatcherPrivate::doNotifyLostChanges()
+{
+    emit _parent->lostChanges();
+}
+
 
 
 } // ns mirall
@@ -40,6 +40,7 @@ public:
 
     void startWatching();
     void doNotifyParent(const QStringList &);
+    void doNotifyLostChanges();
 
 private:
     FolderWatcher *_parent;
@@ -33,6 +33,9 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path
 {
     _watcher.reset(new QFileSystemWatcher);
 
+    // Only the directories are watched: changes to the contents of files are not reported
+    _parent->_isReliable = false;
+
     QObject::connect(_watcher.data(), SIGNAL(directoryChanged(QString)),
                      _parent, SLOT(changeDetected(QString)) );
 
@@ -51,6 +51,7 @@ protected:
 
 signals:
     void changed(const QString &path);
+    void lostChanges();
 
 private:
     QString _path;
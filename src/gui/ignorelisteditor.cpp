@@ -127,6 +127,8 @@ void IgnoreListEditor::slotUpdateLocalIgnoreList()
     // ignored (because the remote etag did not change)   (issue #3172)
     foreach (Folder* folder, folderMan->map()) {
         folder->journalDb()->forceRemoteDiscoveryNextSync();
+        // Same for the local files in directories that would be read from the journal
+        folder->slotNextSyncFullLocalDiscovery();
         folderMan->scheduleFolder(folder);
     }
 
@@ -25,9 +25,17 @@
 
 #include <QTimer>
 #include <QObject>
+#include <QVector>
+#include <QPair>
+
+#include <algorithm>
 
 namespace OCC {
 
+// The absolute limits are shared out in slices this often. Short, so that a transfer started
+// in between does not wait long for its first quota.
+static qint64 absoluteLimitTimerIntervalMsec = 100;
+
 // Because of the many layers of buffering inside Qt (and probably the OS and the network)
 // we cannot lower this value much more. If we do, the estimated bw will be very high
 // because the buffers fill fast while the actual network algorithms are not relevant yet.
@@ -59,7 +67,7 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p) : QObject(),
 
     // absolute uploads/downloads
     QObject::connect(&_absoluteLimitTimer, SIGNAL(timeout()), this, SLOT(absoluteLimitTimerExpired()));
-    _absoluteLimitTimer.setInterval(1000);
+    _absoluteLimitTimer.setInterval(absoluteLimitTimerIntervalMsec);
     _absoluteLimitTimer.start();
 
     // Relative uploads
@@ -389,23 +397,41 @@ void BandwidthManager::switchingTimerExpired() {
     }
 }
 
+template <typename T>
+static bool needsLess(const QPair<qint64, T *> &a, const QPair<qint64, T *> &b)
+{
+    return a.first < b.first;
+}
+
+/* Gives each transfer of the list an equal part of the quota, but no more than it still needs:
+ * what the small ones leave is shared by the others, so that the limit is used up even with
+ * many small files in flight. The transfers that do not know what they need get full parts.
+ */
+template <typename T>
+static void shareQuota(const QLinkedList<T *> &transfers, qint64 quota)
+{
+    QVector<QPair<qint64, T *>> needs;
+    needs.reserve(transfers.count());
+    Q_FOREACH(T *transfer, transfers) {
+        qint64 needed = transfer->bandwidthNeeded();
+        needs.append(qMakePair(needed < 0 ? quota : needed, transfer));
+    }
+    // The smallest needs first, so that what they leave goes to the bigger ones
+    std::sort(needs.begin(), needs.end(), needsLess<T>);
+    for (int i = 0; i < needs.size(); ++i) {
+        qint64 given = qMin(needs.at(i).first, quota / (needs.size() - i));
+        needs.at(i).second->giveBandwidthQuota(given);
+        quota -= given;
+    }
+}
+
 void BandwidthManager::absoluteLimitTimerExpired()
 {
     if (usingAbsoluteUploadLimit() && _absoluteUploadDeviceList.count() > 0) {
-        qint64 quotaPerDevice = _currentUploadLimit / qMax(1, _absoluteUploadDeviceList.count());
-//        qDebug() << Q_FUNC_INFO << quotaPerDevice <<  _absoluteUploadDeviceList.count() << _currentUploadLimit;
-        Q_FOREACH(UploadDevice *device, _absoluteUploadDeviceList) {
-            device->giveBandwidthQuota(quotaPerDevice);
-//            qDebug() << Q_FUNC_INFO << "Gave " << quotaPerDevice/1024.0 << " kB to" << device;
-        }
+        shareQuota(_absoluteUploadDeviceList, _currentUploadLimit * absoluteLimitTimerIntervalMsec / 1000);
     }
     if (usingAbsoluteDownloadLimit() && _downloadJobList.count() > 0) {
-        qint64 quotaPerJob = _currentDownloadLimit / qMax(1, _downloadJobList.count());
-//        qDebug() << Q_FUNC_INFO << quotaPerJob <<  _downloadJobList.count() << _currentDownloadLimit;
-        Q_FOREACH(GETFileJob *j, _downloadJobList) {
-            j->giveBandwidthQuota(quotaPerJob);
-//            qDebug() << Q_FUNC_INFO << "Gave " << quotaPerJob/1024.0 << " kB to" << j;
-        }
+        shareQuota(_downloadJobList, _currentDownloadLimit * absoluteLimitTimerIntervalMsec / 1000);
     }
 }
 
@@ -127,6 +127,7 @@ public:
      * Called from csync, where a instance of CSyncChecksumHook has
      * to be set as userdata.
      * The return value will be owned by csync.
+     * It may be called from several threads at the same time.
      */
     static const char* hook(const char* path, uint32_t checksumTypeId, void* this_obj);
 
@@ -0,0 +1,135 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "concurrencycontroller.h"
+
+#include <QDebug>
+
+#include <algorithm>
+
+namespace OCC {
+
+// Requests transferring more than that take as long as the transfer, not as the latency
+static const qint64 latencySampleMaxBytes = 100 * 1024;
+// The latency is congested when it is this many times the baseline, and this much longer
+static const qint64 congestedLatencyFactor = 2;
+static const qint64 congestedLatencyMinimumMsec = 50;
+// One failure in ten samples is too many
+static const int maxFailuresPerTenSamples = 1;
+// The throughput dropped after an increase when it is under 80% of the one before
+static const qint64 throughputDropPercent = 80;
+
+ConcurrencyController::ConcurrencyController(int minimum, int maximum)
+    : _minimum(minimum)
+    , _maximum(qMax(minimum, maximum))
+    , _limit(_maximum)
+    , _windowStart(-1)
+    , _lastEnd(-1)
+    , _samples(0)
+    , _failures(0)
+    , _bytes(0)
+    , _lastLatency(-1)
+    , _baselineLatency(-1)
+    , _lastThroughput(-1)
+    , _lastWasIncrease(false)
+{
+}
+
+void ConcurrencyController::addSample(qint64 endMsec, qint64 durationMsec, qint64 bytes, bool failed)
+{
+    const qint64 startMsec = endMsec - durationMsec;
+    if (_windowStart < 0) {
+        _windowStart = startMsec;
+    } else if (startMsec > _lastEnd) {
+        // Nothing was measured in between, the propagator was idle or there was no sync
+        _windowStart += startMsec - _lastEnd;
+    }
+    _lastEnd = qMax(_lastEnd, endMsec);
+    ++_samples;
+    if (failed) {
+        ++_failures;
+    } else {
+        _bytes += bytes;
+    }
+    if (bytes <= latencySampleMaxBytes) {
+        _latencies.append(durationMsec);
+    }
+
+    // Enough samples for each of the jobs allowed in parallel to have been measured
+    if (_samples >= qMax(4, 2 * _limit)) {
+        decide(endMsec);
+    }
+}
+
+void ConcurrencyController::decide(qint64 endMsec)
+{
+    qint64 latency = -1;
+    qint64 lowLatency = -1;
+    if (!_latencies.isEmpty()) {
+        std::nth_element(_latencies.begin(), _latencies.begin() + _latencies.size() / 2, _latencies.end());
+        latency = _latencies.at(_latencies.size() / 2);
+        // The requests that started while few others were in flight, like the first ones
+        std::nth_element(_latencies.begin(), _latencies.begin() + _latencies.size() / 10, _latencies.end());
+        lowLatency = _latencies.at(_latencies.size() / 10);
+    }
+    qint64 throughput = -1;
+    if (_bytes > 0) {
+        throughput = _bytes * 1000 / qMax(qint64(1), endMsec - _windowStart);
+    }
+
+    const int oldLimit = _limit;
+    const char *reason = 0;
+    if (_failures * 10 > _samples * maxFailuresPerTenSamples) {
+        _limit = qMax(_minimum, _limit / 2);
+        reason = "errors";
+    } else if (latency >= 0 && _baselineLatency >= 0
+        && latency > congestedLatencyFactor * _baselineLatency
+        && latency - _baselineLatency > congestedLatencyMinimumMsec) {
+        if (_limit > _minimum) {
+            _limit = qMax(_minimum, _limit / 2);
+            reason = "latency";
+        } else {
+            // Not because of us, the network is slower than before
+            _baselineLatency = latency;
+        }
+    } else if (_lastWasIncrease && throughput >= 0 && _lastThroughput >= 0
+        && throughput * 100 < _lastThroughput * throughputDropPercent) {
+        _limit = qMax(_minimum, _limit - 1);
+        reason = "throughput";
+    } else if (_limit < _maximum) {
+        _limit += 1;
+        reason = "increase";
+    }
+
+    if (reason) {
+        qDebug() << "Concurrency limit" << oldLimit << "->" << _limit << "because of" << reason
+                 << "latency:" << latency << "ms, baseline:" << _baselineLatency << "ms,"
+                 << "throughput:" << throughput << "B/s, errors:" << _failures << "/" << _samples;
+    }
+
+    if (lowLatency >= 0 && (_baselineLatency < 0 || lowLatency < _baselineLatency)) {
+        _baselineLatency = lowLatency;
+    }
+    _lastWasIncrease = _limit > oldLimit;
+    _lastLatency = latency;
+    if (throughput >= 0) {
+        _lastThroughput = throughput;
+    }
+
+    _windowStart = -1;
+    _samples = 0;
+    _failures = 0;
+    _bytes = 0;
+    _latencies.clear();
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+#include <QtGlobal>
+#include <QVector>
+
+namespace OCC {
+
+/**
+ * @brief Tunes the number of jobs the propagator runs in parallel
+ *
+ * The jobs report how long their requests took, how many bytes they transferred and
+ * whether they failed because of the network or the server. After each window of
+ * samples the limit is adjusted, AIMD-style:
+ *  - it is halved when too many requests failed, or when the latency grew well over
+ *    the one seen with less parallel jobs (the link or the server is congested);
+ *  - it goes back down by one when the last increase made the throughput drop;
+ *  - otherwise it goes up by one.
+ *
+ * The changes of the limit are logged. The SyncEngine keeps its controller from one
+ * sync to the next, so the limit and the samples carry over. The time nothing was
+ * measured, like between two syncs, does not count for the throughput.
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT ConcurrencyController
+{
+public:
+    // Qt cannot do more than 6 requests in parallel to a server anyway
+    // TODO: increase the maximum when using HTTP2
+    explicit ConcurrencyController(int minimum = 2, int maximum = 6);
+
+    /** The current number of jobs that may be active in parallel */
+    int limit() const { return _limit; }
+
+    /**
+     * A request finished at \a endMsec (on any monotonic clock) after \a durationMsec.
+     * \a bytes is what it transferred, \a failed whether it failed because of the
+     * network or the server being overloaded.
+     */
+    void addSample(qint64 endMsec, qint64 durationMsec, qint64 bytes, bool failed);
+
+    /** The median latency of the last window, in ms, or -1 */
+    qint64 lastLatency() const { return _lastLatency; }
+    /** The lowest latency seen, in ms, or -1. Taken from the fastest requests of each
+     * window, as the limit starts at the maximum */
+    qint64 baselineLatency() const { return _baselineLatency; }
+    /** The throughput of the last window, in bytes per second, or -1 */
+    qint64 lastThroughput() const { return _lastThroughput; }
+
+private:
+    void decide(qint64 endMsec);
+
+    int _minimum;
+    int _maximum;
+    int _limit;
+
+    // The current window
+    qint64 _windowStart;
+    qint64 _lastEnd; // the end of the last request, in any window
+    int _samples;
+    int _failures;
+    qint64 _bytes;
+    QVector<qint64> _latencies;
+
+    qint64 _lastLatency;
+    qint64 _baselineLatency;
+    qint64 _lastThroughput;
+    bool _lastWasIncrease;
+};
+
+}
@@ -53,6 +53,14 @@ static const char updateCheckIntervalC[] = "updateCheckInterval";
 static const char geometryC[] = "geometry";
 static const char timeoutC[] = "timeout";
 static const char chunkSizeC[] = "chunkSize";
+static const char parallelDiscoveryJobsC[] = "parallelDiscoveryJobs";
+static const char localDiscoveryThreadsC[] = "localDiscoveryThreads";
+static const char discoveryChecksumThreadsC[] = "discoveryChecksumThreads";
+static const char reconcileThreadsC[] = "reconcileThreads";
+static const char streamInitialSyncC[] = "streamInitialSync";
+static const char syncMemoryBudgetC[] = "syncMemoryBudget";
+static const char fullLocalDiscoveryIntervalC[] = "fullLocalDiscoveryInterval";
+static const char localDiscoveryFromJournalC[] = "localDiscoveryFromJournal";
 
 static const char proxyHostC[] = "Proxy/host";
 static const char proxyTypeC[] = "Proxy/type";
@@ -130,6 +138,42 @@ quint64 ConfigFile::chunkSize() const
     return settings.value(QLatin1String(chunkSizeC), 10*1000*1000).toLongLong(); // default to 10 MB
 }
 
+int ConfigFile::parallelDiscoveryJobs() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(parallelDiscoveryJobsC), 4).toInt();
+}
+
+int ConfigFile::localDiscoveryThreads() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(localDiscoveryThreadsC), 4).toInt();
+}
+
+int ConfigFile::discoveryChecksumThreads() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(discoveryChecksumThreadsC), 0).toInt();
+}
+
+int ConfigFile::reconcileThreads() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(reconcileThreadsC), 1).toInt();
+}
+
+bool ConfigFile::streamInitialSync() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(streamInitialSyncC), false).toBool();
+}
+
+qint64 ConfigFile::syncMemoryBudget() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    return settings.value(QLatin1String(syncMemoryBudgetC), 0).toLongLong();
+}
+
 void ConfigFile::setOptionalDesktopNotifications(bool show)
 {
     QSettings settings(configFile(), QSettings::IniFormat);
@@ -378,6 +422,23 @@ quint64 ConfigFile::forceSyncInterval(const QString& connection) const
     return interval;
 }
 
+quint64 ConfigFile::fullLocalDiscoveryInterval() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    settings.beginGroup(defaultConnection());
+
+    quint64 defaultInterval = 60 * 60 * 1000ull; // 1h
+    return settings.value(QLatin1String(fullLocalDiscoveryIntervalC), defaultInterval).toULongLong();
+}
+
+bool ConfigFile::localDiscoveryFromJournal() const
+{
+    QSettings settings(configFile(), QSettings::IniFormat);
+    settings.beginGroup(defaultConnection());
+
+    return settings.value(QLatin1String(localDiscoveryFromJournalC), false).toBool();
+}
+
 quint64 ConfigFile::notificationRefreshInterval(const QString& connection) const
 {
     QString con( connection );
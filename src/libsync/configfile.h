@@ -69,6 +69,14 @@ public:
     /* Force sync interval, in milliseconds */
     quint64 forceSyncInterval(const QString &connection = QString()) const;
 
+    /* Interval, in milliseconds, after which the local tree is walked completely again
+     * instead of only the directories the file system watcher reported as changed */
+    quint64 fullLocalDiscoveryInterval() const;
+
+    /* Whether unchanged local directories may be read from the journal between
+     * two full local discoveries. Off by default: every sync walks the whole local tree. */
+    bool localDiscoveryFromJournal() const;
+
     bool monoIcons() const;
     void setMonoIcons(bool);
 
@@ -115,6 +123,20 @@ public:
 
     int timeout() const;
     quint64 chunkSize() const;
+    /** How many remote directory listings the discovery may fetch at the same time */
+    int parallelDiscoveryJobs() const;
+    /** How many threads read the local directories during the discovery */
+    int localDiscoveryThreads() const;
+    /** How many threads compare the checksums of touched files during the discovery.
+     * 0 by default: only the .eml files are compared, on the discovery thread */
+    int discoveryChecksumThreads() const;
+    /** How many threads reconcile the local and remote trees, 1 by default */
+    int reconcileThreads() const;
+    /** Whether the first sync of a folder propagates each top-level directory once it is discovered.
+     * Off by default */
+    bool streamInitialSync() const;
+    /** Memory (in MB) a sync may use for its view of the tree before it goes in rounds, 0 for no limit */
+    qint64 syncMemoryBudget() const;
 
     void saveGeometry(QWidget *w);
     void restoreGeometry(QWidget *w);
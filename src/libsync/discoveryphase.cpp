@@ -17,6 +17,8 @@
 #include "account.h"
 #include "theme.h"
 #include "asserts.h"
+#include "syncjournaldb.h"
+#include "syncjournalfilerecord.h"
 
 #include <csync_private.h>
 #include <csync_rename.h>
@@ -29,6 +31,8 @@
 
 namespace OCC {
 
+// How many directory listings may wait for the sync thread to take them
+static const size_t maxPrefetchedResults = 1000;
 
 /* Given a sorted list of paths ending with '/', return whether or not the given path is within one of the paths of the list*/
 static bool findPathInList(const QStringList &list, const QString &path)
@@ -87,6 +91,56 @@ int DiscoveryJob::isInSelectiveSyncBlackListCallback(void *data, const char *pat
     return static_cast<DiscoveryJob*>(data)->isInSelectiveSyncBlackList(path);
 }
 
+bool DiscoveryJob::isLocalDirectoryDirty(const QString &path) const
+{
+    Q_ASSERT(std::is_sorted(_localDiscoveryPaths.begin(), _localDiscoveryPaths.end()));
+
+    // Something changed inside of this directory
+    QString pathSlash = path + QLatin1Char('/');
+    auto it = std::lower_bound(_localDiscoveryPaths.begin(), _localDiscoveryPaths.end(), pathSlash);
+    if (it != _localDiscoveryPaths.end() && it->startsWith(pathSlash)) {
+        return true;
+    }
+
+    // The directory itself, or one of its parents, changed. It may have been moved
+    // in, and nothing is known about its contents.
+    QString parent = path;
+    forever {
+        if (std::binary_search(_localDiscoveryPaths.begin(), _localDiscoveryPaths.end(), parent)) {
+            return true;
+        }
+        if (parent.isEmpty()) {
+            return false;
+        }
+        parent.truncate(qMax(parent.lastIndexOf(QLatin1Char('/')), 0));
+    }
+}
+
+int DiscoveryJob::isLocalDirectoryDirtyCallback(void *data, const char *path)
+{
+    return static_cast<DiscoveryJob*>(data)->isLocalDirectoryDirty(QString::fromUtf8(path));
+}
+
+bool SyncScope::contains(const QString &path, bool isDirectory) const
+{
+    if (!_limited) {
+        return true;
+    }
+    Q_ASSERT(std::is_sorted(_subtrees.begin(), _subtrees.end()));
+
+    int slash = path.indexOf(QLatin1Char('/'));
+    if (slash < 0 && !isDirectory) {
+        return _subtrees.isEmpty();
+    }
+    return std::binary_search(_subtrees.begin(), _subtrees.end(), slash < 0 ? path : path.left(slash));
+}
+
+int DiscoveryJob::isOutsideSyncScopeCallback(void *data, const char *path, int type)
+{
+    return !static_cast<DiscoveryJob*>(data)->_syncScope.contains(
+        QString::fromUtf8(path), type == CSYNC_FTW_TYPE_DIR);
+}
+
 bool DiscoveryJob::checkSelectiveSyncNewFolder(const QString& path, const char *remotePerm)
 {
 
@@ -383,7 +437,7 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
             fileRef = file.midRef(slashPos+1);
         }
         //qDebug() << "!!!!" << file_stat << file_stat->name << file_stat->file_id << map.count();
-        _results.append(file_stat);
+        _results.push_back(std::move(file_stat));
     }
 
     //This works in concerto with the RequestEtagJob and the Folder object to check if the remote folder changed.
@@ -407,7 +461,7 @@ void DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot()
     }
     emit etag(_firstEtag);
     emit etagConcatenation(_etagConcatenation);
-    emit finishedWithResult(_results);
+    emit finishedWithResult();
     deleteLater();
 }
 
@@ -438,6 +492,10 @@ void DiscoveryMainThread::setupHooks(DiscoveryJob *discoveryJob, const QString &
 {
     _discoveryJob = discoveryJob;
     _pathPrefix = pathPrefix;
+    _maxParallelJobs = qMax(1, discoveryJob->_syncOptions._parallelDiscoveryJobs);
+    // Our own copy, the DiscoveryJob is used from the sync thread
+    _selectiveSyncBlackList = discoveryJob->_selectiveSyncBlackList;
+    _selectiveSyncBlackList.sort();
 
     connect(discoveryJob, SIGNAL(doOpendirSignal(QString,DiscoveryDirectoryResult*)),
             this, SLOT(doOpendirSlot(QString,DiscoveryDirectoryResult*)),
@@ -447,6 +505,31 @@ void DiscoveryMainThread::setupHooks(DiscoveryJob *discoveryJob, const QString &
             Qt::QueuedConnection);
 }
 
+DiscoverySingleDirectoryJob *DiscoveryMainThread::startSingleDirectoryJob(const QString &fullPath)
+{
+    auto job = new DiscoverySingleDirectoryJob(_account, fullPath, this);
+    QObject::connect(job, SIGNAL(finishedWithResult()),
+                     this, SLOT(singleDirectoryJobResultSlot()));
+    QObject::connect(job, SIGNAL(finishedWithError(int,QString)),
+                     this, SLOT(singleDirectoryJobFinishedWithErrorSlot(int,QString)));
+
+    if (!_firstFolderProcessed) {
+        // Only the root listing is relevant for the permissions of the root, its etag
+        // and the data-fingerprint. No other listing is started before it is finished.
+        QObject::connect(job, SIGNAL(firstDirectoryPermissions(QString)),
+                         this, SLOT(singleDirectoryJobFirstDirectoryPermissionsSlot(QString)));
+        QObject::connect(job, SIGNAL(etagConcatenation(QString)),
+                         this, SIGNAL(etagConcatenation(QString)));
+        QObject::connect(job, SIGNAL(etag(QString)),
+                         this, SIGNAL(etag(QString)));
+        job->setIsRootPath();
+    }
+
+    _runningJobs.insert(fullPath, job);
+    job->start();
+    return job;
+}
+
 // Coming from owncloud_opendir -> DiscoveryJob::vio_opendir_hook -> doOpendirSignal
 void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirectoryResult *r)
 {
@@ -467,64 +550,160 @@ void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirecto
     _currentDiscoveryDirectoryResult = r;
     _currentDiscoveryDirectoryResult->path = fullPath;
 
-    // Schedule the DiscoverySingleDirectoryJob
-    _singleDirJob = new DiscoverySingleDirectoryJob(_account, fullPath, this);
-    QObject::connect(_singleDirJob, SIGNAL(finishedWithResult(const QList<FileStatPointer> &)),
-                     this, SLOT(singleDirectoryJobResultSlot(const QList<FileStatPointer> &)));
-    QObject::connect(_singleDirJob, SIGNAL(finishedWithError(int,QString)),
-                     this, SLOT(singleDirectoryJobFinishedWithErrorSlot(int,QString)));
-    QObject::connect(_singleDirJob, SIGNAL(firstDirectoryPermissions(QString)),
-                     this, SLOT(singleDirectoryJobFirstDirectoryPermissionsSlot(QString)));
-    QObject::connect(_singleDirJob, SIGNAL(etagConcatenation(QString)),
-                     this, SIGNAL(etagConcatenation(QString)));
-    QObject::connect(_singleDirJob, SIGNAL(etag(QString)),
-                     this, SIGNAL(etag(QString)));
+    // The listing might already have been fetched ahead of time
+    auto prefetched = _prefetchedResults.find(fullPath);
+    if (prefetched != _prefetchedResults.end()) {
+        qDebug() << Q_FUNC_INFO << "Using prefetched listing for" << fullPath;
+        deliverCurrentResult(prefetched->second);
+        _prefetchedResults.erase(prefetched);
+        schedulePrefetchJobs();
+        return;
+    }
 
-    if (!_firstFolderProcessed) {
-        _singleDirJob->setIsRootPath();
+    // Or it is still on its way, in which case the result slot will hand it over.
+    // Otherwise our guess was wrong and it is scheduled right away: the sync thread is
+    // waiting for it, so it does not wait for a free slot.
+    _prefetchQueue.removeOne(fullPath);
+    if (!_runningJobs.value(fullPath)) {
+        startSingleDirectoryJob(fullPath);
     }
+}
 
-    _singleDirJob->start();
+void DiscoveryMainThread::deliverCurrentResult(DiscoveryDirectoryResult &result)
+{
+    _currentDiscoveryDirectoryResult->code = result.code;
+    _currentDiscoveryDirectoryResult->msg = result.msg;
+    _currentDiscoveryDirectoryResult->list.swap(result.list);
+    _currentDiscoveryDirectoryResult->listIndex = 0;
+    _currentDiscoveryDirectoryResult = 0; // the sync thread owns it now
+
+    _discoveryJob->_vioMutex.lock();
+    _discoveryJob->_vioWaitCondition.wakeAll();
+    _discoveryJob->_vioMutex.unlock();
 }
 
+void DiscoveryMainThread::enqueueSubDirectories(const QString &fullPath, const FileStatList &result)
+{
+    if (_maxParallelJobs <= 1) {
+        return;
+    }
+
+    QString relativePath = fullPath.mid(_pathPrefix.length());
+    while (relativePath.startsWith(QLatin1Char('/'))) {
+        relativePath.remove(0, 1);
+    }
+    if (!relativePath.isEmpty()) {
+        relativePath += QLatin1Char('/');
+    }
+
+    // csync walks the tree depth first and in the order of the listing. So the sub directories
+    // of the directory that was listed last go in front of the queue, keeping their order.
+    auto insertPos = _prefetchQueue.begin();
+    for (const auto &file_stat : result) {
+        if (file_stat->type != CSYNC_VIO_FILE_TYPE_DIRECTORY) {
+            continue;
+        }
+        const QString name = QString::fromUtf8(file_stat->name);
+        if (!willBeOpened(relativePath + name, file_stat.get())) {
+            continue;
+        }
+        insertPos = _prefetchQueue.insert(insertPos, fullPath + QLatin1Char('/') + name);
+        ++insertPos;
+    }
+}
 
-void DiscoveryMainThread::singleDirectoryJobResultSlot(const QList<FileStatPointer> & result)
+/* Guess whether csync is going to open the given remote directory, using the same criteria
+ * as _csync_detect_update: directories with the same etag, file id and permissions as in the
+ * database are read from the database instead.
+ * A wrong guess is not harmful, it only costs a useless or a non-prefetched listing. */
+bool DiscoveryMainThread::willBeOpened(const QString &relativePath, const csync_vio_file_stat_t *file_stat)
 {
-    if (!_currentDiscoveryDirectoryResult) {
-        return; // possibly aborted
+    if (!_selectiveSyncBlackList.isEmpty() && findPathInList(_selectiveSyncBlackList, relativePath)) {
+        return false;
     }
-    qDebug() << Q_FUNC_INFO << "Have" << result.count() << "results for " << _currentDiscoveryDirectoryResult->path;
 
+    SyncJournalFileRecord record = _journal->getFileRecord(relativePath);
+    if (!record.isValid()) {
+        return true; // new directory, or renamed
+    }
+    return record._etag != file_stat->etag
+        || record._fileId != file_stat->file_id
+        || record._remotePerm != file_stat->remotePerm;
+}
 
-    _currentDiscoveryDirectoryResult->list = result;
-    _currentDiscoveryDirectoryResult->code = 0;
-    _currentDiscoveryDirectoryResult->listIndex = 0;
-    _currentDiscoveryDirectoryResult = 0; // the sync thread owns it now
+void DiscoveryMainThread::schedulePrefetchJobs()
+{
+    // Between the rounds of a streamed sync nobody takes the listings, keep their memory bounded
+    while (_runningJobs.count() < _maxParallelJobs && !_prefetchQueue.isEmpty()
+           && _prefetchedResults.size() < maxPrefetchedResults) {
+        const QString path = _prefetchQueue.takeFirst();
+        if (_runningJobs.contains(path) || _prefetchedResults.count(path)) {
+            continue;
+        }
+        startSingleDirectoryJob(path);
+    }
+}
+
+void DiscoveryMainThread::singleDirectoryJobResultSlot()
+{
+    auto job = qobject_cast<DiscoverySingleDirectoryJob *>(sender());
+    if (!job || !_runningJobs.contains(job->path())) {
+        return; // possibly aborted
+    }
+    const QString path = job->path();
+    _runningJobs.remove(path);
+
+    DiscoveryDirectoryResult directoryResult;
+    directoryResult.path = path;
+    directoryResult.code = 0;
+    directoryResult.list = job->takeResults();
 
     if (!_firstFolderProcessed) {
         _firstFolderProcessed = true;
-        _dataFingerprint = _singleDirJob->_dataFingerprint;
+        _dataFingerprint = job->_dataFingerprint;
+        for (const auto &file_stat : directoryResult.list) {
+            if (file_stat->type == CSYNC_VIO_FILE_TYPE_DIRECTORY) {
+                _rootDirectories.append(QString::fromUtf8(file_stat->name));
+            }
+        }
     }
+    qDebug() << Q_FUNC_INFO << "Have" << directoryResult.list.size() << "results for " << path;
 
-    _discoveryJob->_vioMutex.lock();
-    _discoveryJob->_vioWaitCondition.wakeAll();
-    _discoveryJob->_vioMutex.unlock();
+    enqueueSubDirectories(path, directoryResult.list);
+
+    if (_currentDiscoveryDirectoryResult && _currentDiscoveryDirectoryResult->path == path) {
+        deliverCurrentResult(directoryResult);
+    } else {
+        _prefetchedResults[path] = std::move(directoryResult);
+    }
+
+    schedulePrefetchJobs();
 }
 
 void DiscoveryMainThread::singleDirectoryJobFinishedWithErrorSlot(int csyncErrnoCode, const QString &msg)
 {
-    if (!_currentDiscoveryDirectoryResult) {
+    auto job = qobject_cast<DiscoverySingleDirectoryJob *>(sender());
+    if (!job || !_runningJobs.contains(job->path())) {
         return; // possibly aborted
     }
-    qDebug() << Q_FUNC_INFO << csyncErrnoCode << msg;
+    const QString path = job->path();
+    _runningJobs.remove(path);
+    qDebug() << Q_FUNC_INFO << csyncErrnoCode << msg << path;
 
-     _currentDiscoveryDirectoryResult->code = csyncErrnoCode;
-     _currentDiscoveryDirectoryResult->msg = msg;
-     _currentDiscoveryDirectoryResult = 0; // the sync thread owns it now
+    // A prefetched directory can fail as well, the error is only reported
+    // once the sync thread actually opens that directory.
+    DiscoveryDirectoryResult directoryResult;
+    directoryResult.path = path;
+    directoryResult.code = csyncErrnoCode;
+    directoryResult.msg = msg;
 
-    _discoveryJob->_vioMutex.lock();
-    _discoveryJob->_vioWaitCondition.wakeAll();
-    _discoveryJob->_vioMutex.unlock();
+    if (_currentDiscoveryDirectoryResult && _currentDiscoveryDirectoryResult->path == path) {
+        deliverCurrentResult(directoryResult);
+    } else {
+        _prefetchedResults[path] = std::move(directoryResult);
+    }
+
+    schedulePrefetchJobs();
 }
 
 void DiscoveryMainThread::singleDirectoryJobFirstDirectoryPermissionsSlot(const QString &p)
@@ -592,12 +771,17 @@ void DiscoveryMainThread::slotGetSizeResult(const QVariantMap &map)
 
 // called from SyncEngine
 void DiscoveryMainThread::abort() {
-    if (_singleDirJob) {
-        _singleDirJob->disconnect(SIGNAL(finishedWithError(int,QString)), this);
-        _singleDirJob->disconnect(SIGNAL(firstDirectoryPermissions(QString)), this);
-        _singleDirJob->disconnect(SIGNAL(finishedWithResult(const QList<FileStatPointer> &)), this);
-        _singleDirJob->abort();
+    foreach (const QPointer<DiscoverySingleDirectoryJob> &job, _runningJobs) {
+        if (job) {
+            job->disconnect(SIGNAL(finishedWithError(int,QString)), this);
+            job->disconnect(SIGNAL(firstDirectoryPermissions(QString)), this);
+            job->disconnect(SIGNAL(finishedWithResult()), this);
+            job->abort();
+        }
     }
+    _runningJobs.clear();
+    _prefetchQueue.clear();
+    _prefetchedResults.clear();
     if (_currentDiscoveryDirectoryResult) {
         if (_discoveryJob->_vioMutex.tryLock()) {
             _currentDiscoveryDirectoryResult->msg = tr("Aborted by the user"); // Actually also created somewhere else by sync engine
@@ -654,9 +838,8 @@ csync_vio_file_stat_t* DiscoveryJob::remote_vio_readdir_hook (csync_vio_handle_t
     if (discoveryJob) {
         DiscoveryDirectoryResult *directoryResult = static_cast<DiscoveryDirectoryResult*>(dhandle);
         if (directoryResult->listIndex < directoryResult->list.size()) {
-            csync_vio_file_stat_t *file_stat = directoryResult->list.at(directoryResult->listIndex++).data();
-            // Make a copy, csync_update will delete the copy
-            return csync_vio_file_stat_copy(file_stat);
+            // csync_update takes ownership and deletes it
+            return directoryResult->list[directoryResult->listIndex++].release();
         }
     }
     return NULL;
@@ -669,17 +852,28 @@ void DiscoveryJob::remote_vio_closedir_hook (csync_vio_handle_t *dhandle,  void
         DiscoveryDirectoryResult *directoryResult = static_cast<DiscoveryDirectoryResult*> (dhandle);
         QString path = directoryResult->path;
         qDebug() << Q_FUNC_INFO << discoveryJob << path;
-        delete directoryResult; // just deletes the struct and the iterator, the data itself is owned by the SyncEngine/DiscoveryMainThread
+        delete directoryResult; // also deletes the entries csync did not read
     }
 }
 
 void DiscoveryJob::start() {
     _selectiveSyncBlackList.sort();
     _selectiveSyncWhiteList.sort();
+    _localDiscoveryPaths.sort();
+    _syncScope._subtrees.sort();
     _csync_ctx->callbacks.update_callback_userdata = this;
     _csync_ctx->callbacks.update_callback = update_job_update_callback;
     _csync_ctx->callbacks.checkSelectiveSyncBlackListHook = isInSelectiveSyncBlackListCallback;
     _csync_ctx->callbacks.checkSelectiveSyncNewFolderHook = checkSelectiveSyncNewFolderCallback;
+    if (_localDiscoveryStyle == DatabaseAndFilesystem) {
+        qDebug() << "Local discovery limited to" << _localDiscoveryPaths.size() << "changed paths";
+        _csync_ctx->callbacks.checkLocalDirectoryDirtyHook = isLocalDirectoryDirtyCallback;
+    }
+    if (_syncScope._limited) {
+        qDebug() << "Discovery limited to" << (_syncScope._subtrees.isEmpty()
+            ? QStringList(QLatin1String("the files at the root")) : _syncScope._subtrees);
+        _csync_ctx->callbacks.checkSyncScopeHook = isOutsideSyncScopeCallback;
+    }
 
     _csync_ctx->callbacks.remote_opendir_hook = remote_vio_opendir_hook;
     _csync_ctx->callbacks.remote_readdir_hook = remote_vio_readdir_hook;
@@ -694,6 +888,8 @@ void DiscoveryJob::start() {
 
     _csync_ctx->callbacks.checkSelectiveSyncNewFolderHook = 0;
     _csync_ctx->callbacks.checkSelectiveSyncBlackListHook = 0;
+    _csync_ctx->callbacks.checkLocalDirectoryDirtyHook = 0;
+    _csync_ctx->callbacks.checkSyncScopeHook = 0;
     _csync_ctx->callbacks.update_callback = 0;
     _csync_ctx->callbacks.update_callback_userdata = 0;
 
@@ -19,14 +19,19 @@
 #include <QStringList>
 #include <csync.h>
 #include <QMap>
+#include <QHash>
 #include "networkjobs.h"
 #include <QMutex>
 #include <QWaitCondition>
 #include <QLinkedList>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace OCC {
 
 class Account;
+class SyncJournalDb;
 
 /**
  * The Discovery Phase was once called "update" phase in csync terms.
@@ -35,48 +40,86 @@ class Account;
  */
 
 struct SyncOptions {
-    SyncOptions() : _newBigFolderSizeLimit(-1), _confirmExternalStorage(false) {}
+    SyncOptions() : _newBigFolderSizeLimit(-1), _confirmExternalStorage(false), _parallelDiscoveryJobs(1),
+        _localDiscoveryThreads(1), _discoveryChecksumThreads(0), _reconcileThreads(1),
+        _localDiscoveryFromJournal(false), _streamInitialSync(false), _memoryBudget(0) {}
     /** Maximum size (in Bytes) a folder can have without asking for confirmation.
      * -1 means infinite */
     qint64 _newBigFolderSizeLimit;
     /** If a confirmation should be asked for external storages */
     bool _confirmExternalStorage;
+    /** How many remote directory listings may be fetched at the same time during the
+     * discovery. 1 means the directories are listed one after the other, as csync asks for them */
+    int _parallelDiscoveryJobs;
+    /** How many threads list and stat local directories during the discovery.
+     * 1 means the local tree is only read by the discovery thread itself */
+    int _localDiscoveryThreads;
+    /** How many threads compare the checksums of the local files that were touched
+     * without changing their size, during the discovery. 0 means only .eml files are
+     * compared, by the discovery thread itself */
+    int _discoveryChecksumThreads;
+    /** How many threads reconcile the local and remote trees after the discovery.
+     * 1 means the reconcile runs on the sync thread only */
+    int _reconcileThreads;
+    /** If the local discovery may read the directories nothing changed in from the journal,
+     * see SyncEngine::setLocalDiscoveryOptions. If false, every sync walks the whole local tree */
+    bool _localDiscoveryFromJournal;
+    /** If the first sync of a folder goes in rounds: the files at the root first, then each
+     * top-level directory. Each round is propagated as soon as it is discovered, while the
+     * listings of the next ones are fetched */
+    bool _streamInitialSync;
+    /** Roughly how much memory (in Bytes) a sync may use for the files it knows about.
+     * If the journal has more files than that, the sync goes in rounds of top-level
+     * directories like a streamed initial sync, committing the journal after each one.
+     * 0 means no limit */
+    qint64 _memoryBudget;
 };
 
+/**
+ * The part of the tree a sync round is limited to, see SyncOptions::_streamInitialSync
+ * and SyncOptions::_memoryBudget.
+ * The discovery skips everything else as if it did not exist.
+ */
+struct SyncScope {
+    SyncScope() : _limited(false) {}
+    /** If false, the whole tree is synced */
+    bool _limited;
+    /** The top-level directories of the round, sorted. If empty, the round is
+     * about the entries at the root that are not directories */
+    QStringList _subtrees;
+
+    bool contains(const QString &path, bool isDirectory) const;
+};
 
 /**
- * @brief The FileStatPointer class
- * @ingroup libsync
+ * How the local tree is discovered
  */
-class FileStatPointer {
-public:
-    FileStatPointer(csync_vio_file_stat_t *stat)
-        : _stat(stat)
-    { }
-    FileStatPointer(const FileStatPointer &other)
-        : _stat(csync_vio_file_stat_copy(other._stat))
-    { }
-    ~FileStatPointer() {
-        csync_vio_file_stat_destroy(_stat);
-    }
-    FileStatPointer &operator=(const FileStatPointer &other) {
-        csync_vio_file_stat_destroy(_stat);
-        _stat = csync_vio_file_stat_copy(other._stat);
-        return *this;
-    }
-    inline csync_vio_file_stat_t *data() const { return _stat; }
-    inline csync_vio_file_stat_t *operator->() const { return _stat; }
+enum LocalDiscoveryStyle {
+    FilesystemOnly, // walk the whole local tree
+    DatabaseAndFilesystem // only walk the directories that may have changed, take the others from the journal
+};
 
-private:
-    csync_vio_file_stat_t *_stat;
+
+/**
+ * @brief Owning pointer to a csync_vio_file_stat_t
+ *
+ * It can only be moved: the entries of a directory listing are handed from the
+ * DiscoverySingleDirectoryJob to the sync thread, and then to csync, without copies.
+ *
+ * @ingroup libsync
+ */
+struct FileStatDeleter {
+    void operator()(csync_vio_file_stat_t *stat) const { csync_vio_file_stat_destroy(stat); }
 };
+typedef std::unique_ptr<csync_vio_file_stat_t, FileStatDeleter> FileStatPointer;
+typedef std::vector<FileStatPointer> FileStatList;
 
 struct DiscoveryDirectoryResult {
     QString path;
     QString msg;
     int code;
-    QList<FileStatPointer> list;
-    int listIndex;
+    FileStatList list;
+    size_t listIndex;
     DiscoveryDirectoryResult() : code(EIO), listIndex(0) { }
 };
 
@@ -95,19 +138,22 @@ public:
     void setIsRootPath() { _isRootPath = true; }
     void start();
     void abort();
+    QString path() const { return _subPath; }
+    // The entries of the listing, to be taken once finishedWithResult was emitted
+    FileStatList takeResults() { return std::move(_results); }
     // This is not actually a network job, it is just a job
 signals:
     void firstDirectoryPermissions(const QString &);
     void etagConcatenation(const QString &);
     void etag(const QString &);
-    void finishedWithResult(const QList<FileStatPointer> &);
+    void finishedWithResult();
     void finishedWithError(int csyncErrnoCode, const QString &msg);
 private slots:
     void directoryListingIteratedSlot(QString, const QMap<QString,QString>&);
     void lsJobFinishedWithoutErrorSlot();
     void lsJobFinishedWithErrorSlot(QNetworkReply*);
 private:
-    QList<FileStatPointer> _results;
+    FileStatList _results;
     QString _subPath;
     QString _etagConcatenation;
     QString _firstEtag;
@@ -131,20 +177,39 @@ class DiscoveryMainThread : public QObject {
     Q_OBJECT
 
     QPointer<DiscoveryJob> _discoveryJob;
-    QPointer<DiscoverySingleDirectoryJob> _singleDirJob;
     QString _pathPrefix; // remote path
     AccountPtr _account;
+    SyncJournalDb *_journal;
+    QStringList _selectiveSyncBlackList;
     DiscoveryDirectoryResult *_currentDiscoveryDirectoryResult;
     qint64 *_currentGetSizeResult;
     bool _firstFolderProcessed;
 
+    // Directory listings in flight, keyed by their full remote path.
+    // Contains the one the sync thread is waiting for, if any, and the prefetched ones.
+    QHash<QString, QPointer<DiscoverySingleDirectoryJob> > _runningJobs;
+    // Listings that arrived before the sync thread asked for them
+    std::map<QString, DiscoveryDirectoryResult> _prefetchedResults;
+    // Directories that we expect the sync thread to open soon, the first one is the most likely
+    QLinkedList<QString> _prefetchQueue;
+    int _maxParallelJobs;
+
+    DiscoverySingleDirectoryJob *startSingleDirectoryJob(const QString &fullPath);
+    void schedulePrefetchJobs();
+    void enqueueSubDirectories(const QString &fullPath, const FileStatList &result);
+    bool willBeOpened(const QString &relativePath, const csync_vio_file_stat_t *file_stat);
+    void deliverCurrentResult(DiscoveryDirectoryResult &result);
+
 public:
-    DiscoveryMainThread(AccountPtr account) : QObject(), _account(account),
-        _currentDiscoveryDirectoryResult(0), _currentGetSizeResult(0), _firstFolderProcessed(false)
+    DiscoveryMainThread(AccountPtr account, SyncJournalDb *journal) : QObject(), _account(account),
+        _journal(journal), _currentDiscoveryDirectoryResult(0), _currentGetSizeResult(0), _firstFolderProcessed(false),
+        _maxParallelJobs(1)
     { }
     void abort();
 
     QByteArray _dataFingerprint;
+    // The directories of the first root listing, in the order of the listing
+    QStringList _rootDirectories;
 
 
 public slots:
@@ -153,7 +218,7 @@ public slots:
     void doGetSizeSlot(const QString &path ,qint64 *result);
 
     // From Job:
-    void singleDirectoryJobResultSlot(const QList<FileStatPointer> &);
+    void singleDirectoryJobResultSlot();
     void singleDirectoryJobFinishedWithErrorSlot(int csyncErrnoCode, const QString &msg);
     void singleDirectoryJobFirstDirectoryPermissionsSlot(const QString&);
 
@@ -191,6 +256,15 @@ class DiscoveryJob : public QObject {
     bool checkSelectiveSyncNewFolder(const QString &path, const char *remotePerm);
     static int checkSelectiveSyncNewFolderCallback(void* data, const char* path, const char* remotePerm);
 
+    /**
+     * return true if the local directory needs to be read from the file system,
+     * false if its contents can be taken from the journal
+     */
+    bool isLocalDirectoryDirty(const QString &path) const;
+    static int isLocalDirectoryDirtyCallback(void *, const char *);
+
+    static int isOutsideSyncScopeCallback(void *, const char *, int);
+
     // Just for progress
     static void update_job_update_callback (bool local,
                                             const char *dirname,
@@ -209,7 +283,7 @@ class DiscoveryJob : public QObject {
 
 public:
     explicit DiscoveryJob(CSYNC *ctx, QObject* parent = 0)
-            : QObject(parent), _csync_ctx(ctx) {
+            : QObject(parent), _csync_ctx(ctx), _localDiscoveryStyle(FilesystemOnly) {
         // We need to forward the log property as csync uses thread local
         // and updates run in another thread
         _log_callback = csync_get_log_callback();
@@ -220,6 +294,10 @@ public:
     QStringList _selectiveSyncBlackList;
     QStringList _selectiveSyncWhiteList;
     SyncOptions _syncOptions;
+    LocalDiscoveryStyle _localDiscoveryStyle;
+    // Paths, relative to the sync folder, that changed locally since the last sync
+    QStringList _localDiscoveryPaths;
+    SyncScope _syncScope;
     Q_INVOKABLE void start();
 signals:
     void finished(int result);
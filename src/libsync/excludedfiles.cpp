@@ -27,11 +27,14 @@ using namespace OCC;
 
 ExcludedFiles::ExcludedFiles(c_strlist_t** excludesPtr)
     : _excludesPtr(excludesPtr)
+    , _matcher(csync_exclude_matcher_new(*excludesPtr))
+    , _revision(0)
 {
 }
 
 ExcludedFiles::~ExcludedFiles()
 {
+    csync_exclude_matcher_free(_matcher);
     c_strlist_destroy(*_excludesPtr);
 }
 
@@ -51,11 +54,25 @@ void ExcludedFiles::addExcludeFilePath(const QString& path)
 void ExcludedFiles::addExcludeExpr(const QString &expr)
 {
     _csync_exclude_add(_excludesPtr, expr.toLatin1().constData());
+    csync_exclude_matcher_free(_matcher);
+    _matcher = csync_exclude_matcher_new(*_excludesPtr);
+    _matchedDirectories.clear();
+    ++_revision;
 }
 #endif
 
+static QList<QByteArray> patternsOf(const c_strlist_t *list)
+{
+    QList<QByteArray> patterns;
+    for (size_t i = 0; list && i < list->count; ++i) {
+        patterns.append(QByteArray(list->vector[i]));
+    }
+    return patterns;
+}
+
 bool ExcludedFiles::reloadExcludes()
 {
+    const QList<QByteArray> oldPatterns = patternsOf(*_excludesPtr);
     c_strlist_destroy(*_excludesPtr);
     *_excludesPtr = NULL;
 
@@ -64,6 +81,12 @@ bool ExcludedFiles::reloadExcludes()
         if (csync_exclude_load(file.toUtf8(), _excludesPtr) < 0)
             success = false;
     }
+    if (patternsOf(*_excludesPtr) != oldPatterns) {
+        ++_revision;
+    }
+    csync_exclude_matcher_free(_matcher);
+    _matcher = csync_exclude_matcher_new(*_excludesPtr);
+    _matchedDirectories.clear();
     return success;
 }
 
@@ -77,31 +100,85 @@ bool ExcludedFiles::isExcluded(
         return true;
     }
 
-    if( excludeHidden ) {
-        QString path = filePath;
-        // Check all path subcomponents, but to *not* check the base path:
-        // We do want to be able to sync with a hidden folder as the target.
-        while (path.size() > basePath.size()) {
-            QFileInfo fi(path);
-            if( fi.isHidden() || fi.fileName().startsWith(QLatin1Char('.')) ) {
-                return true;
-            }
-
-            // Get the parent path
-            path = fi.absolutePath();
-        }
+    QString relativePath = filePath.mid(basePath.size());
+    if (relativePath.endsWith(QLatin1Char('/'))) {
+        relativePath.chop(1);
+    }
+
+    // The parent directories were most likely checked before
+    int slash = relativePath.lastIndexOf(QLatin1Char('/'));
+    if (slash > 0 && isDirectoryExcluded(relativePath.left(slash), basePath, excludeHidden)) {
+        return true;
     }
 
     QFileInfo fi(filePath);
+    // We do want to be able to sync with a hidden folder as the target,
+    // so the base path itself is not checked.
+    if (excludeHidden && !relativePath.isEmpty()) {
+        if( fi.isHidden() || fi.fileName().startsWith(QLatin1Char('.')) ) {
+            return true;
+        }
+    }
+
     csync_ftw_type_e type = CSYNC_FTW_TYPE_FILE;
     if (fi.isDir()) {
         type = CSYNC_FTW_TYPE_DIR;
     }
 
-    QString relativePath = filePath.mid(basePath.size());
-    if (relativePath.endsWith(QLatin1Char('/'))) {
-        relativePath.chop(1);
+    return csync_exclude_match_traversal(_matcher, relativePath.toUtf8(), type) != CSYNC_NOT_EXCLUDED;
+}
+
+bool ExcludedFiles::isDirectoryExcluded(
+        const QString& relativeDir,
+        const QString& basePath,
+        bool excludeHidden) const
+{
+    if (isDirectoryMatched(relativeDir, basePath)) {
+        return true;
+    }
+    if (!excludeHidden) {
+        return false;
+    }
+
+    // The hidden attribute can change without the path changing, so it is
+    // looked up every time
+    QString dir = relativeDir;
+    for (;;) {
+        QFileInfo fi(basePath + dir);
+        if (fi.fileName().startsWith(QLatin1Char('.')) || fi.isHidden()) {
+            return true;
+        }
+        int slash = dir.lastIndexOf(QLatin1Char('/'));
+        if (slash <= 0) {
+            return false;
+        }
+        dir.truncate(slash);
+    }
+}
+
+bool ExcludedFiles::isDirectoryMatched(
+        const QString& relativeDir,
+        const QString& basePath) const
+{
+    const auto key = qMakePair(basePath, relativeDir);
+    auto it = _matchedDirectories.constFind(key);
+    if (it != _matchedDirectories.constEnd()) {
+        return it.value();
     }
 
-    return csync_excluded_no_ctx(*_excludesPtr, relativePath.toUtf8(), type) != CSYNC_NOT_EXCLUDED;
+    bool matched = false;
+    int slash = relativeDir.lastIndexOf(QLatin1Char('/'));
+    if (slash > 0) {
+        matched = isDirectoryMatched(relativeDir.left(slash), basePath);
+    }
+    if (!matched) {
+        matched = csync_exclude_match_traversal(_matcher, relativeDir.toUtf8(), CSYNC_FTW_TYPE_DIR) != CSYNC_NOT_EXCLUDED;
+    }
+
+    // Browsing through a huge tree should not grow the cache forever
+    if (_matchedDirectories.size() >= 100000) {
+        _matchedDirectories.clear();
+    }
+    _matchedDirectories.insert(key, matched);
+    return matched;
 }
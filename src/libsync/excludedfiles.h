@@ -16,7 +16,9 @@
 
 #include "owncloudlib.h"
 
+#include <QHash>
 #include <QObject>
+#include <QPair>
 #include <QSet>
 #include <QString>
 
@@ -50,6 +52,10 @@ public:
     /**
      * Checks whether a file or directory should be excluded.
      *
+     * Like the discovery, a path is excluded if its parent directory is or if
+     * its own name matches. The pattern verdicts for the directories are cached
+     * until the patterns change, so this is not thread safe.
+     *
      * @param filePath     the absolute path to the file
      * @param basePath     folder path from which to apply exclude rules
      */
@@ -62,6 +68,12 @@ public:
     void addExcludeExpr(const QString &expr);
 #endif
 
+    /**
+     * Changes whenever the patterns change, so that the files that are no longer
+     * excluded can be looked for again.
+     */
+    int revision() const { return _revision; }
+
 public slots:
     /**
      * Reloads the exclude patterns from the registered paths.
@@ -69,10 +81,32 @@ public slots:
     bool reloadExcludes();
 
 private:
+    /**
+     * Whether the directory at basePath + relativeDir or one of its parents
+     * below basePath is excluded.
+     */
+    bool isDirectoryExcluded(
+            const QString& relativeDir,
+            const QString& basePath,
+            bool excludeHidden) const;
+
+    /**
+     * Whether the directory or one of its parents matches a pattern, from the
+     * cache if possible.
+     */
+    bool isDirectoryMatched(
+            const QString& relativeDir,
+            const QString& basePath) const;
+
     // This is a pointer to the csync exclude list, its is owned by this class
     // but the pointer can be in a csync_context so that it can itself also query the list.
     c_strlist_t** _excludesPtr;
+    // The patterns of *_excludesPtr compiled for isExcluded(), rebuilt when they change
+    csync_exclude_matcher_t* _matcher;
+    // The pattern verdicts for directories by (basePath, relative path), for isExcluded()
+    mutable QHash<QPair<QString, QString>, bool> _matchedDirectories;
     QSet<QString> _excludeFiles;
+    int _revision;
 };
 
 } // namespace OCC
@@ -136,146 +136,209 @@ bool MkColJob::finished()
 }
 
 /*********************************************************************************************/
-// supposed to read <D:collection> when pointing to <D:resourcetype><D:collection></D:resourcetype>..
-static QString readContentsAsString(QXmlStreamReader &reader) {
-    QString result;
-    int level = 0;
-    do {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        if (type == QXmlStreamReader::StartElement) {
-            level++;
-            result += "<" + reader.name().toString() + ">";
-        } else if (type == QXmlStreamReader::Characters) {
-            result += reader.text();
-        } else if (type == QXmlStreamReader::EndElement) {
-            level--;
-            if (level < 0) {
-                break;
-            }
-            result += "</" + reader.name().toString() + ">";
-        }
 
-    } while (!reader.atEnd());
-    return result;
+LsColXMLParser::LsColXMLParser()
+    : _sizes(0)
+    , _failed(false)
+    , _currentPropsHaveHttp200(false)
+    , _insidePropstat(false)
+    , _insideProp(false)
+    , _insideMultiStatus(false)
+    , _multiStatusComplete(false)
+    , _currentTextElement(NoText)
+    , _propertyLevel(0)
+{
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
 }
 
+bool LsColXMLParser::parse( const QByteArray& xml, QHash<QString, qint64> *sizes, const QString& expectedPath)
+{
+    start(sizes, expectedPath);
+    return addData(xml) && finish();
+}
 
-LsColXMLParser::LsColXMLParser()
+void LsColXMLParser::start(QHash<QString, qint64> *sizes, const QString &expectedPath)
 {
+    _sizes = sizes;
+    _expectedPath = expectedPath;
+}
 
+bool LsColXMLParser::addData(const QByteArray &data)
+{
+    if (_failed) {
+        return false;
+    }
+    _reader.addData(data);
+    return processTokens();
 }
 
-bool LsColXMLParser::parse( const QByteArray& xml, QHash<QString, qint64> *sizes, const QString& expectedPath)
+bool LsColXMLParser::processTokens()
 {
-    // Parse DAV response
-    QXmlStreamReader reader(xml);
-    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
-
-    QStringList folders;
-    QString currentHref;
-    QMap<QString, QString> currentTmpProperties;
-    QMap<QString, QString> currentHttp200Properties;
-    bool currentPropsHaveHttp200 = false;
-    bool insidePropstat = false;
-    bool insideProp = false;
-    bool insideMultiStatus = false;
-
-    while (!reader.atEnd()) {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        QString name = reader.name().toString();
+    if (_reader.tokenType() == QXmlStreamReader::EndDocument) {
+        return true;
+    }
+    // Not checking atEnd(): it is also true when the reader waits for more data
+    forever {
+        QXmlStreamReader::TokenType type = _reader.readNext();
+        if (type == QXmlStreamReader::Invalid || type == QXmlStreamReader::EndDocument) {
+            break; // error, end, or the rest of the data did not arrive yet
+        }
+
+        if (_propertyLevel > 0) {
+            // Inside a property: the raw content, e.g. "<collection></collection>" for the
+            // resourcetype of a folder
+            if (type == QXmlStreamReader::StartElement) {
+                _propertyLevel++;
+                _currentPropertyContent += "<" + _reader.name().toString() + ">";
+            } else if (type == QXmlStreamReader::Characters) {
+                _currentPropertyContent += _reader.text();
+            } else if (type == QXmlStreamReader::EndElement) {
+                if (--_propertyLevel > 0) {
+                    _currentPropertyContent += "</" + _reader.name().toString() + ">";
+                    continue;
+                }
+                if (_currentPropertyName == QLatin1String("resourcetype") && _currentPropertyContent.contains("collection")) {
+                    _folders.append(_currentHref);
+                } else if (_currentPropertyName == QLatin1String("size")) {
+                    bool ok = false;
+                    auto s = _currentPropertyContent.toLongLong(&ok);
+                    if (ok && _sizes) {
+                        _sizes->insert(_currentHref, s);
+                    }
+                }
+                _currentTmpProperties.insert(_currentPropertyName, _currentPropertyContent);
+                _currentPropertyContent.clear();
+            }
+            continue;
+        }
+
+        if (_currentTextElement != NoText) {
+            if (type == QXmlStreamReader::Characters) {
+                _currentText += _reader.text();
+            } else if (type == QXmlStreamReader::EndElement) {
+                if (_currentTextElement == HrefText) {
+                    // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
+                    // but the result will have URL encoding..
+                    QString hrefString = QString::fromUtf8(QByteArray::fromPercentEncoding(_currentText.toUtf8()));
+                    if (!hrefString.startsWith(_expectedPath)) {
+                        qDebug() << "Invalid href" << hrefString << "expected starting with" << _expectedPath;
+                        _failed = true;
+                        return false;
+                    }
+                    _currentHref = hrefString;
+                } else {
+                    _currentPropsHaveHttp200 = _currentText.startsWith("HTTP/1.1 200");
+                }
+                _currentTextElement = NoText;
+                _currentText.clear();
+            }
+            continue;
+        }
+
+        const QStringRef name = _reader.name();
         // Start elements with DAV:
-        if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
+        if (type == QXmlStreamReader::StartElement && _reader.namespaceUri() == QLatin1String("DAV:")) {
             if (name == QLatin1String("href")) {
-                // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
-                // but the result will have URL encoding..
-                QString hrefString = QString::fromUtf8(QByteArray::fromPercentEncoding(reader.readElementText().toUtf8()));
-                if (!hrefString.startsWith(expectedPath)) {
-                    qDebug() << "Invalid href" << hrefString << "expected starting with" << expectedPath;
-                    return false;
-                }
-                currentHref = hrefString;
+                _currentTextElement = HrefText;
+                continue;
             } else if (name == QLatin1String("response")) {
             } else if (name == QLatin1String("propstat")) {
-                insidePropstat = true;
-            } else if (name == QLatin1String("status") && insidePropstat) {
-                QString httpStatus = reader.readElementText();
-                if (httpStatus.startsWith("HTTP/1.1 200")) {
-                    currentPropsHaveHttp200 = true;
-                } else {
-                    currentPropsHaveHttp200 = false;
-                }
+                _insidePropstat = true;
+            } else if (name == QLatin1String("status") && _insidePropstat) {
+                _currentTextElement = StatusText;
+                continue;
             } else if (name == QLatin1String("prop")) {
-                insideProp = true;
+                _insideProp = true;
                 continue;
             } else if (name == QLatin1String("multistatus")) {
-                insideMultiStatus = true;
+                _insideMultiStatus = true;
                 continue;
             }
         }
 
-        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
+        if (type == QXmlStreamReader::StartElement && _insidePropstat && _insideProp) {
             // All those elements are properties
-            QString propertyContent = readContentsAsString(reader);
-            if (name == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
-                folders.append(currentHref);
-            } else if (name == QLatin1String("size")) {
-                bool ok = false;
-                auto s = propertyContent.toLongLong(&ok);
-                if (ok && sizes) {
-                    sizes->insert(currentHref, s);
-                }
-            }
-            currentTmpProperties.insert(reader.name().toString(), propertyContent);
+            _currentPropertyName = internedPropertyName(name);
+            _propertyLevel = 1;
+            continue;
         }
 
         // End elements with DAV:
         if (type == QXmlStreamReader::EndElement) {
-            if (reader.namespaceUri() == QLatin1String("DAV:")) {
-                if (reader.name() == "response") {
-                    if (currentHref.endsWith('/')) {
-                        currentHref.chop(1);
+            if (_reader.namespaceUri() == QLatin1String("DAV:")) {
+                if (_reader.name() == "response") {
+                    if (_currentHref.endsWith('/')) {
+                        _currentHref.chop(1);
                     }
-                    emit directoryListingIterated(currentHref, currentHttp200Properties);
-                    currentHref.clear();
-                    currentHttp200Properties.clear();
-                } else if (reader.name() == "propstat") {
-                    insidePropstat = false;
-                    if (currentPropsHaveHttp200) {
-                        currentHttp200Properties = QMap<QString,QString>(currentTmpProperties);
+                    emit directoryListingIterated(_currentHref, _currentHttp200Properties);
+                    _currentHref.clear();
+                    _currentHttp200Properties.clear();
+                } else if (_reader.name() == "propstat") {
+                    _insidePropstat = false;
+                    if (_currentPropsHaveHttp200) {
+                        _currentHttp200Properties.swap(_currentTmpProperties);
                     }
-                    currentTmpProperties.clear();
-                    currentPropsHaveHttp200 = false;
-                } else if (reader.name() == "prop") {
-                    insideProp = false;
+                    _currentTmpProperties.clear();
+                    _currentPropsHaveHttp200 = false;
+                } else if (_reader.name() == "prop") {
+                    _insideProp = false;
+                } else if (_reader.name() == "multistatus") {
+                    _multiStatusComplete = true;
                 }
             }
         }
     }
 
-    if (reader.hasError()) {
+    if (_reader.hasError() && _reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
         // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
-        qDebug() << "ERROR" << reader.errorString() << xml;
+        qDebug() << "ERROR" << _reader.errorString() << "at line" << _reader.lineNumber();
+        _failed = true;
         return false;
-    } else if (!insideMultiStatus) {
-        qDebug() << "ERROR no WebDAV response?" << xml;
-        return false;
-    } else {
-        emit directoryListingSubfolders(folders);
-        emit finishedWithoutError();
     }
     return true;
+}
+
+// The same few property names come for every entry: sharing the strings saves
+// allocating them again for each entry.
+QString LsColXMLParser::internedPropertyName(const QStringRef &name)
+{
+    foreach (const QString &propertyName, _propertyNames) {
+        if (name == propertyName) {
+            return propertyName;
+        }
+    }
+    _propertyNames.append(name.toString());
+    return _propertyNames.last();
+}
 
+bool LsColXMLParser::finish()
+{
+    if (_failed) {
+        return false;
+    }
+    // The reader cannot know whether more data would follow, a premature end is
+    // only fine if the document was actually complete.
+    if (_reader.hasError() && !(_reader.error() == QXmlStreamReader::PrematureEndOfDocumentError && _multiStatusComplete)) {
+        qDebug() << "ERROR" << _reader.errorString() << "at line" << _reader.lineNumber();
+        return false;
+    } else if (!_insideMultiStatus) {
+        qDebug() << "ERROR no WebDAV response?";
+        return false;
+    }
+    emit directoryListingSubfolders(_folders);
+    emit finishedWithoutError();
+    return true;
 }
 
 /*********************************************************************************************/
 
 LsColJob::LsColJob(AccountPtr account, const QString &path, QObject *parent)
-    : AbstractNetworkJob(account, path, parent)
+    : AbstractNetworkJob(account, path, parent), _parser(0)
 {
 }
 
 LsColJob::LsColJob(AccountPtr account, const QUrl &url, QObject *parent)
-    : AbstractNetworkJob(account, QString(), parent), _url(url)
+    : AbstractNetworkJob(account, QString(), parent), _url(url), _parser(0)
 {
 }
 
@@ -327,29 +390,51 @@ void LsColJob::start()
     buf->setParent(reply);
     setReply(reply);
     setupConnections(reply);
+    connect(reply, SIGNAL(readyRead()), this, SLOT(slotReadyRead()));
     AbstractNetworkJob::start();
 }
 
-// TODO: Instead of doing all in this slot, we should iteratively parse in readyRead(). This
-// would allow us to be more asynchronous in processing while data is coming from the network,
-// not all in one big blob at the end.
-bool LsColJob::finished()
+bool LsColJob::canParseReply()
 {
     QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
     int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
-        LsColXMLParser parser;
-        connect( &parser, SIGNAL(directoryListingSubfolders(const QStringList&)),
+    return httpCode == 207 && contentType.contains("application/xml; charset=utf-8");
+}
+
+// Parse the listing while it is arriving, so that entries are emitted early and
+// big listings do not need to be kept in memory.
+void LsColJob::slotReadyRead()
+{
+    if (!_parser) {
+        if (!canParseReply()) {
+            return; // Leave the data for the error handling in finished()
+        }
+        _parser = new LsColXMLParser;
+        _parser->setParent(this);
+        connect( _parser, SIGNAL(directoryListingSubfolders(const QStringList&)),
                  this, SIGNAL(directoryListingSubfolders(const QStringList&)) );
-        connect( &parser, SIGNAL(directoryListingIterated(const QString&, const QMap<QString,QString>&)),
+        connect( _parser, SIGNAL(directoryListingIterated(const QString&, const QMap<QString,QString>&)),
                  this, SIGNAL(directoryListingIterated(const QString&, const QMap<QString,QString>&)) );
-        connect( &parser, SIGNAL(finishedWithError(QNetworkReply *)),
+        connect( _parser, SIGNAL(finishedWithError(QNetworkReply *)),
                  this, SIGNAL(finishedWithError(QNetworkReply *)) );
-        connect( &parser, SIGNAL(finishedWithoutError()),
+        connect( _parser, SIGNAL(finishedWithoutError()),
                  this, SIGNAL(finishedWithoutError()) );
 
         QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
-        if( !parser.parse( reply()->readAll(), &_sizes, expectedPath ) ) {
+        _parser->start(&_sizes, expectedPath);
+    }
+
+    // An error is remembered by the parser and reported in finished()
+    _parser->addData(reply()->readAll());
+}
+
+bool LsColJob::finished()
+{
+    int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (canParseReply()) {
+        // Whatever was not consumed by slotReadyRead yet
+        slotReadyRead();
+        if (!_parser->finish()) {
             // XML parse error
             emit finishedWithError(reply());
         }
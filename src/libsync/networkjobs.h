@@ -18,6 +18,8 @@
 
 #include "abstractnetworkjob.h"
 
+#include <QXmlStreamReader>
+
 class QUrl;
 
 namespace OCC {
@@ -48,14 +50,52 @@ class OWNCLOUDSYNC_EXPORT LsColXMLParser : public QObject {
 public:
     explicit LsColXMLParser();
 
+    /** Parse a complete PROPFIND reply */
     bool parse(const QByteArray &xml, QHash<QString, qint64> *sizes, const QString& expectedPath);
 
+    /**
+     * Incremental parsing: call start() once, then addData() with each chunk of the
+     * reply as it arrives and finish() when the reply is complete.
+     * Each entry is emitted as soon as it was fully received, the reply is never
+     * held in memory as a whole. addData() and finish() return false on error.
+     */
+    void start(QHash<QString, qint64> *sizes, const QString& expectedPath);
+    bool addData(const QByteArray &data);
+    bool finish();
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString,QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
 
+private:
+    bool processTokens();
+    QString internedPropertyName(const QStringRef &name);
+
+    QXmlStreamReader _reader;
+    QHash<QString, qint64> *_sizes;
+    QString _expectedPath;
+    bool _failed;
+
+    QStringList _folders;
+    QString _currentHref;
+    QMap<QString, QString> _currentTmpProperties;
+    QMap<QString, QString> _currentHttp200Properties;
+    bool _currentPropsHaveHttp200;
+    bool _insidePropstat;
+    bool _insideProp;
+    bool _insideMultiStatus;
+    bool _multiStatusComplete;
+
+    // The text of the DAV:href or DAV:status being read, the data can be split in several chunks
+    enum { NoText, HrefText, StatusText } _currentTextElement;
+    QString _currentText;
+    // The property being read, with its nesting level (0 when not inside a property)
+    QString _currentPropertyName;
+    QString _currentPropertyContent;
+    int _propertyLevel;
+    QStringList _propertyNames;
 };
 
 class OWNCLOUDSYNC_EXPORT LsColJob : public AbstractNetworkJob {
@@ -85,10 +125,14 @@ signals:
 
 private slots:
     virtual bool finished() Q_DECL_OVERRIDE;
+    void slotReadyRead();
 
 private:
+    bool canParseReply();
+
     QList<QByteArray> _properties;
     QUrl _url; // Used instead of path() if the url is specified in the constructor
+    LsColXMLParser *_parser; // created on the first chunk of a valid reply
 };
 
 /**
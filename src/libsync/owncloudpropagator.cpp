@@ -76,10 +76,7 @@ OwncloudPropagator::~OwncloudPropagator()
 
 int OwncloudPropagator::maximumActiveTransferJob()
 {
-    if (_downloadLimit.fetchAndAddAcquire(0) != 0 || _uploadLimit.fetchAndAddAcquire(0) != 0) {
-        // disable parallelism when there is a network limit.
-        return 1;
-    }
+    // The network limits are shared by the transfers in flight, see BandwidthManager
     return qCeil(hardMaximumActiveJob()/2.);
 }
 
@@ -87,11 +84,80 @@ int OwncloudPropagator::maximumActiveTransferJob()
 int OwncloudPropagator::hardMaximumActiveJob()
 {
     static int max = qgetenv("OWNCLOUD_MAX_PARALLEL").toUInt();
-    if (!max) {
-        max = 6; //default (Qt cannot do more anyway)
-        // TODO: increase this number when using HTTP2
+    if (max) {
+        return max;
+    }
+    return _concurrency->limit();
+}
+
+// Whether the job of the item uploads or downloads the file
+static bool isTransfer(const SyncFileItem &item)
+{
+    return !item._isDirectory
+        && (item._instruction == CSYNC_INSTRUCTION_NEW
+            || item._instruction == CSYNC_INSTRUCTION_SYNC
+            || item._instruction == CSYNC_INSTRUCTION_CONFLICT
+            || item._instruction == CSYNC_INSTRUCTION_TYPE_CHANGE);
+}
+
+// The clock of the samples, the same for all the propagators
+static qint64 concurrencyClockMsecs()
+{
+    static QElapsedTimer clock;
+    if (!clock.isValid()) {
+        clock.start();
+    }
+    return clock.elapsed();
+}
+
+void OwncloudPropagator::reportJobDuration(const SyncFileItem &item, qint64 durationMsec)
+{
+    // The local operations and the ignored items say nothing about the network
+    const bool usesNetwork = isTransfer(item)
+        || (item._direction == SyncFileItem::Up
+            && (item._instruction == CSYNC_INSTRUCTION_NEW
+                || item._instruction == CSYNC_INSTRUCTION_REMOVE
+                || item._instruction == CSYNC_INSTRUCTION_RENAME));
+    if (!usesNetwork || _abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+    // The server or the link is overloaded, or the request timed out
+    const bool failed = item._status == SyncFileItem::FatalError
+        || item._httpErrorCode == 429 || item._httpErrorCode >= 500;
+    const qint64 bytes = isTransfer(item) && item._status == SyncFileItem::Success ? item._size : 0;
+    _concurrency->addSample(concurrencyClockMsecs(), durationMsec, bytes, failed);
+}
+
+OwncloudPropagator::JobLane OwncloudPropagator::laneOf(PropagateItemJob *job)
+{
+    if (!isTransfer(*job->_item)) {
+        return QuickLane;
     }
-    return max;
+    return job->isLikelyFinishedQuickly() ? SmallTransferLane : LargeTransferLane;
+}
+
+int OwncloudPropagator::maximumActiveJobs(JobLane lane)
+{
+    switch (lane) {
+    case QuickLane:
+        return hardMaximumActiveJob();
+    case SmallTransferLane:
+    case LargeTransferLane:
+        return maximumActiveTransferJob();
+    }
+    return hardMaximumActiveJob();
+}
+
+bool OwncloudPropagator::hasRoomInLane(PropagateItemJob *job)
+{
+    const JobLane lane = laneOf(job);
+    int active = 0;
+    foreach (PropagateItemJob *activeJob, _activeJobList) {
+        if (laneOf(activeJob) == lane) {
+            ++active;
+        }
+    }
+    return active < maximumActiveJobs(lane);
 }
 
 /** Updates, creates or removes a blacklist entry for the given item.
@@ -169,6 +235,10 @@ void PropagateItemJob::done(SyncFileItem::Status status, const QString &errorStr
 
     _item->_status = status;
 
+    if (_runTime.isValid()) {
+        propagator()->reportJobDuration(*_item, _runTime.elapsed());
+    }
+
     emit propagator()->itemCompleted(_item);
     emit finished(status);
 
@@ -250,6 +320,131 @@ void PropagateItemJob::slotRestoreJobFinished(SyncFileItem::Status status)
 
 // ================================================================================
 
+// Whether path is inside one of the dirs, or one of them if orEqual
+template <typename Dirs>
+static bool isInsideAnyOf(const QString &path, const Dirs &dirs, bool orEqual)
+{
+    if (orEqual && dirs.contains(path)) {
+        return true;
+    }
+    int slash = path.lastIndexOf(QLatin1Char('/'));
+    while (slash > 0) {
+        if (dirs.contains(path.left(slash))) {
+            return true;
+        }
+        slash = path.lastIndexOf(QLatin1Char('/'), slash - 1);
+    }
+    return false;
+}
+
+bool OwncloudPropagator::isDelayedByDirectoryMove(const SyncFileItem &item) const
+{
+    if (_pendingDirectoryMoves.isEmpty()) {
+        return false;
+    }
+    // The source of the item was adjusted for the directory move, it only exists there
+    // once the move is done
+    if (item._instruction == CSYNC_INSTRUCTION_RENAME
+            && isInsideAnyOf(item._file, _pendingDirectoryMoves, false)) {
+        return true;
+    }
+    return isInsideAnyOf(item.destination(), _pendingDirectoryMoveSources, true);
+}
+
+void OwncloudPropagator::directoryMoveDone(const QString &target, bool andInside)
+{
+    auto it = _pendingDirectoryMoves.find(target);
+    if (it != _pendingDirectoryMoves.end()) {
+        _pendingDirectoryMoveSources.remove(it.value());
+        _pendingDirectoryMoves.erase(it);
+    }
+    if (!andInside) {
+        return;
+    }
+    const QString inside = target + QLatin1Char('/');
+    for (it = _pendingDirectoryMoves.begin(); it != _pendingDirectoryMoves.end();) {
+        if (it.key().startsWith(inside)) {
+            _pendingDirectoryMoveSources.remove(it.value());
+            it = _pendingDirectoryMoves.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+static QString parentPath(const QString &path)
+{
+    return path.left(qMax(0, path.lastIndexOf(QLatin1Char('/'))));
+}
+
+/* Fails the directory moves that wait for each other, see isDelayedByDirectoryMove(): none of
+ * them could ever start, like the moves of A to B/C and of B to A/D. Doing them would need
+ * a temporary name.
+ */
+static void failCyclicDirectoryMoves(const SyncFileItemVector &items)
+{
+    QHash<QString, SyncFileItem *> bySource;
+    QHash<QString, SyncFileItem *> byTarget;
+    foreach (const SyncFileItemPtr &item, items) {
+        if (item->_isDirectory && item->_instruction == CSYNC_INSTRUCTION_RENAME) {
+            bySource.insert(item->_file, item.data());
+            byTarget.insert(item->destination(), item.data());
+        }
+    }
+    if (bySource.size() < 2) {
+        return;
+    }
+
+    QHash<SyncFileItem *, QVector<SyncFileItem *> > dependencies;
+    foreach (SyncFileItem *move, bySource) {
+        QVector<SyncFileItem *> waitsFor;
+        // Its source is inside a directory that is moved too
+        for (QString dir = parentPath(move->_file); !dir.isEmpty(); dir = parentPath(dir)) {
+            if (SyncFileItem *other = byTarget.value(dir)) {
+                waitsFor.append(other);
+            }
+        }
+        // It goes where a directory is moved away from
+        for (QString dir = move->destination(); !dir.isEmpty(); dir = parentPath(dir)) {
+            SyncFileItem *other = bySource.value(dir);
+            if (other && other != move) {
+                waitsFor.append(other);
+            }
+        }
+        if (!waitsFor.isEmpty()) {
+            dependencies.insert(move, waitsFor);
+        }
+    }
+
+    QVector<SyncFileItem *> cyclic;
+    for (auto it = dependencies.constBegin(); it != dependencies.constEnd(); ++it) {
+        // Whether it waits for itself, through the others
+        QSet<SyncFileItem *> seen;
+        QVector<SyncFileItem *> toVisit = it.value();
+        while (!toVisit.isEmpty()) {
+            SyncFileItem *other = toVisit.takeLast();
+            if (other == it.key()) {
+                cyclic.append(other);
+                break;
+            }
+            if (!seen.contains(other)) {
+                seen.insert(other);
+                toVisit += dependencies.value(other);
+            }
+        }
+    }
+
+    foreach (SyncFileItem *move, cyclic) {
+        qWarning() << "Directory move waiting for itself through other moves:"
+                   << move->_file << "->" << move->destination();
+        move->_instruction = CSYNC_INSTRUCTION_ERROR;
+        move->_status = SyncFileItem::NormalError;
+        move->_errorString = OwncloudPropagator::tr("The folder can not be moved, the move of "
+            "another folder has to be done first and it waits for this one. Move one of them to "
+            "its final place first.");
+    }
+}
+
 PropagateItemJob* OwncloudPropagator::createJob(const SyncFileItemPtr &item) {
     bool deleteExisting = item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE;
     switch(item->_instruction) {
@@ -309,16 +504,31 @@ void OwncloudPropagator::start(const SyncFileItemVector& items)
      * In order to do that we loop over the items. (which are sorted by destination)
      * When we enter a directory, we can create the directory job and push it on the stack. */
 
-    _rootJob.reset(new PropagateDirectory(this));
+    failCyclicDirectoryMoves(items);
+
+    _rootJob.reset(new PropagateRootDirectory(this));
+    _pendingDirectoryMoves.clear();
+    _pendingDirectoryMoveSources.clear();
     QStack<QPair<QString /* directory name */, PropagateDirectory* /* job */> > directories;
     directories.push(qMakePair(QString(), _rootJob.data()));
-    QVector<PropagatorJob*> directoriesToRemove;
+    QVector<PropagatorJob*> directoriesToRemove; // run in the reverse order
     QString removedDirectory;
+    QString skippedUploadsDirectory;
     foreach(const SyncFileItemPtr &item, items) {
 
+        if (!skippedUploadsDirectory.isEmpty()) {
+            if (item->destination().startsWith(skippedUploadsDirectory)) {
+                // See below, the contents of a directory follows it
+                item->_instruction = CSYNC_INSTRUCTION_NONE;
+                _anotherSyncNeeded = true;
+            } else {
+                skippedUploadsDirectory.clear();
+            }
+        }
+
         if (!removedDirectory.isEmpty() && item->_file.startsWith(removedDirectory)) {
             // this is an item in a directory which is going to be removed.
-            PropagateDirectory *delDirJob = qobject_cast<PropagateDirectory*>(directoriesToRemove.first());
+            PropagateDirectory *delDirJob = qobject_cast<PropagateDirectory*>(directoriesToRemove.last());
 
             if (item->_instruction == CSYNC_INSTRUCTION_REMOVE) {
                 // already taken care of. (by the removal of the parent directory)
@@ -355,6 +565,11 @@ void OwncloudPropagator::start(const SyncFileItemVector& items)
         if (item->_isDirectory) {
             PropagateDirectory *dir = new PropagateDirectory(this, item);
 
+            if (item->_instruction == CSYNC_INSTRUCTION_RENAME) {
+                _pendingDirectoryMoves.insert(item->destination(), item->_file);
+                _pendingDirectoryMoveSources.insert(item->_file);
+            }
+
             if (item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE
                     && item->_direction == SyncFileItem::Up) {
                 // Skip all potential uploads to the new folder.
@@ -362,18 +577,14 @@ void OwncloudPropagator::start(const SyncFileItemVector& items)
                 // checkForPermissions() has already run and used the permissions
                 // of the file we're about to delete to decide whether uploading
                 // to the new dir is ok...
-                foreach(const SyncFileItemPtr &item2, items) {
-                    if (item2->destination().startsWith(item->destination() + "/")) {
-                        item2->_instruction = CSYNC_INSTRUCTION_NONE;
-                        _anotherSyncNeeded = true;
-                    }
-                }
+                // The items are sorted by destination, so these are the items that follow.
+                skippedUploadsDirectory = item->destination() + "/";
             }
 
             if (item->_instruction == CSYNC_INSTRUCTION_REMOVE) {
                 // We do the removal of directories at the end, because there might be moves from
                 // these directories that will happen later.
-                directoriesToRemove.prepend(dir);
+                directoriesToRemove.append(dir);
                 removedDirectory = item->_file + "/";
 
                 // We should not update the etag of parent directories of the removed directory
@@ -392,7 +603,7 @@ void OwncloudPropagator::start(const SyncFileItemVector& items)
         } else {
             if (item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE) {
                 // will delete directories, so defer execution
-                directoriesToRemove.prepend(createJob(item));
+                directoriesToRemove.append(createJob(item));
                 removedDirectory = item->_file + "/";
             } else {
                 directories.top().second->appendTask(item);
@@ -400,8 +611,8 @@ void OwncloudPropagator::start(const SyncFileItemVector& items)
         }
     }
 
-    foreach(PropagatorJob* it, directoriesToRemove) {
-        _rootJob->appendJob(it);
+    for (int i = directoriesToRemove.size() - 1; i >= 0; --i) {
+        _rootJob->_dirDeletionJobs.appendJob(directoriesToRemove.at(i));
     }
 
     connect(_rootJob.data(), SIGNAL(finished(SyncFileItem::Status)), this, SLOT(emitFinished(SyncFileItem::Status)));
@@ -526,27 +737,12 @@ void OwncloudPropagator::scheduleNextJobImpl()
     // Down-scaling on slow networks? https://github.com/owncloud/client/issues/3382
     // Making sure we do up/down at same time? https://github.com/owncloud/client/issues/1633
 
-    if (_activeJobList.count() < maximumActiveTransferJob()) {
+    // Each lane has its own limit too, a job waits until there is room in its lane.
+    // See hasRoomInLane().
+    if (_activeJobList.count() < hardMaximumActiveJob()) {
         if (_rootJob->scheduleSelfOrChild()) {
             scheduleNextJob();
         }
-    } else if (_activeJobList.count() < hardMaximumActiveJob()) {
-        int likelyFinishedQuicklyCount = 0;
-        // NOTE: Only counts the first 3 jobs! Then for each
-        // one that is likely finished quickly, we can launch another one.
-        // When a job finishes another one will "move up" to be one of the first 3 and then
-        // be counted too.
-        for (int i = 0; i < maximumActiveTransferJob() && i < _activeJobList.count(); i++) {
-            if (_activeJobList.at(i)->isLikelyFinishedQuickly()) {
-                likelyFinishedQuicklyCount++;
-            }
-        }
-        if (_activeJobList.count() < maximumActiveTransferJob() + likelyFinishedQuicklyCount) {
-            qDebug() <<  "Can pump in another request! activeJobs =" << _activeJobList.count();
-            if (_rootJob->scheduleSelfOrChild()) {
-                scheduleNextJob();
-            }
-        }
     }
 }
 
@@ -592,6 +788,21 @@ OwncloudPropagator *PropagatorJob::propagator() const
     return qobject_cast<OwncloudPropagator*>(parent());
 }
 
+bool PropagateItemJob::scheduleSelfOrChild()
+{
+    if (_state != NotYetStarted) {
+        return false;
+    }
+    // Stays in the running jobs of its parent until it can start, without holding up the others
+    if (propagator()->isDelayedByDirectoryMove(*_item) || !propagator()->hasRoomInLane(this)) {
+        return false;
+    }
+    _state = Running;
+    _runTime.start();
+    QMetaObject::invokeMethod(this, "start"); // We could be in a different thread (neon jobs)
+    return true;
+}
+
 // ================================================================================
 
 PropagatorJob::JobParallelism PropagatorCompositeJob::parallelism()
@@ -606,6 +817,18 @@ PropagatorJob::JobParallelism PropagatorCompositeJob::parallelism()
 }
 
 
+// Small first: the operations that transfer nothing, then the transfers from the smallest
+// one, so that most of the files are done early. The order is kept for the same size.
+static bool isScheduledBefore(const SyncFileItemPtr &item1, const SyncFileItemPtr &item2)
+{
+    const bool isTransfer1 = isTransfer(*item1);
+    const bool isTransfer2 = isTransfer(*item2);
+    if (isTransfer1 != isTransfer2) {
+        return isTransfer2;
+    }
+    return isTransfer1 && item1->_size < item2->_size;
+}
+
 bool PropagatorCompositeJob::scheduleSelfOrChild()
 {
     if (_state == Finished) {
@@ -615,15 +838,21 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     // Start the composite job
     if (_state == NotYetStarted) {
         _state = Running;
+        std::stable_sort(_tasksToDo.begin() + _nextTask, _tasksToDo.end(), isScheduledBefore);
     }
 
     // Ask all the running composite jobs if they have something new to schedule.
+    int waitingJobs = 0;
     for (int i = 0; i < _runningJobs.size(); ++i) {
-        ASSERT(_runningJobs.at(i)->_state == Running);
+        // Not started yet if it waits for room in its lane or for a directory move
+        ASSERT(_runningJobs.at(i)->_state != Finished);
 
         if (possiblyRunNextJob(_runningJobs.at(i))) {
             return true;
         }
+        if (_runningJobs.at(i)->_state == NotYetStarted) {
+            ++waitingJobs;
+        }
 
         // If any of the running sub jobs is not parallel, we have to cancel the scheduling
         // of the rest of the list and wait for the blocking job to finish and schedule the next one.
@@ -633,29 +862,27 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
         }
     }
 
-    // Now it's our turn, check if we have something left to do.
-    if (!_jobsToDo.isEmpty()) {
-        PropagatorJob *nextJob = _jobsToDo.first();
-        _jobsToDo.remove(0);
+    // Now it's our turn, check if we have something left to do. A new job that can only
+    // wait, for room in its lane or for a directory move, must not hold up the ones after
+    // it: the move it waits for may be one of them. Do not create more jobs than could run.
+    while (waitingJobs < propagator()->hardMaximumActiveJob()) {
+        PropagatorJob *nextJob = createNextJob();
+        if (!nextJob) {
+            break;
+        }
         _runningJobs.append(nextJob);
-        return possiblyRunNextJob(nextJob);
-    }
-    while (!_tasksToDo.isEmpty()) {
-        SyncFileItemPtr nextTask = _tasksToDo.first();
-        _tasksToDo.remove(0);
-        PropagatorJob *job = propagator()->createJob(nextTask);
-        if (!job) {
-            qWarning() << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
-            continue;
+        if (possiblyRunNextJob(nextJob)) {
+            return true;
         }
-
-        _runningJobs.append(job);
-        return possiblyRunNextJob(job);
+        if (nextJob->parallelism() == WaitForFinished) {
+            return false;
+        }
+        ++waitingJobs;
     }
 
     // If neither us or our children had stuff left to do we could hang. Make sure
     // we mark this job as finished so that the propagator can schedule a new one.
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (!hasJobsOrTasksToDo() && _runningJobs.isEmpty()) {
         // Our parent jobs are already iterating over their running jobs, post to the event loop
         // to avoid removing ourself from that list while they iterate.
         QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
@@ -663,6 +890,34 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     return false;
 }
 
+PropagatorJob *PropagatorCompositeJob::createNextJob()
+{
+    if (_nextJob < _jobsToDo.size()) {
+        PropagatorJob *nextJob = _jobsToDo.at(_nextJob++);
+        if (_nextJob == _jobsToDo.size()) {
+            _jobsToDo.clear();
+            _nextJob = 0;
+        }
+        return nextJob;
+    }
+    while (_nextTask < _tasksToDo.size()) {
+        // The job keeps the item alive, the vector lets go of it
+        SyncFileItemPtr nextTask;
+        nextTask.swap(_tasksToDo[_nextTask++]);
+        if (_nextTask == _tasksToDo.size()) {
+            _tasksToDo.clear();
+            _nextTask = 0;
+        }
+        PropagatorJob *job = propagator()->createJob(nextTask);
+        if (!job) {
+            qWarning() << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
+            continue;
+        }
+        return job;
+    }
+    return 0;
+}
+
 void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
 {
     PropagatorJob *subJob = static_cast<PropagatorJob *>(sender());
@@ -680,7 +935,7 @@ void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
         _hasError = status;
     }
 
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (!hasJobsOrTasksToDo() && _runningJobs.isEmpty()) {
         finalize();
     } else {
         propagator()->scheduleNextJob();
@@ -762,12 +1017,18 @@ void PropagateDirectory::slotFirstJobFinished(SyncFileItem::Status status)
     _firstJob.take()->deleteLater();
 
     if (status != SyncFileItem::Success && status != SyncFileItem::Restoration) {
+        // Nothing inside of this directory is going to move anymore
+        propagator()->directoryMoveDone(_item->destination(), true);
         abort();
         _state = Finished;
         emit finished(status);
         return;
     }
 
+    if (_item->_instruction == CSYNC_INSTRUCTION_RENAME) {
+        propagator()->directoryMoveDone(_item->destination(), false);
+    }
+
     propagator()->scheduleNextJob();
 }
 
@@ -811,6 +1072,50 @@ void PropagateDirectory::slotSubJobsFinished(SyncFileItem::Status status)
 
 // ================================================================================
 
+PropagateRootDirectory::PropagateRootDirectory(OwncloudPropagator *propagator)
+    : PropagateDirectory(propagator)
+    , _dirDeletionJobs(propagator)
+    , _directoryJobsStatus(SyncFileItem::NoStatus)
+{
+    disconnect(&_subJobs, SIGNAL(finished(SyncFileItem::Status)), this, 0);
+    connect(&_subJobs, SIGNAL(finished(SyncFileItem::Status)), this, SLOT(slotDirectoryJobsFinished(SyncFileItem::Status)));
+    connect(&_dirDeletionJobs, SIGNAL(finished(SyncFileItem::Status)), this, SLOT(slotDirDeletionJobsFinished(SyncFileItem::Status)));
+}
+
+bool PropagateRootDirectory::scheduleSelfOrChild()
+{
+    if (_state == Finished) {
+        return false;
+    }
+
+    if (PropagateDirectory::scheduleSelfOrChild()) {
+        return true;
+    }
+
+    // The removals wait until everything else is done
+    if (_subJobs._state != Finished) {
+        return false;
+    }
+    return _dirDeletionJobs.scheduleSelfOrChild();
+}
+
+void PropagateRootDirectory::slotDirectoryJobsFinished(SyncFileItem::Status status)
+{
+    _directoryJobsStatus = status;
+    propagator()->scheduleNextJob();
+}
+
+void PropagateRootDirectory::slotDirDeletionJobsFinished(SyncFileItem::Status status)
+{
+    if (_directoryJobsStatus != SyncFileItem::Success) {
+        status = _directoryJobsStatus;
+    }
+    _state = Finished;
+    emit finished(status);
+}
+
+// ================================================================================
+
 CleanupPollsJob::~CleanupPollsJob()
 {}
 
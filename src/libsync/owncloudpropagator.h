@@ -18,6 +18,7 @@
 #include <QHash>
 #include <QObject>
 #include <QMap>
+#include <QSet>
 #include <QLinkedList>
 #include <QElapsedTimer>
 #include <QTimer>
@@ -28,6 +29,7 @@
 #include "syncfileitem.h"
 #include "syncjournaldb.h"
 #include "bandwidthmanager.h"
+#include "concurrencycontroller.h"
 #include "accountfwd.h"
 
 namespace OCC {
@@ -137,19 +139,13 @@ protected slots:
 
 private:
     QScopedPointer<PropagateItemJob> _restoreJob;
+    QElapsedTimer _runTime; // since the job was started
 
 public:
     PropagateItemJob(OwncloudPropagator* propagator, const SyncFileItemPtr &item)
         : PropagatorJob(propagator), _item(item) {}
 
-    bool scheduleSelfOrChild() Q_DECL_OVERRIDE {
-        if (_state != NotYetStarted) {
-            return false;
-        }
-        _state = Running;
-        QMetaObject::invokeMethod(this, "start"); // We could be in a different thread (neon jobs)
-        return true;
-    }
+    bool scheduleSelfOrChild() Q_DECL_OVERRIDE;
 
     SyncFileItemPtr  _item;
 
@@ -166,16 +162,22 @@ class PropagatorCompositeJob : public PropagatorJob {
 public:
     QVector<PropagatorJob *> _jobsToDo;
     SyncFileItemVector _tasksToDo;
+    // The jobs and tasks before these were already started. They are not removed from the
+    // front of the vectors, which would move all the others each time.
+    int _nextJob;
+    int _nextTask;
     QVector<PropagatorJob *> _runningJobs;
     SyncFileItem::Status _hasError;  // NoStatus,  or NormalError / SoftError if there was an error
 
     explicit PropagatorCompositeJob(OwncloudPropagator *propagator)
         : PropagatorJob(propagator)
+        , _nextJob(0)
+        , _nextTask(0)
         , _hasError(SyncFileItem::NoStatus)
     { }
 
     virtual ~PropagatorCompositeJob() {
-        qDeleteAll(_jobsToDo);
+        qDeleteAll(_jobsToDo.begin() + _nextJob, _jobsToDo.end());
         qDeleteAll(_runningJobs);
     }
 
@@ -186,6 +188,10 @@ public:
         _tasksToDo.append(item);
     }
 
+    bool hasJobsOrTasksToDo() const {
+        return _nextJob < _jobsToDo.size() || _nextTask < _tasksToDo.size();
+    }
+
     virtual bool scheduleSelfOrChild() Q_DECL_OVERRIDE;
     virtual JobParallelism parallelism() Q_DECL_OVERRIDE;
     virtual void abort() Q_DECL_OVERRIDE {
@@ -195,10 +201,15 @@ public:
 
     qint64 committedDiskSpace() const Q_DECL_OVERRIDE;
 
+private:
+    /** Takes the next job to do, or creates the one of the next task. 0 if there is none */
+    PropagatorJob *createNextJob();
+
 private slots:
     bool possiblyRunNextJob(PropagatorJob *next) {
         if (next->_state == NotYetStarted) {
-            connect(next, SIGNAL(finished(SyncFileItem::Status)), this, SLOT(slotSubJobFinished(SyncFileItem::Status)));
+            // Unique: a job that waits for a directory move is asked again
+            connect(next, SIGNAL(finished(SyncFileItem::Status)), this, SLOT(slotSubJobFinished(SyncFileItem::Status)), Qt::UniqueConnection);
         }
         return next->scheduleSelfOrChild();
     }
@@ -253,6 +264,36 @@ private slots:
     void slotSubJobsFinished(SyncFileItem::Status status);
 };
 
+/**
+ * @brief The root of the propagation: the directory removals only start once all the
+ * other jobs are done, as some of them may move things out of the removed directories.
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT PropagateRootDirectory : public PropagateDirectory {
+    Q_OBJECT
+public:
+    PropagatorCompositeJob _dirDeletionJobs;
+
+    explicit PropagateRootDirectory(OwncloudPropagator *propagator);
+
+    virtual bool scheduleSelfOrChild() Q_DECL_OVERRIDE;
+    virtual void abort() Q_DECL_OVERRIDE {
+        PropagateDirectory::abort();
+        _dirDeletionJobs.abort();
+    }
+
+    qint64 committedDiskSpace() const Q_DECL_OVERRIDE {
+        return PropagateDirectory::committedDiskSpace() + _dirDeletionJobs.committedDiskSpace();
+    }
+
+private slots:
+    void slotDirectoryJobsFinished(SyncFileItem::Status status);
+    void slotDirDeletionJobsFinished(SyncFileItem::Status status);
+
+private:
+    SyncFileItem::Status _directoryJobsStatus;
+};
+
 
 /**
  * @brief Dummy job that just mark it as completed and ignored
@@ -272,7 +313,7 @@ public:
 class OwncloudPropagator : public QObject {
     Q_OBJECT
 
-    QScopedPointer<PropagateDirectory> _rootJob;
+    QScopedPointer<PropagateRootDirectory> _rootJob;
 
 public:
     const QString _localDir; // absolute path to the local directory. ends with '/'
@@ -284,15 +325,18 @@ public:
 
 public:
     OwncloudPropagator(AccountPtr account, const QString &localDir,
-                       const QString &remoteFolder, SyncJournalDb *progressDb)
+                       const QString &remoteFolder, SyncJournalDb *progressDb,
+                       ConcurrencyController *concurrency)
             : _localDir((localDir.endsWith(QChar('/'))) ? localDir : localDir+'/' )
             , _remoteFolder((remoteFolder.endsWith(QChar('/'))) ? remoteFolder : remoteFolder+'/' )
             , _journal(progressDb)
             , _finishedEmited(false)
             , _bandwidthManager(this)
             , _anotherSyncNeeded(false)
+            , _concurrency(concurrency)
             , _account(account)
-    { }
+    {
+    }
 
     ~OwncloudPropagator();
 
@@ -315,11 +359,42 @@ public:
     /** We detected that another sync is required after this one */
     bool _anotherSyncNeeded;
 
+    /** Tunes hardMaximumActiveJob(), unless OWNCLOUD_MAX_PARALLEL is set. Owned by the
+     * SyncEngine, so that it learns from all the syncs and not only from this one */
+    ConcurrencyController * const _concurrency;
+
+    /** The job of the item took \a durationMsec, tell _concurrency if it used the network */
+    void reportJobDuration(const SyncFileItem &item, qint64 durationMsec);
+
+    /** The directory moves that are not done yet, from the target to the source path.
+     * The jobs that depend on one of them wait, see isDelayedByDirectoryMove() */
+    QHash<QString, QString> _pendingDirectoryMoves;
+    QSet<QString> _pendingDirectoryMoveSources;
+
+    /** Whether the job of the item has to wait for a directory move: the item is moved out
+     * of a directory that is moved too, or it is put where a directory is moved away from */
+    bool isDelayedByDirectoryMove(const SyncFileItem &item) const;
+    /** The move of the directory to \a target is done, or will not happen. If \a andInside,
+     * the same goes for the moves into that directory. The caller schedules the next job. */
+    void directoryMoveDone(const QString &target, bool andInside);
+
     /* the maximum number of jobs using bandwidth (uploads or downloads, in parallel) */
     int maximumActiveTransferJob();
     /* The maximum number of active jobs in parallel  */
     int hardMaximumActiveJob();
 
+    /** The jobs are scheduled in lanes, each with its own limit of active jobs, so that
+     * large transfers do not hold up the small ones and the metadata operations */
+    enum JobLane {
+        QuickLane, // directory creations, moves and deletions
+        SmallTransferLane, // transfers that are likely finished quickly
+        LargeTransferLane
+    };
+    static JobLane laneOf(PropagateItemJob *job);
+    int maximumActiveJobs(JobLane lane);
+    /** Whether one more job of the lane of this one may be active */
+    bool hasRoomInLane(PropagateItemJob *job);
+
     bool isInSharedDirectory(const QString& file);
     bool localFileNameClash(const QString& relfile);
     QString getFilePath(const QString& tmp_file_name) const;
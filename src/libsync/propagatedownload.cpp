@@ -218,10 +218,23 @@ void GETFileJob::setBandwidthLimited(bool b)
 void GETFileJob::giveBandwidthQuota(qint64 q)
 {
     _bandwidthQuota = q;
-    qDebug() << Q_FUNC_INFO << "Got" << q << "bytes";
+//    qDebug() << Q_FUNC_INFO << "Got" << q << "bytes";
     QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
 }
 
+qint64 GETFileJob::bandwidthNeeded()
+{
+    if (!reply()) {
+        return -1;
+    }
+    bool ok = false;
+    qint64 length = reply()->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+    if (!ok) {
+        return -1;
+    }
+    return qMax(qint64(0), length - (currentDownloadPosition() - qint64(_resumeStart)));
+}
+
 qint64 GETFileJob::currentDownloadPosition()
 {
     if (_device && _device->pos() > 0 && _device->pos() > qint64(_resumeStart)) {
@@ -743,6 +756,11 @@ void PropagateDownloadFile::downloadFinished()
     // We need to fetch the time again because some file systems such as FAT have worse than a second
     // Accuracy, and we really need the time from the file system. (#3103)
     _item->_modtime = FileSystem::getModTime(_tmpFile.fileName());
+    // What the discovery saw of the replaced file does not apply anymore. The journal
+    // record takes the status change time of the new file from the file system.
+    _item->_modtimeNsec = 0;
+    _item->_ctime = 0;
+    _item->_ctimeNsec = 0;
 
     if (FileSystem::fileExists(fn)) {
         // Preserve the existing file permissions.
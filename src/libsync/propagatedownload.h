@@ -79,6 +79,8 @@ public:
     void setChoked(bool c);
     void setBandwidthLimited(bool b);
     void giveBandwidthQuota(qint64 q);
+    /** The bytes left to be read, or -1 if not known yet */
+    qint64 bandwidthNeeded();
     qint64 currentDownloadPosition();
 
     QString errorString() const;
@@ -223,7 +223,12 @@ void PropagateUploadFileCommon::slotComputeContentChecksum()
 
     // remember the modtime before checksumming to be able to detect a file
     // change during the checksum calculation
+    const time_t discoveredModtime = _item->_modtime;
     _item->_modtime = FileSystem::getModTime(filePath);
+    if (_item->_modtime != discoveredModtime) {
+        // The sub-second part seen by the discovery belongs to another version of the file
+        _item->_modtimeNsec = 0;
+    }
 
 #ifdef WITH_TESTING
     _stopWatch.start();
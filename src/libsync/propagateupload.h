@@ -54,6 +54,8 @@ public:
     void setChoked(bool);
     bool isChoked() { return _choked; }
     void giveBandwidthQuota(qint64 bwq);
+    /** The bytes left to be read */
+    qint64 bandwidthNeeded() const { return _data.size() - _read; }
 
 signals:
 #if QT_VERSION < 0x050402
@@ -224,6 +224,9 @@ void PropagateLocalRename::start()
             done(SyncFileItem::NormalError, renameError);
             return;
         }
+        // The rename changed the status change time, let the record read the new one
+        _item->_ctime = 0;
+        _item->_ctimeNsec = 0;
     }
 
     SyncJournalFileRecord oldRecord =
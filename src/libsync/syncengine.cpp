@@ -58,6 +58,10 @@ bool SyncEngine::s_anySyncRunning = false;
 
 qint64 SyncEngine::minimumFileAgeForUpload = 2000;
 
+// A rough estimate of the memory a sync needs per file of the tree, for the
+// discovery, the reconcile and the sync item together
+static const qint64 bytesPerSyncedFile = 2000;
+
 SyncEngine::SyncEngine(AccountPtr account, const QString& localPath,
                        const QString& remotePath, OCC::SyncJournalDb* journal)
   : _account(account)
@@ -69,10 +73,13 @@ SyncEngine::SyncEngine(AccountPtr account, const QString& localPath,
   , _progressInfo(new ProgressInfo)
   , _hasNoneFiles(false)
   , _hasRemoveFile(false)
+  , _askedAboutRemovingAllFiles(false)
   , _hasForwardInTimeFiles(false)
   , _backInTimeFiles(0)
   , _uploadLimit(0)
   , _downloadLimit(0)
+  , _localDiscoveryStyle(FilesystemOnly)
+  , _lastLocalDiscoveryStyle(FilesystemOnly)
   , _checksum_hook(journal)
   , _anotherSyncNeeded(NoFollowUpSync)
 {
@@ -344,7 +351,7 @@ int SyncEngine::treewalkRemote( TREE_WALK_FILE* file, void *data )
  * Called on each entry in the local and remote trees by
  * csync_walk_local_tree()/csync_walk_remote_tree().
  *
- * It merges the two csync rbtrees into a single map of SyncFileItems.
+ * It merges the two csync trees into a single map of SyncFileItems.
  *
  * See doc/dev/sync-algorithm.md for an overview.
  */
@@ -376,8 +383,14 @@ int SyncEngine::treewalkFile( TREE_WALK_FILE *file, bool remote )
 
     // Gets a default-constructed SyncFileItemPtr or the one from the first walk (=local walk)
     SyncFileItemPtr item = _syncItemMap.value(key);
-    if (!item)
+    if (!item) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 1, 0)
+        // The item and its reference count in one allocation
+        item = SyncFileItemPtr::create();
+#else
         item = SyncFileItemPtr(new SyncFileItem);
+#endif
+    }
 
     if (item->_file.isEmpty() || instruction == CSYNC_INSTRUCTION_RENAME) {
         item->_file = fileUtf8;
@@ -408,7 +421,7 @@ int SyncEngine::treewalkFile( TREE_WALK_FILE *file, bool remote )
         item->_directDownloadCookies = QString::fromUtf8( file->directDownloadCookies );
     }
     if (file->remotePerm && file->remotePerm[0]) {
-        item->_remotePerm = QByteArray(file->remotePerm);
+        item->_remotePerm = internRemotePerm(file->remotePerm);
         if (remote)
             _remotePerms[item->_file] = item->_remotePerm;
     }
@@ -434,6 +447,13 @@ int SyncEngine::treewalkFile( TREE_WALK_FILE *file, bool remote )
         item->_contentChecksumType = _journal->getChecksumType(file->checksumTypeId);
     }
 
+    // Only the local file system has sub-second modification times and status change times
+    if (!remote) {
+        item->_modtimeNsec = file->modtime_nsec;
+        item->_ctime = file->ctime;
+        item->_ctimeNsec = file->ctime_nsec;
+    }
+
     // record the seen files to be able to clean the journal later
     _seenFiles.insert(item->_file);
     if (!renameTarget.isEmpty()) {
@@ -590,7 +610,8 @@ int SyncEngine::treewalkFile( TREE_WALK_FILE *file, bool remote )
             } else {
                 // The local tree is walked first and doesn't have all the info from the server.
                 // Update only outdated data from the disk.
-                _journal->updateLocalMetadata(item->_file, item->_modtime, item->_size, item->_inode);
+                _journal->updateLocalMetadata(item->_file, item->_modtime, item->_size, item->_inode,
+                    item->_modtimeNsec, item->_ctime, item->_ctimeNsec);
             }
 
             // Technically we're done with this item.
@@ -653,8 +674,9 @@ int SyncEngine::treewalkFile( TREE_WALK_FILE *file, bool remote )
 
     _needsUpdate = true;
 
-    item->log._other_etag        = file->other.etag;
-    item->log._other_fileId      = file->other.file_id;
+    // Usually the same on both sides, then share the data
+    item->log._other_etag        = item->_etag == file->other.etag ? item->_etag : QByteArray(file->other.etag);
+    item->log._other_fileId      = item->_fileId == file->other.file_id ? item->_fileId : QByteArray(file->other.file_id);
     item->log._other_instruction = file->other.instruction;
     item->log._other_modtime     = file->other.modtime;
     item->log._other_size        = file->other.size;
@@ -751,11 +773,6 @@ void SyncEngine::startSync()
         qDebug() << "Could not determine free space available at" << _localPath;
     }
 
-    _syncItemMap.clear();
-    _needsUpdate = false;
-
-    csync_resume(_csync_ctx);
-
     int fileRecordCount = -1;
     if (!_journal->exists()) {
         qDebug() << "===== new sync (no sync journal exists)";
@@ -782,12 +799,65 @@ void SyncEngine::startSync()
         // database creation error!
     }
 
+    // Nothing would be transferred before the whole tree is discovered, which takes long
+    // for the first sync of a big folder. Instead the files at the root are synced first,
+    // and then each top-level directory in a round of its own, see startNextRound().
+    // The same keeps the memory of the sync of a tree that is too big for the budget
+    // bounded: only a few top-level directories are in memory at once.
+    _syncScope = SyncScope();
+    _pendingRounds.clear();
+    _itemsOfRounds.clear();
+    if (fileRecordCount == 0 && _syncOptions._streamInitialSync) {
+        qDebug() << "===== initial sync, one top-level directory after the other";
+        _syncScope._limited = true;
+    } else if (_syncOptions._memoryBudget > 0
+            && fileRecordCount * bytesPerSyncedFile > _syncOptions._memoryBudget) {
+        qDebug() << "=====" << fileRecordCount << "files are over the memory budget of"
+                 << _syncOptions._memoryBudget << "bytes, syncing in rounds";
+        _syncScope._limited = true;
+    }
+
+    _discoveryMainThread = new DiscoveryMainThread(account(), _journal);
+    _discoveryMainThread->setParent(this);
+    connect(this, SIGNAL(finished(bool)), _discoveryMainThread, SLOT(deleteLater()));
+    qDebug() << "=====Server" << account()->serverVersion()
+             <<  QString("rootEtagChangesNotOnlySubFolderEtags=%1").arg(account()->rootEtagChangesNotOnlySubFolderEtags());
+    if (account()->rootEtagChangesNotOnlySubFolderEtags()) {
+        connect(_discoveryMainThread, SIGNAL(etag(QString)), this, SLOT(slotRootEtagReceived(QString)));
+    } else {
+        connect(_discoveryMainThread, SIGNAL(etagConcatenation(QString)), this, SLOT(slotRootEtagReceived(QString)));
+    }
+
+    _stopWatch.start();
+    startDiscovery(fileRecordCount);
+}
+
+void SyncEngine::startDiscovery(int fileRecordCount)
+{
+    _syncItemMap.clear();
+    _needsUpdate = false;
+
+    csync_resume(_csync_ctx);
+
     _csync_ctx->read_remote_from_db = true;
 
     // This tells csync to never read from the DB if it is empty
     // thereby speeding up the initial discovery significantly.
     _csync_ctx->db_is_empty = (fileRecordCount == 0);
 
+    // Journals up to this size are loaded in memory for the update detection instead
+    // of being queried once per file. An entry takes a few hundred bytes.
+    static qint64 statedbIndexMaxEntries = [] {
+        bool ok = false;
+        qint64 value = qgetenv("OWNCLOUD_STATEDB_INDEX_MAX_ENTRIES").toLongLong(&ok);
+        return ok ? value : 100000;
+    }();
+    _csync_ctx->statedb.index_max_entries = statedbIndexMaxEntries;
+
+    _csync_ctx->local.prefetch_threads = _syncOptions._localDiscoveryThreads;
+    _csync_ctx->local.checksum_threads = _syncOptions._discoveryChecksumThreads;
+    _csync_ctx->reconcile_threads = _syncOptions._reconcileThreads;
+
     bool ok;
     auto selectiveSyncBlackList = _journal->getSelectiveSyncList(SyncJournalDb::SelectiveSyncBlackList, &ok);
     if (ok) {
@@ -805,8 +875,6 @@ void SyncEngine::startSync()
     _csync_ctx->callbacks.checksum_hook = &CSyncChecksumHook::hook;
     _csync_ctx->callbacks.checksum_userdata = &_checksum_hook;
 
-    _stopWatch.start();
-
     qDebug() << "#### Discovery start #################################################### >>";
 
     // Usually the discovery runs in the background: We want to avoid
@@ -814,17 +882,6 @@ void SyncEngine::startSync()
     // be interacting with at the time.
     _thread.start(QThread::LowPriority);
 
-    _discoveryMainThread = new DiscoveryMainThread(account());
-    _discoveryMainThread->setParent(this);
-    connect(this, SIGNAL(finished(bool)), _discoveryMainThread, SLOT(deleteLater()));
-    qDebug() << "=====Server" << account()->serverVersion()
-             <<  QString("rootEtagChangesNotOnlySubFolderEtags=%1").arg(account()->rootEtagChangesNotOnlySubFolderEtags());
-    if (account()->rootEtagChangesNotOnlySubFolderEtags()) {
-        connect(_discoveryMainThread, SIGNAL(etag(QString)), this, SLOT(slotRootEtagReceived(QString)));
-    } else {
-        connect(_discoveryMainThread, SIGNAL(etagConcatenation(QString)), this, SLOT(slotRootEtagReceived(QString)));
-    }
-
     DiscoveryJob *discoveryJob = new DiscoveryJob(_csync_ctx);
     discoveryJob->_selectiveSyncBlackList = selectiveSyncBlackList;
     discoveryJob->_selectiveSyncWhiteList =
@@ -838,6 +895,15 @@ void SyncEngine::startSync()
     }
 
     discoveryJob->_syncOptions = _syncOptions;
+    if (!_syncOptions._localDiscoveryFromJournal) {
+        _localDiscoveryStyle = FilesystemOnly;
+    }
+    discoveryJob->_localDiscoveryStyle = _localDiscoveryStyle;
+    discoveryJob->_localDiscoveryPaths = _localDiscoveryPaths;
+    discoveryJob->_syncScope = _syncScope;
+    _lastLocalDiscoveryStyle = _localDiscoveryStyle;
+    _localDiscoveryStyle = FilesystemOnly;
+    _localDiscoveryPaths.clear();
     discoveryJob->moveToThread(&_thread);
     connect(discoveryJob, SIGNAL(finished(int)), this, SLOT(slotDiscoveryJobFinished(int)));
     connect(discoveryJob, SIGNAL(folderDiscovered(bool,QString)),
@@ -855,6 +921,12 @@ void SyncEngine::startSync()
     QMetaObject::invokeMethod(discoveryJob, "start", Qt::QueuedConnection);
 }
 
+void SyncEngine::setLocalDiscoveryOptions(LocalDiscoveryStyle style, const QStringList &paths)
+{
+    _localDiscoveryStyle = style;
+    _localDiscoveryPaths = paths;
+}
+
 void SyncEngine::slotRootEtagReceived(const QString &e) {
     if (_remoteRootEtag.isEmpty()) {
         qDebug() << Q_FUNC_INFO << e;
@@ -874,6 +946,18 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     }
     qDebug() << "<<#### Discovery end #################################################### " << _stopWatch.addLapTime(QLatin1String("Discovery Finished"));
 
+    // Whether all the files are removed is a question about the whole tree, so the
+    // rounds of a sync keep what the earlier ones saw, see planSubtreeRounds()
+    if (!_syncScope._limited || _syncScope._subtrees.isEmpty()) {
+        _hasNoneFiles = false;
+        _askedAboutRemovingAllFiles = false;
+    }
+    _hasRemoveFile = false;
+
+    if (_syncScope._limited && _syncScope._subtrees.isEmpty()) {
+        planSubtreeRounds();
+    }
+
     // Sanity check
     if (!_journal->isConnected()) {
         qDebug() << "Bailing out, DB failure";
@@ -892,16 +976,16 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
 
     qDebug() << "<<#### Reconcile end #################################################### " << _stopWatch.addLapTime(QLatin1String("Reconcile Finished"));
 
-    _hasNoneFiles = false;
-    _hasRemoveFile = false;
     _hasForwardInTimeFiles = false;
     _backInTimeFiles = 0;
     bool walkOk = true;
     _remotePerms.clear();
-    _remotePerms.reserve(c_rbtree_size(_csync_ctx->remote.tree));
+    _remotePerms.reserve(c_htable_size(_csync_ctx->remote.tree));
     _seenFiles.clear();
     _temporarilyUnavailablePaths.clear();
     _renamedFolders.clear();
+    // Every path is in one tree or both
+    _syncItemMap.reserve(int(qMax(c_htable_size(_csync_ctx->local.tree), c_htable_size(_csync_ctx->remote.tree))));
 
     if( csync_walk_local_tree(_csync_ctx, &treewalkLocal, 0) < 0 ) {
         qDebug() << "Error in local treewalk.";
@@ -920,15 +1004,24 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     csync_commit(_csync_ctx);
 
     // The map was used for merging trees, convert it to a list:
-    SyncFileItemVector syncItems = _syncItemMap.values().toVector();
+    SyncFileItemVector syncItems;
+    syncItems.reserve(_syncItemMap.size());
+    for (auto it = _syncItemMap.constBegin(); it != _syncItemMap.constEnd(); ++it) {
+        syncItems.append(*it);
+    }
     _syncItemMap.clear(); // free memory
 
     // Adjust the paths for the renames.
-    for (SyncFileItemVector::iterator it = syncItems.begin();
-            it != syncItems.end(); ++it) {
-        (*it)->_file = adjustRenamedPath((*it)->_file);
+    if (!_renamedFolders.isEmpty()) {
+        for (SyncFileItemVector::iterator it = syncItems.begin();
+                it != syncItems.end(); ++it) {
+            (*it)->_file = adjustRenamedPath((*it)->_file);
+        }
     }
 
+    // Sort items per destination
+    std::sort(syncItems.begin(), syncItems.end());
+
     // Check for invalid character in old server version
     if (_account->serverVersionInt() < 0x080100) {
         // Server version older than 8.1 don't support these character in filename.
@@ -942,8 +1035,9 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
         }
     }
 
-    if (!_hasNoneFiles && _hasRemoveFile) {
+    if (!_hasNoneFiles && _hasRemoveFile && !_askedAboutRemovingAllFiles) {
         qDebug() << Q_FUNC_INFO << "All the files are going to be changed, asking the user";
+        _askedAboutRemovingAllFiles = true;
         bool cancel = false;
         emit aboutToRemoveAllFiles(syncItems.first()->_direction, &cancel);
         if (cancel) {
@@ -974,9 +1068,6 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
         }
     }
 
-    // Sort items per destination
-    std::sort(syncItems.begin(), syncItems.end());
-
     // make sure everything is allowed
     checkForPermission(syncItems);
 
@@ -1002,7 +1093,7 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     _journal->commit("post treewalk");
 
     _propagator = QSharedPointer<OwncloudPropagator>(
-        new OwncloudPropagator (_account, _localPath, _remotePath, _journal));
+        new OwncloudPropagator (_account, _localPath, _remotePath, _journal, &_concurrency));
     connect(_propagator.data(), SIGNAL(itemCompleted(const SyncFileItemPtr &)),
             this, SLOT(slotItemCompleted(const SyncFileItemPtr &)));
     connect(_propagator.data(), SIGNAL(progress(const SyncFileItem &,quint64)),
@@ -1014,10 +1105,24 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     // apply the network limits to the propagator
     setNetworkLimits(_uploadLimit, _downloadLimit);
 
-    deleteStaleDownloadInfos(syncItems);
-    deleteStaleUploadInfos(syncItems);
-    deleteStaleErrorBlacklistEntries(syncItems);
-    _journal->commit("post stale entry removal");
+    // The entries of the rounds still to come are not stale: they are only cleaned up
+    // in the last round, against the items of all the rounds
+    if (_syncScope._limited) {
+        foreach (const SyncFileItemPtr &item, syncItems) {
+            if ((item->_type == SyncFileItem::File && item->_direction != SyncFileItem::None)
+                    || item->_hasBlacklistEntry) {
+                _itemsOfRounds.append(item);
+            }
+        }
+    }
+    if (_pendingRounds.isEmpty()) {
+        const SyncFileItemVector &items = _syncScope._limited ? _itemsOfRounds : syncItems;
+        deleteStaleDownloadInfos(items);
+        deleteStaleUploadInfos(items);
+        deleteStaleErrorBlacklistEntries(items);
+        _journal->commit("post stale entry removal");
+        _itemsOfRounds.clear();
+    }
 
     // Emit the started signal only after the propagator has been set up.
     if (_needsUpdate)
@@ -1081,17 +1186,28 @@ void SyncEngine::slotFinished(bool success)
         _anotherSyncNeeded = ImmediateFollowUp;
     }
 
-    if (success) {
+    // The rounds still to come compare with the fingerprint from before the sync
+    if (success && _pendingRounds.isEmpty()) {
         _journal->setDataFingerprint(_discoveryMainThread->_dataFingerprint);
     }
 
     // emit the treewalk results.
-    if( ! _journal->postSyncCleanup( _seenFiles, _temporarilyUnavailablePaths ) ) {
+    // A round only saw its part of the tree, the records of the others are not stale.
+    if (_syncScope._limited) {
+        if (!_journal->postSyncCleanup(_seenFiles, _temporarilyUnavailablePaths, _syncScope._subtrees)) {
+            qDebug() << "Cleaning of synced ";
+        }
+    } else if( ! _journal->postSyncCleanup( _seenFiles, _temporarilyUnavailablePaths ) ) {
         qDebug() << "Cleaning of synced ";
     }
 
     _journal->commit("All Finished.", false);
 
+    if (success && !_pendingRounds.isEmpty()) {
+        startNextRound();
+        return;
+    }
+
     // Send final progress information even if no
     // files needed propagation, but clear the lastCompletedItem
     // so we don't count this twice (like Recent Files)
@@ -1101,6 +1217,90 @@ void SyncEngine::slotFinished(bool success)
     finalize(success);
 }
 
+void SyncEngine::planSubtreeRounds()
+{
+    // The directories at the root on either side, in the order the listings of the
+    // server are prefetched, and the ones of the journal that are gone on both sides
+    QStringList subtrees = _discoveryMainThread->_rootDirectories;
+    QSet<QString> known = subtrees.toSet();
+    const QStringList localDirectories = QDir(_localPath).entryList(
+        QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System | QDir::NoSymLinks);
+    foreach (const QString &dir, localDirectories) {
+        if (!known.contains(dir)) {
+            subtrees.append(dir);
+            known.insert(dir);
+        }
+    }
+    const QHash<QString, int> fileCounts = _journal->getTopLevelRecordCounts();
+    for (auto it = fileCounts.constBegin(); it != fileCounts.constEnd(); ++it) {
+        if (!known.contains(it.key())) {
+            subtrees.append(it.key());
+        }
+    }
+
+    // A round only sees a part of the tree. A top-level directory that has files in the journal
+    // and is still on both sides is not removed, so not all the files are, whatever the rounds
+    // that come before it find.
+    const QSet<QString> serverDirectories = _discoveryMainThread->_rootDirectories.toSet();
+    const QSet<QString> localDirectorySet = localDirectories.toSet();
+    for (auto it = fileCounts.constBegin(); it != fileCounts.constEnd() && !_hasNoneFiles; ++it) {
+        // The count includes the record of the directory itself
+        if (it.value() > 1 && serverDirectories.contains(it.key()) && localDirectorySet.contains(it.key())) {
+            _hasNoneFiles = true;
+        }
+    }
+
+    // Every round lists the root again, so several directories share a round when there are many
+    static const int maxRounds = 32;
+    const int perRound = (subtrees.size() + maxRounds - 1) / maxRounds;
+
+    // With a memory budget, a round also takes no more directories than the files of the
+    // journal allow. A directory that is too big on its own still gets a round.
+    const qint64 maxFilesPerRound = _syncOptions._memoryBudget / bytesPerSyncedFile;
+
+    _pendingRounds.clear();
+    QStringList round;
+    qint64 roundFiles = 0;
+    foreach (const QString &subtree, subtrees) {
+        const int files = fileCounts.value(subtree);
+        if (!round.isEmpty()
+                && (round.size() >= perRound
+                       || (maxFilesPerRound > 0 && roundFiles + files > maxFilesPerRound))) {
+            _pendingRounds.append(round);
+            round.clear();
+            roundFiles = 0;
+        }
+        round.append(subtree);
+        roundFiles += files;
+    }
+    if (!round.isEmpty()) {
+        _pendingRounds.append(round);
+    }
+    qDebug() << "The sync continues with" << subtrees.size() << "directories in"
+             << _pendingRounds.size() << "rounds";
+}
+
+void SyncEngine::startNextRound()
+{
+    // The root listing only gives its permissions the first time
+    const QByteArray rootPerms = _remotePerms.value(QString());
+
+    _propagator.clear();
+    _remotePerms.clear();
+    _remotePermValues.clear();
+    _seenFiles.clear();
+    _temporarilyUnavailablePaths.clear();
+    _renamedFolders.clear();
+
+    if (!rootPerms.isEmpty() && !_csync_ctx->remote.root_perms) {
+        _csync_ctx->remote.root_perms = strdup(rootPerms.constData());
+    }
+
+    _syncScope._subtrees = _pendingRounds.takeFirst();
+    qDebug() << "===== next round of the sync," << _pendingRounds.size() << "more to go";
+    startDiscovery(_journal->getFileRecordCount());
+}
+
 void SyncEngine::finalize(bool success)
 {
     _thread.quit();
@@ -1119,9 +1319,13 @@ void SyncEngine::finalize(bool success)
     // Delete the propagator only after emitting the signal.
     _propagator.clear();
     _remotePerms.clear();
+    _remotePermValues.clear();
     _seenFiles.clear();
     _temporarilyUnavailablePaths.clear();
     _renamedFolders.clear();
+    _syncScope = SyncScope();
+    _pendingRounds.clear();
+    _itemsOfRounds.clear();
 
     _clearTouchedFilesTimer.start();
 }
@@ -1398,6 +1602,18 @@ QByteArray SyncEngine::getPermissions(const QString& file) const
     return _remotePerms.value(file);
 }
 
+QByteArray SyncEngine::internRemotePerm(const char *perm)
+{
+    const QByteArray raw = QByteArray::fromRawData(perm, qstrlen(perm));
+    auto it = _remotePermValues.constFind(raw);
+    if (it != _remotePermValues.constEnd()) {
+        return *it;
+    }
+    QByteArray value(perm);
+    _remotePermValues.insert(value);
+    return value;
+}
+
 void SyncEngine::restoreOldFiles(SyncFileItemVector &syncItems)
 {
     /* When the server is trying to send us lots of file in the past, this means that a backup
@@ -23,6 +23,7 @@
 #include <QString>
 #include <QSet>
 #include <QMap>
+#include <QHash>
 #include <QStringList>
 #include <QSharedPointer>
 
@@ -39,6 +40,7 @@
 #include "accountfwd.h"
 #include "discoveryphase.h"
 #include "checksums.h"
+#include "concurrencycontroller.h"
 
 class QProcess;
 
@@ -78,6 +80,23 @@ public:
     bool isSyncRunning() const { return _syncRunning; }
 
     void setSyncOptions(const SyncOptions &options) { _syncOptions = options; }
+
+    /**
+     * Control how the next sync discovers the local tree.
+     *
+     * With DatabaseAndFilesystem only the directories containing one of the \a paths
+     * (relative to the local path) are read from the file system, and the paths themselves
+     * if they are directories. The other directories are taken from the journal as long as
+     * their mtime and inode did not change.
+     *
+     * This only applies to the next sync, the following ones walk the whole tree again.
+     * DatabaseAndFilesystem is ignored unless SyncOptions::_localDiscoveryFromJournal is set.
+     */
+    void setLocalDiscoveryOptions(LocalDiscoveryStyle style, const QStringList &paths = QStringList());
+    /** How the local tree was discovered by the last sync that was started */
+    LocalDiscoveryStyle lastLocalDiscoveryStyle() const { return _lastLocalDiscoveryStyle; }
+    /** Tunes the number of jobs the propagator runs in parallel, kept from one sync to the next */
+    ConcurrencyController &concurrencyController() { return _concurrency; }
     bool ignoreHiddenFiles() const { return _csync_ctx->ignore_hidden_files; }
     void setIgnoreHiddenFiles(bool ignore) { _csync_ctx->ignore_hidden_files = ignore; }
 
@@ -181,13 +200,21 @@ private:
     // Removes stale error blacklist entries from the journal.
     void deleteStaleErrorBlacklistEntries(const SyncFileItemVector &syncItems);
 
+    // Starts the discovery of the current round, the whole tree unless the sync goes in rounds
+    void startDiscovery(int fileRecordCount);
+    // After the first round of a sync in rounds: splits the top-level directories in rounds
+    void planSubtreeRounds();
+    // Continues a sync in rounds with the next one, once the previous one is propagated
+    void startNextRound();
+
     // cleanup and emit the finished signal
     void finalize(bool success);
 
     static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
 
-    // Must only be acessed during update and reconcile
-    QMap<QString, SyncFileItemPtr> _syncItemMap;
+    // Must only be acessed during update and reconcile. Unordered: the items are sorted
+    // once, after the tree walks.
+    QHash<QString, SyncFileItemPtr> _syncItemMap;
 
     AccountPtr _account;
     CSYNC *_csync_ctx;
@@ -240,6 +267,7 @@ private:
 
     bool _hasNoneFiles; // true if there is at least one file which was not changed on the server
     bool _hasRemoveFile; // true if there is at leasr one file with instruction REMOVE
+    bool _askedAboutRemovingAllFiles; // only once for all the rounds of a sync
     bool _hasForwardInTimeFiles; // true if there is at least one file from the server that goes forward in time
     int _backInTimeFiles; // number of files which goes back in time from the server
 
@@ -248,8 +276,26 @@ private:
     int _downloadLimit;
     SyncOptions _syncOptions;
 
+    // The number of jobs the propagators run in parallel, tuned over all the syncs
+    ConcurrencyController _concurrency;
+
+    LocalDiscoveryStyle _localDiscoveryStyle;
+    QStringList _localDiscoveryPaths;
+    LocalDiscoveryStyle _lastLocalDiscoveryStyle;
+
+    // The part of the tree the current round is about, see SyncOptions::_streamInitialSync
+    // and SyncOptions::_memoryBudget
+    SyncScope _syncScope;
+    // The top-level directories of the rounds still to come
+    QList<QStringList> _pendingRounds;
+    // The items of the rounds so far with transfer or blacklist entries in the journal
+    SyncFileItemVector _itemsOfRounds;
+
     // hash containing the permissions on the remote directory
     QHash<QString, QByteArray> _remotePerms;
+    // The few distinct remote permissions, shared by the items and _remotePerms
+    QSet<QByteArray> _remotePermValues;
+    QByteArray internRemotePerm(const char *perm);
 
     /// Hook for computing checksums from csync_update
     CSyncChecksumHook _checksum_hook;
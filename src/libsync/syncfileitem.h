@@ -69,7 +69,8 @@ public:
          _errorMayBeBlacklisted(false), _status(NoStatus),
         _isRestoration(false),
         _httpErrorCode(0), _affectedItems(1),
-        _instruction(CSYNC_INSTRUCTION_NONE), _modtime(0), _size(0), _inode(0)
+        _instruction(CSYNC_INSTRUCTION_NONE), _modtimeNsec(0), _ctimeNsec(0), _modtime(0), _ctime(0),
+        _size(0), _inode(0)
     {
     }
 
@@ -79,8 +80,8 @@ public:
 
     friend bool operator<(const SyncFileItem& item1, const SyncFileItem& item2) {
         // Sort by destination
-        auto d1 = item1.destination();
-        auto d2 = item2.destination();
+        const QString &d1 = item1.destination();
+        const QString &d2 = item2.destination();
 
         // But this we need to order it so the slash come first. It should be this order:
         //  "foo", "foo/bar", "foo-bar"
@@ -108,7 +109,7 @@ public:
         return data1[prefixL] < data2[prefixL];
     }
 
-    QString destination() const {
+    const QString &destination() const {
         if (!_renameTarget.isEmpty()) {
             return _renameTarget;
         }
@@ -158,20 +159,24 @@ public:
     Status               _status BITFIELD(4);
     bool                 _isRestoration BITFIELD(1); // The original operation was forbidden, and this is a restoration
     quint16              _httpErrorCode;
-    QString              _errorString; // Contains a string only in case of error
-    QByteArray           _responseTimeStamp;
     quint32              _affectedItems; // the number of affected items by the operation on this item.
      // usually this value is 1, but for removes on dirs, it might be much higher.
+    QString              _errorString; // Contains a string only in case of error
+    QByteArray           _responseTimeStamp;
 
     // Variables used by the propagator
+    // (the members smaller than a pointer are next to each other, there can be millions of items)
     csync_instructions_e _instruction;
-    QString              _originalFile; // as it is in the csync tree
+    qint32               _modtimeNsec; // of the local file, as seen by the discovery
+    qint32               _ctimeNsec;
+    QString              _originalFile; // as it is in the csync tree, shares its data with _file unless renamed
     time_t               _modtime;
+    time_t               _ctime; // status change time of the local file, as seen by the discovery
     QByteArray           _etag;
     quint64              _size;
     quint64              _inode;
     QByteArray           _fileId;
-    QByteArray           _remotePerm;
+    QByteArray           _remotePerm; // shared between the items with the same permissions
     QByteArray           _contentChecksum;
     QByteArray           _contentChecksumType;
     QString              _directDownloadUrl;
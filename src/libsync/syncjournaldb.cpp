@@ -288,6 +288,9 @@ bool SyncJournalDb::checkConnect()
                         // ignoredChildrenRemote
                         // contentChecksum
                         // contentChecksumTypeId
+                        // modtimeNsec
+                        // ctime
+                        // ctimeNsec
                          "PRIMARY KEY(phash)"
                          ");");
 
@@ -455,7 +458,7 @@ bool SyncJournalDb::checkConnect()
     _getFileRecordQuery.reset(new SqlQuery(_db));
     if (_getFileRecordQuery->prepare(
             "SELECT path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize,"
-            "  ignoredChildrenRemote, contentChecksum, contentchecksumtype.name"
+            "  ignoredChildrenRemote, contentChecksum, contentchecksumtype.name, modtimeNsec, ctime, ctimeNsec"
             " FROM metadata"
             "  LEFT JOIN checksumtype as contentchecksumtype ON metadata.contentChecksumTypeId == contentchecksumtype.id"
             " WHERE phash=?1" )) {
@@ -464,8 +467,8 @@ bool SyncJournalDb::checkConnect()
 
     _setFileRecordQuery.reset(new SqlQuery(_db) );
     if (_setFileRecordQuery->prepare("INSERT OR REPLACE INTO metadata "
-                                 "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId) "
-                                 "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16);" )) {
+                                 "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, modtimeNsec, ctime, ctimeNsec) "
+                                 "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19);" )) {
         return sqlFail("prepare _setFileRecordQuery", *_setFileRecordQuery);
     }
 
@@ -480,7 +483,7 @@ bool SyncJournalDb::checkConnect()
     _setFileRecordLocalMetadataQuery.reset(new SqlQuery(_db));
     if (_setFileRecordLocalMetadataQuery->prepare(
             "UPDATE metadata"
-            " SET inode=?2, modtime=?3, filesize=?4"
+            " SET inode=?2, modtime=?3, filesize=?4, modtimeNsec=?5, ctime=?6, ctimeNsec=?7"
             " WHERE phash == ?1;")) {
         return sqlFail("prepare _setFileRecordLocalMetadataQuery", *_setFileRecordLocalMetadataQuery);
     }
@@ -737,6 +740,36 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal("update database structure: add contentChecksumTypeId col");
     }
 
+    // Sub-second modification time and status change time of the local file.
+    // NULL in the existing rows: they are then compared with a second resolution.
+    if( columns.indexOf(QLatin1String("modtimeNsec")) == -1 ) {
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE metadata ADD COLUMN modtimeNsec INTEGER;");
+        if( !query.exec()) {
+            sqlFail("updateMetadataTableStructure: add modtimeNsec column", query);
+            re = false;
+        }
+        commitInternal("update database structure: add modtimeNsec col");
+    }
+    if( columns.indexOf(QLatin1String("ctime")) == -1 ) {
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE metadata ADD COLUMN ctime INTEGER(8);");
+        if( !query.exec()) {
+            sqlFail("updateMetadataTableStructure: add ctime column", query);
+            re = false;
+        }
+        commitInternal("update database structure: add ctime col");
+    }
+    if( columns.indexOf(QLatin1String("ctimeNsec")) == -1 ) {
+        SqlQuery query(_db);
+        query.prepare("ALTER TABLE metadata ADD COLUMN ctimeNsec INTEGER;");
+        if( !query.exec()) {
+            sqlFail("updateMetadataTableStructure: add ctimeNsec column", query);
+            re = false;
+        }
+        commitInternal("update database structure: add ctimeNsec col");
+    }
+
 
     return re;
 }
@@ -872,6 +905,9 @@ bool SyncJournalDb::setFileRecord( const SyncJournalFileRecord& _record )
         _setFileRecordQuery->bindValue(14, record._serverHasIgnoredFiles ? 1:0);
         _setFileRecordQuery->bindValue(15, record._contentChecksum );
         _setFileRecordQuery->bindValue(16, contentChecksumTypeId );
+        _setFileRecordQuery->bindValue(17, record._modtimeNsec );
+        _setFileRecordQuery->bindValue(18, record._ctime );
+        _setFileRecordQuery->bindValue(19, record._ctimeNsec );
 
         if( !_setFileRecordQuery->exec() ) {
             qWarning() << "Error SQL statement setFileRecord: " << _setFileRecordQuery->lastQuery() <<  " :"
@@ -882,7 +918,8 @@ bool SyncJournalDb::setFileRecord( const SyncJournalFileRecord& _record )
         qDebug() <<  _setFileRecordQuery->lastQuery() << phash << plen << record._path << record._inode
                  << QString::number(Utility::qDateTimeToTime_t(record._modtime)) << QString::number(record._type)
                  << record._etag << record._fileId << record._remotePerm << record._fileSize << (record._serverHasIgnoredFiles ? 1:0)
-                 << record._contentChecksum << record._contentChecksumType << contentChecksumTypeId;
+                 << record._contentChecksum << record._contentChecksumType << contentChecksumTypeId
+                 << record._modtimeNsec << record._ctime << record._ctimeNsec;
 
         _setFileRecordQuery->reset_and_clear_bindings();
         return true;
@@ -968,6 +1005,9 @@ SyncJournalFileRecord SyncJournalDb::getFileRecord(const QString& filename)
             if( !_getFileRecordQuery->nullValue(13) ) {
                 rec._contentChecksumType = _getFileRecordQuery->baValue(13);
             }
+            rec._modtimeNsec = _getFileRecordQuery->intValue(14);
+            rec._ctime = _getFileRecordQuery->int64Value(15);
+            rec._ctimeNsec = _getFileRecordQuery->intValue(16);
             _getFileRecordQuery->reset_and_clear_bindings();
         } else {
             int errId = _getFileRecordQuery->errorId();
@@ -986,6 +1026,28 @@ SyncJournalFileRecord SyncJournalDb::getFileRecord(const QString& filename)
     return rec;
 }
 
+static void appendSuperfluousRecords(SqlQuery &query,
+                                     const QSet<QString>& filepathsToKeep,
+                                     const QSet<QString>& prefixesToKeep,
+                                     QStringList *superfluousItems)
+{
+    while(query.next()) {
+        const QString file = query.stringValue(1);
+        bool keep = filepathsToKeep.contains(file);
+        if( !keep ) {
+            foreach( const QString & prefix, prefixesToKeep ) {
+                if( file.startsWith(prefix) ) {
+                    keep = true;
+                    break;
+                }
+            }
+        }
+        if( !keep ) {
+            superfluousItems->append(query.stringValue(0));
+        }
+    }
+}
+
 bool SyncJournalDb::postSyncCleanup(const QSet<QString>& filepathsToKeep,
                                     const QSet<QString>& prefixesToKeep)
 {
@@ -1005,23 +1067,53 @@ bool SyncJournalDb::postSyncCleanup(const QSet<QString>& filepathsToKeep,
     }
 
     QStringList superfluousItems;
+    appendSuperfluousRecords(query, filepathsToKeep, prefixesToKeep, &superfluousItems);
 
-    while(query.next()) {
-        const QString file = query.stringValue(1);
-        bool keep = filepathsToKeep.contains(file);
-        if( !keep ) {
-            foreach( const QString & prefix, prefixesToKeep ) {
-                if( file.startsWith(prefix) ) {
-                    keep = true;
-                    break;
-                }
-            }
+    return deleteSuperfluousRecords(superfluousItems);
+}
+
+bool SyncJournalDb::postSyncCleanup(const QSet<QString>& filepathsToKeep,
+                                    const QSet<QString>& prefixesToKeep,
+                                    const QStringList& subtrees)
+{
+    QMutexLocker locker(&_mutex);
+
+    if( !checkConnect() ) {
+        return false;
+    }
+
+    QStringList superfluousItems;
+    SqlQuery query(_db);
+    if (subtrees.isEmpty()) {
+        query.prepare("SELECT phash, path FROM metadata WHERE path NOT LIKE('%/%') AND type != 2"); // CSYNC_FTW_TYPE_DIR == 2
+        if (!query.exec()) {
+            QString err = query.error();
+            qDebug() << "Error creating prepared statement: " << query.lastQuery() << ", Error:" << err;
+            return false;
         }
-        if( !keep ) {
-            superfluousItems.append(query.stringValue(0));
+        appendSuperfluousRecords(query, filepathsToKeep, prefixesToKeep, &superfluousItems);
+    } else {
+        // The directory and what sorts between "dir/" and "dir0", '0' coming right after '/'.
+        // Unlike LIKE, this is case sensitive and uses the index.
+        query.prepare("SELECT phash, path FROM metadata WHERE (path == ?1 AND type == 2)"
+                      " OR (path > ?1||'/' AND path < ?1||'0')");
+        foreach (const QString &subtree, subtrees) {
+            query.reset_and_clear_bindings();
+            query.bindValue(1, subtree);
+            if (!query.exec()) {
+                QString err = query.error();
+                qDebug() << "Error creating prepared statement: " << query.lastQuery() << ", Error:" << err;
+                return false;
+            }
+            appendSuperfluousRecords(query, filepathsToKeep, prefixesToKeep, &superfluousItems);
         }
     }
 
+    return deleteSuperfluousRecords(superfluousItems);
+}
+
+bool SyncJournalDb::deleteSuperfluousRecords(const QStringList &superfluousItems)
+{
     if( superfluousItems.count() )  {
         QString sql = "DELETE FROM metadata WHERE phash in ("+ superfluousItems.join(",")+")";
         qDebug() << "Sync Journal cleanup: " << sql;
@@ -1065,6 +1157,31 @@ int SyncJournalDb::getFileRecordCount()
     return 0;
 }
 
+QHash<QString, int> SyncJournalDb::getTopLevelRecordCounts()
+{
+    QMutexLocker locker(&_mutex);
+
+    QHash<QString, int> counts;
+    if( !checkConnect() ) {
+        return counts;
+    }
+
+    SqlQuery query(_db);
+    query.prepare("SELECT substr(path, 1, instr(path || '/', '/') - 1), COUNT(*) FROM metadata"
+                  " WHERE type == 2 OR path LIKE('%/%') GROUP BY 1"); // CSYNC_FTW_TYPE_DIR == 2
+
+    if (!query.exec()) {
+        QString err = query.error();
+        qDebug() << "Error creating prepared statement: " << query.lastQuery() << ", Error:" << err;;
+        return counts;
+    }
+
+    while (query.next()) {
+        counts.insert(query.stringValue(0), query.intValue(1));
+    }
+    return counts;
+}
+
 bool SyncJournalDb::updateFileRecordChecksum(const QString& filename,
                                              const QByteArray& contentChecksum,
                                              const QByteArray& contentChecksumType)
@@ -1100,7 +1217,8 @@ bool SyncJournalDb::updateFileRecordChecksum(const QString& filename,
 }
 
 bool SyncJournalDb::updateLocalMetadata(const QString& filename,
-                                        qint64 modtime, quint64 size, quint64 inode)
+                                        qint64 modtime, quint64 size, quint64 inode,
+                                        qint32 modtimeNsec, qint64 ctime, qint32 ctimeNsec)
 
 {
     QMutexLocker locker(&_mutex);
@@ -1118,6 +1236,9 @@ bool SyncJournalDb::updateLocalMetadata(const QString& filename,
     query->bindValue(2, inode);
     query->bindValue(3, modtime);
     query->bindValue(4, size);
+    query->bindValue(5, modtimeNsec);
+    query->bindValue(6, ctime);
+    query->bindValue(7, ctimeNsec);
 
     if( !query->exec() ) {
         qWarning() << "Error SQL statement updateLocalMetadata: "
@@ -1127,7 +1248,7 @@ bool SyncJournalDb::updateLocalMetadata(const QString& filename,
     }
 
     qDebug() << query->lastQuery() << phash << inode
-             << modtime << size;
+             << modtime << size << modtimeNsec << ctime << ctimeNsec;
 
     query->reset_and_clear_bindings();
     return true;
@@ -1145,6 +1266,9 @@ bool SyncJournalDb::setFileRecordMetadata(const SyncJournalFileRecord& record)
     // Update the metadata on the existing record.
     existing._inode = record._inode;
     existing._modtime = record._modtime;
+    existing._modtimeNsec = record._modtimeNsec;
+    existing._ctime = record._ctime;
+    existing._ctimeNsec = record._ctimeNsec;
     existing._type = record._type;
     existing._etag = record._etag;
     existing._fileId = record._fileId;
@@ -58,11 +58,14 @@ public:
 
     bool deleteFileRecord( const QString& filename, bool recursively = false );
     int getFileRecordCount();
+    /// The number of records in each top-level directory, the directory itself included
+    QHash<QString, int> getTopLevelRecordCounts();
     bool updateFileRecordChecksum(const QString& filename,
                                   const QByteArray& contentChecksum,
                                   const QByteArray& contentChecksumType);
     bool updateLocalMetadata(const QString& filename,
-                             qint64 modtime, quint64 size, quint64 inode);
+                             qint64 modtime, quint64 size, quint64 inode,
+                             qint32 modtimeNsec, qint64 ctime, qint32 ctimeNsec);
     bool exists();
     void walCheckpoint();
 
@@ -148,6 +151,14 @@ public:
 
     bool postSyncCleanup(const QSet<QString>& filepathsToKeep,
                          const QSet<QString>& prefixesToKeep);
+    /**
+     * The same, after a sync that only saw a part of the tree: only the records in the
+     * given top-level directories are looked at, or the ones at the root that are not
+     * directories if \a subtrees is empty.
+     */
+    bool postSyncCleanup(const QSet<QString>& filepathsToKeep,
+                         const QSet<QString>& prefixesToKeep,
+                         const QStringList& subtrees);
 
     /* Because sqlite transactions are really slow, we encapsulate everything in big transactions
      * Commit will actually commit the transaction and create a new one.
@@ -190,6 +201,7 @@ private:
     void commitTransaction();
     QStringList tableColumns( const QString& table );
     bool checkConnect();
+    bool deleteSuperfluousRecords(const QStringList &superfluousItems);
 
     // Same as forceRemoteDiscoveryNextSync but without acquiring the lock
     void forceRemoteDiscoveryNextSyncLocked();
@@ -29,12 +29,13 @@
 namespace OCC {
 
 SyncJournalFileRecord::SyncJournalFileRecord()
-    :_inode(0), _type(0), _fileSize(0), _serverHasIgnoredFiles(false)
+    :_inode(0), _modtimeNsec(0), _ctime(0), _ctimeNsec(0), _type(0), _fileSize(0), _serverHasIgnoredFiles(false)
 {
 }
 
 SyncJournalFileRecord::SyncJournalFileRecord(const SyncFileItem &item, const QString &localFileName)
     : _path(item._file), _modtime(Utility::qDateTimeFromTime_t(item._modtime)),
+      _modtimeNsec(item._modtimeNsec), _ctime(item._ctime), _ctimeNsec(item._ctimeNsec),
       _type(item._type), _etag(item._etag), _fileId(item._fileId), _fileSize(item._size),
       _remotePerm(item._remotePerm), _serverHasIgnoredFiles(item._serverHasIgnoredFiles),
       _contentChecksum(item._contentChecksum),
@@ -80,6 +81,15 @@ SyncJournalFileRecord::SyncJournalFileRecord(const SyncFileItem &item, const QSt
         qWarning() << "Failed to query the 'inode' for file " << localFileName;
     } else {
         _inode = sb.st_ino;
+        if (!_ctime) {
+            // The discovery did not see this version of the file, the propagation just wrote it
+            _ctime = sb.st_ctime;
+#ifdef Q_OS_MAC
+            _ctimeNsec = sb.st_ctimespec.tv_nsec;
+#else
+            _ctimeNsec = sb.st_ctim.tv_nsec;
+#endif
+        }
     }
 #endif
     qDebug() << Q_FUNC_INFO << localFileName << "Retrieved inode " << _inode << "(previous item inode: " << item._inode << ")";
@@ -92,6 +102,9 @@ SyncFileItem SyncJournalFileRecord::toSyncFileItem()
     item._file = _path;
     item._inode = _inode;
     item._modtime = Utility::qDateTimeToTime_t(_modtime);
+    item._modtimeNsec = _modtimeNsec;
+    item._ctime = _ctime;
+    item._ctimeNsec = _ctimeNsec;
     item._type = static_cast<SyncFileItem::Type>(_type);
     item._etag = _etag;
     item._fileId = _fileId;
@@ -178,6 +191,9 @@ bool operator==(const SyncJournalFileRecord & lhs,
     return     lhs._path == rhs._path
             && lhs._inode == rhs._inode
             && lhs._modtime.toTime_t() == rhs._modtime.toTime_t()
+            && lhs._modtimeNsec == rhs._modtimeNsec
+            && lhs._ctime == rhs._ctime
+            && lhs._ctimeNsec == rhs._ctimeNsec
             && lhs._type == rhs._type
             && lhs._etag == rhs._etag
             && lhs._fileId == rhs._fileId
@@ -50,6 +50,9 @@ public:
     QString    _path;
     quint64    _inode;
     QDateTime  _modtime;
+    qint32     _modtimeNsec; // sub-second part of the local modtime, 0 if not known
+    qint64     _ctime; // status change time of the local file, 0 if not known
+    qint32     _ctimeNsec;
     int        _type;
     QByteArray _etag;
     QByteArray _fileId;
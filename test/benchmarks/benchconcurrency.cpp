@@ -0,0 +1,64 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+// Times the upload of many small files on simulated networks, to see how the propagator
+// tunes the number of jobs it runs in parallel. Its decisions are in the log. The same
+// uploads with a fixed number of jobs are the baseline.
+//
+// Usage: ConcurrencyBench [count]   (default: 300)
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+// Upload `count` files when each request takes `latency` ms, plus
+// `latencyPerRequestInFlight` ms for each other request in flight. With at most
+// `fixedLimit` jobs in parallel, or a tuned number if 0.
+static qint64 timeUpload(int count, int latency, int latencyPerRequestInFlight, int fixedLimit)
+{
+    FakeFolder fakeFolder{FileInfo{}};
+    if (fixedLimit) {
+        fakeFolder.syncEngine().concurrencyController() = ConcurrencyController(fixedLimit, fixedLimit);
+    }
+    for (int i = 0; i < count; ++i) {
+        const QString dir = QStringLiteral("dir") + QString::number(i / 100);
+        if (i % 100 == 0) {
+            fakeFolder.localModifier().mkdir(dir);
+        }
+        fakeFolder.localModifier().insert(dir + QStringLiteral("/file") + QString::number(i), 100);
+    }
+    fakeFolder.setRequestLatency(latency, latencyPerRequestInFlight);
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!fakeFolder.syncOnce()) {
+        qWarning() << "Sync failed";
+    }
+    return timer.elapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int count = argc > 1 ? atoi(argv[1]) : 300;
+
+    // A LAN, a link with a long round trip, and a congested link
+    const int networks[][2] = { { 1, 0 }, { 100, 0 }, { 20, 60 } };
+    // The limits before the tuning (6), the lowest one it goes to (2), and the tuned one (0)
+    const int limits[] = { 6, 2, 0 };
+    for (const auto &network : networks) {
+        for (int limit : limits) {
+            qint64 elapsed = timeUpload(count, network[0], network[1], limit);
+            qDebug() << "FILES" << count << "LATENCY" << network[0] << "ms"
+                     << "PER REQUEST IN FLIGHT" << network[1] << "ms"
+                     << "JOBS" << (limit ? QByteArray::number(limit) : QByteArray("tuned"))
+                     << "UPLOAD" << elapsed << "ms";
+        }
+    }
+    return 0;
+}
@@ -8,6 +8,12 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 
+#include <QElapsedTimer>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
 using namespace OCC;
 
 int numDirs = 0;
@@ -35,9 +41,36 @@ int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
     FakeFolder fakeFolder{FileInfo{}};
-    addBunchOfFiles<10, 8, 4>(0, "", fakeFolder.localModifier());
+    // Upload by default, "download" to have the items carry the remote metadata.
+    // About 50k files by default, "1m" for 1.1M files.
+    FileModifier &modifier = app.arguments().contains(QStringLiteral("download"))
+        ? fakeFolder.remoteModifier() : fakeFolder.localModifier();
+    if (app.arguments().contains(QStringLiteral("1m"))) {
+        addBunchOfFiles<10, 10, 5>(0, "", modifier);
+    } else {
+        addBunchOfFiles<10, 8, 4>(0, "", modifier);
+    }
 
     qDebug() << "NUMFILES" << numFiles;
     qDebug() << "NUMDIRS" << numDirs;
-    return fakeFolder.syncOnce() ? 0 : -1;
+
+    // The discovery, the reconcile and the creation of the sorted sync items are done
+    // when the propagation is about to start
+    QElapsedTimer timer;
+    qint64 untilPropagation = 0;
+    QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate,
+        [&](SyncFileItemVector &) { untilPropagation = timer.elapsed(); });
+    timer.start();
+    bool ok = fakeFolder.syncOnce();
+    qDebug() << "UNTIL_PROPAGATION_MS" << untilPropagation;
+    qDebug() << "TOTAL_MS" << timer.elapsed();
+
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        qDebug() << "MAXRSS_KB" << usage.ru_maxrss;
+        qDebug() << "MAXRSS_B_PER_ITEM" << usage.ru_maxrss * 1024 / (numFiles + numDirs);
+    }
+#endif
+    return ok ? 0 : -1;
 }
@@ -0,0 +1,120 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <dirent.h>
+#include <string.h>
+
+extern "C" {
+#include "csync.h"
+#include "vio/csync_vio_local.h"
+}
+
+int numDirs = 0;
+int numFiles = 0;
+
+template<int filesPerDir, int dirPerDir, int maxDepth>
+void addBunchOfFiles(int depth, const QString &path) {
+    for (int fileNum = 1; fileNum <= filesPerDir; ++fileNum) {
+        QFile file(path + "/file" + QString::number(fileNum));
+        file.open(QFile::WriteOnly);
+        file.write("x");
+        numFiles++;
+    }
+    if (depth >= maxDepth)
+        return;
+    for (int dirNum = 1; dirNum <= dirPerDir; ++dirNum) {
+        QString subPath = path + "/dir" + QString::number(dirNum);
+        QDir().mkdir(subPath);
+        numDirs++;
+        addBunchOfFiles<filesPerDir, dirPerDir, maxDepth>(depth + 1, subPath);
+    }
+}
+
+static bool isDotOrDotDot(const char *name) {
+    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
+// Read the directories and stat every entry by its full path, as the local vio
+// used to do
+static int walkByPath(const QByteArray &path) {
+    int count = 0;
+    DIR *dh = opendir(path.constData());
+    if (!dh)
+        return 0;
+    while (struct dirent *dirent = readdir(dh)) {
+        if (isDotOrDotDot(dirent->d_name))
+            continue;
+        QByteArray filename = path + '/' + dirent->d_name;
+        csync_vio_file_stat_t *stat = csync_vio_file_stat_new();
+        if (csync_vio_local_stat(filename.constData(), stat) == 0) {
+            ++count;
+            if (stat->type == CSYNC_VIO_FILE_TYPE_DIRECTORY)
+                count += walkByPath(filename);
+        }
+        csync_vio_file_stat_destroy(stat);
+    }
+    closedir(dh);
+    return count;
+}
+
+// Walk the tree like csync_ftw does with the local vio
+static int walkWithVio(const QByteArray &path) {
+    int count = 0;
+    csync_vio_handle_t *dh = csync_vio_local_opendir(path.constData());
+    if (!dh)
+        return 0;
+    while (csync_vio_file_stat_t *stat = csync_vio_local_readdir(dh)) {
+        if (stat->name && !isDotOrDotDot(stat->name)) {
+            QByteArray filename = path + '/' + stat->name;
+            if (csync_vio_local_stat(filename.constData(), stat) == 0) {
+                ++count;
+                if (stat->type == CSYNC_VIO_FILE_TYPE_DIRECTORY)
+                    count += walkWithVio(filename);
+            }
+        }
+        csync_vio_file_stat_destroy(stat);
+    }
+    csync_vio_local_closedir(dh);
+    return count;
+}
+
+template<typename Walk>
+static qint64 timeWalk(Walk walk, const QByteArray &root, int rounds, int *count) {
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < rounds; ++i)
+        *count = walk(root);
+    return timer.elapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTemporaryDir dir;
+    addBunchOfFiles<10, 6, 3>(0, dir.path());
+    const QByteArray root = QFile::encodeName(dir.path());
+    const int rounds = 20;
+
+    // warm up the caches, we measure the syscall cost, not the disk
+    int count = 0;
+    walkByPath(root);
+
+    qint64 byPath = timeWalk(walkByPath, root, rounds, &count);
+    qDebug() << "NUMDIRS" << numDirs << "NUMFILES" << numFiles << "ROUNDS" << rounds
+             << "STAT BY PATH" << byPath << "ms" << count << "entries";
+    qint64 withVio = timeWalk(walkWithVio, root, rounds, &count);
+    qDebug() << "NUMDIRS" << numDirs << "NUMFILES" << numFiles << "ROUNDS" << rounds
+             << "LOCAL VIO" << withVio << "ms" << count << "entries";
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+// Times how long the propagator takes to build its job tree and to schedule all of
+// its jobs, without the network: every file is ignored, so its job finishes at once.
+//
+// Usage: PropagatorBench [count]   (default: 1000000)
+
+#include <owncloudpropagator.h>
+#include <syncjournaldb.h>
+#include <account.h>
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QDebug>
+
+#include <algorithm>
+
+using namespace OCC;
+
+static SyncFileItemPtr makeItem(const QString &file, bool isDirectory)
+{
+    SyncFileItemPtr item(new SyncFileItem);
+    item->_file = file;
+    item->_isDirectory = isDirectory;
+    item->_type = isDirectory ? SyncFileItem::Directory : SyncFileItem::File;
+    item->_instruction = isDirectory ? CSYNC_INSTRUCTION_NONE : CSYNC_INSTRUCTION_IGNORE;
+    item->_direction = SyncFileItem::Up;
+    return item;
+}
+
+// `count` files, `filesPerDir` in each directory
+static SyncFileItemVector makeItems(int count, int filesPerDir)
+{
+    SyncFileItemVector items;
+    items.reserve(count + count / filesPerDir + 1);
+    for (int i = 0; i < count; ++i) {
+        const QString dir = QStringLiteral("dir") + QString::number(i / filesPerDir);
+        if (i % filesPerDir == 0) {
+            items.append(makeItem(dir, true));
+        }
+        items.append(makeItem(dir + QStringLiteral("/file") + QString::number(i), false));
+    }
+    std::sort(items.begin(), items.end());
+    return items;
+}
+
+static void run(const QString &localPath, SyncJournalDb *journal, int count, int filesPerDir)
+{
+    const SyncFileItemVector items = makeItems(count, filesPerDir);
+
+    ConcurrencyController concurrency;
+    OwncloudPropagator propagator(Account::create(), localPath, QString(), journal, &concurrency);
+    QEventLoop loop;
+    QObject::connect(&propagator, &OwncloudPropagator::finished, &loop, &QEventLoop::quit);
+
+    // start() builds the job tree, the scheduling happens in the event loop
+    QElapsedTimer timer;
+    timer.start();
+    propagator.start(items);
+    const qint64 build = timer.restart();
+    loop.exec();
+    const qint64 schedule = timer.elapsed();
+
+    qDebug() << "FILES" << count << "FILESPERDIR" << filesPerDir
+             << "BUILD" << build << "ms" << "SCHEDULE" << schedule << "ms";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int count = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    QTemporaryDir dir;
+    SyncJournalDb journal(dir.path() + "/._sync_bench.db");
+
+    // Many small directories, and everything in a single one
+    run(dir.path(), &journal, count, 1000);
+    run(dir.path(), &journal, count, count);
+    return 0;
+}
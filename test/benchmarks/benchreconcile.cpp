@@ -0,0 +1,121 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+// Times csync_reconcile_updates() on both replicas for several tree sizes and
+// numbers of reconcile threads. The trees are directories of 100 files, mostly
+// unchanged, with some files changed on either side and some only on one side.
+//
+// Usage: ReconcileBench [count...] [-t threads...]   (default: 10000 100000 1000000 -t 1 2 4 8)
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <string.h>
+
+extern "C" {
+#include "csync_private.h"
+#include "csync_reconcile.h"
+#include "std/c_jhash.h"
+}
+
+static void addEntry(CSYNC *ctx, c_htable_t *tree, const QByteArray &path, int type,
+    enum csync_instructions_e instruction)
+{
+    csync_file_stat_t *st = csync_file_stat_new(ctx, path.size());
+    memcpy(st->path, path.constData(), path.size() + 1);
+    st->pathlen = path.size();
+    st->phash = c_jhash64((uint8_t *)path.constData(), path.size(), 0);
+    st->type = type;
+    st->instruction = instruction;
+    c_htable_insert(tree, st);
+}
+
+static CSYNC *createContext(const QTemporaryDir &dir, int count)
+{
+    CSYNC *ctx;
+    csync_create(&ctx, QFile::encodeName(dir.path()).constData());
+    csync_init(ctx, QFile::encodeName(dir.path() + "/journal.db").constData());
+
+    for (int i = 0; i < count; ++i) {
+        if (i % 100 == 0) {
+            const QByteArray dirPath = "dir_" + QByteArray::number(i / 100);
+            addEntry(ctx, ctx->local.tree, dirPath, CSYNC_FTW_TYPE_DIR, CSYNC_INSTRUCTION_NONE);
+            addEntry(ctx, ctx->remote.tree, dirPath, CSYNC_FTW_TYPE_DIR, CSYNC_INSTRUCTION_NONE);
+        }
+        const QByteArray path = "dir_" + QByteArray::number(i / 100) + "/file_" + QByteArray::number(i % 100);
+        switch (i % 50) {
+        case 0:
+            addEntry(ctx, ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL);
+            addEntry(ctx, ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+            break;
+        case 1:
+            addEntry(ctx, ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+            addEntry(ctx, ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL);
+            break;
+        case 2:
+            addEntry(ctx, ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL);
+            break;
+        case 3:
+            addEntry(ctx, ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_EVAL);
+            break;
+        default:
+            addEntry(ctx, ctx->local.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+            addEntry(ctx, ctx->remote.tree, path, CSYNC_FTW_TYPE_FILE, CSYNC_INSTRUCTION_NONE);
+            break;
+        }
+    }
+    return ctx;
+}
+
+static qint64 timeReconcile(int count, int threads)
+{
+    QTemporaryDir dir;
+    CSYNC *ctx = createContext(dir, count);
+    ctx->reconcile_threads = threads;
+
+    QElapsedTimer timer;
+    timer.start();
+    ctx->current = LOCAL_REPLICA;
+    csync_reconcile_updates(ctx);
+    ctx->current = REMOTE_REPLICA;
+    csync_reconcile_updates(ctx);
+    qint64 elapsed = timer.elapsed();
+
+    csync_destroy(ctx);
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QList<int> counts;
+    QList<int> threadCounts;
+    bool readingThreads = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0) {
+            readingThreads = true;
+        } else {
+            (readingThreads ? threadCounts : counts).append(atoi(argv[i]));
+        }
+    }
+    if (counts.isEmpty())
+        counts << 10000 << 100000 << 1000000;
+    if (threadCounts.isEmpty())
+        threadCounts << 1 << 2 << 4 << 8;
+
+    qDebug() << "CORES" << QThread::idealThreadCount();
+    foreach (int count, counts) {
+        foreach (int threads, threadCounts) {
+            qDebug() << "FILES" << count << "THREADS" << threads << "RECONCILE" << timeReconcile(count, threads) << "ms";
+        }
+    }
+    return 0;
+}
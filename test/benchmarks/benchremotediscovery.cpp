@@ -0,0 +1,67 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+int numDirs = 0;
+int numFiles = 0;
+
+template<int filesPerDir, int dirPerDir, int maxDepth>
+void addBunchOfFiles(int depth, const QString &path, FileModifier &fi) {
+    for (int fileNum = 1; fileNum <= filesPerDir; ++fileNum) {
+        QString name = QStringLiteral("file") + QString::number(fileNum);
+        fi.insert(path.isEmpty() ? name : path + "/" + name);
+        numFiles++;
+    }
+    if (depth >= maxDepth)
+        return;
+    for (char dirNum = 1; dirNum <= dirPerDir; ++dirNum) {
+        QString name = QStringLiteral("dir") + QString::number(dirNum);
+        QString subPath = path.isEmpty() ? name : path + "/" + name;
+        fi.mkdir(subPath);
+        numDirs++;
+        addBunchOfFiles<filesPerDir, dirPerDir, maxDepth>(depth + 1, subPath, fi);
+    }
+}
+
+// Time the discovery of a remote tree when every PROPFIND takes `latency` ms,
+// with `parallelJobs` directory listings allowed in flight.
+static qint64 timeDiscovery(int parallelJobs, int latency)
+{
+    FakeFolder fakeFolder{FileInfo{}};
+    numDirs = numFiles = 0;
+    addBunchOfFiles<1, 6, 3>(0, "", fakeFolder.remoteModifier());
+
+    SyncOptions options;
+    options._parallelDiscoveryJobs = parallelJobs;
+    fakeFolder.syncEngine().setSyncOptions(options);
+    fakeFolder.setPropfindLatency(latency);
+
+    QElapsedTimer timer;
+    timer.start();
+    fakeFolder.scheduleSync();
+    fakeFolder.execUntilBeforePropagation();
+    qint64 elapsed = timer.elapsed();
+    fakeFolder.execUntilFinished();
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int latency = 80;
+
+    foreach (int parallelJobs, QList<int>() << 1 << 4 << 8 << 16) {
+        qint64 elapsed = timeDiscovery(parallelJobs, latency);
+        qDebug() << "NUMDIRS" << numDirs << "LATENCY" << latency << "ms"
+                 << "PARALLEL" << parallelJobs << "DISCOVERY" << elapsed << "ms";
+    }
+    return 0;
+}
@@ -305,7 +305,7 @@ class FakePropfindReply : public QNetworkReply
 public:
     QByteArray payload;
 
-    FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent, int latency = 0)
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
@@ -316,7 +316,7 @@ public:
         Q_ASSERT(!fileName.isNull()); // for root, it should be empty
         const FileInfo *fileInfo = remoteRootFileInfo.find(fileName);
         if (!fileInfo) {
-            QMetaObject::invokeMethod(this, "respond404", Qt::QueuedConnection);
+            QTimer::singleShot(latency, this, [this] { respond404(); });
             return;
         }
         QString prefix = request.url().path().left(request.url().path().size() - fileName.size());
@@ -364,7 +364,8 @@ public:
         xml.writeEndElement(); // multistatus
         xml.writeEndDocument();
 
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        // Simulates the round trip to the server
+        QTimer::singleShot(latency, this, [this] { respond(); });
     }
 
     Q_INVOKABLE void respond() {
@@ -396,12 +397,21 @@ public:
     }
 };
 
+// Calls respond() of the reply once the simulated round trip to the server is over
+inline void respondAfter(QNetworkReply *reply, int latency)
+{
+    if (latency > 0)
+        QTimer::singleShot(latency, reply, [reply] { QMetaObject::invokeMethod(reply, "respond"); });
+    else
+        QMetaObject::invokeMethod(reply, "respond", Qt::QueuedConnection);
+}
+
 class FakePutReply : public QNetworkReply
 {
     Q_OBJECT
     FileInfo *fileInfo;
 public:
-    FakePutReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QByteArray &putPayload, QObject *parent)
+    FakePutReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QByteArray &putPayload, QObject *parent, int latency = 0)
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
@@ -422,7 +432,7 @@ public:
             abort();
             return;
         }
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        respondAfter(this, latency);
     }
 
     Q_INVOKABLE void respond() {
@@ -444,7 +454,7 @@ class FakeMkcolReply : public QNetworkReply
     Q_OBJECT
     FileInfo *fileInfo;
 public:
-    FakeMkcolReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    FakeMkcolReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent, int latency = 0)
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
@@ -459,7 +469,7 @@ public:
             abort();
             return;
         }
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        respondAfter(this, latency);
     }
 
     Q_INVOKABLE void respond() {
@@ -477,7 +487,7 @@ class FakeDeleteReply : public QNetworkReply
 {
     Q_OBJECT
 public:
-    FakeDeleteReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    FakeDeleteReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent, int latency = 0)
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
@@ -487,7 +497,7 @@ public:
         QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isEmpty());
         remoteRootFileInfo.remove(fileName);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        respondAfter(this, latency);
     }
 
     Q_INVOKABLE void respond() {
@@ -504,7 +514,7 @@ class FakeMoveReply : public QNetworkReply
 {
     Q_OBJECT
 public:
-    FakeMoveReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    FakeMoveReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent, int latency = 0)
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
@@ -516,7 +526,7 @@ public:
         QString dest = getFilePathFromUrl(QUrl::fromEncoded(request.rawHeader("Destination")));
         Q_ASSERT(!dest.isEmpty());
         remoteRootFileInfo.rename(fileName, dest);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        respondAfter(this, latency);
     }
 
     Q_INVOKABLE void respond() {
@@ -535,9 +545,9 @@ class FakeGetReply : public QNetworkReply
 public:
     const FileInfo *fileInfo;
     char payload;
-    int size;
+    int size = 0;
 
-    FakeGetReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    FakeGetReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent, int latency = 0)
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
@@ -547,7 +557,7 @@ public:
         QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isEmpty());
         fileInfo = remoteRootFileInfo.find(fileName);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        respondAfter(this, latency);
     }
 
     Q_INVOKABLE void respond() {
@@ -561,6 +571,8 @@ public:
         emit metaDataChanged();
         if (bytesAvailable())
             emit readyRead();
+        // The body can still be read, if it was not yet because of bandwidth limits
+        setFinished(true);
         emit finished();
     }
 
@@ -583,7 +595,7 @@ class FakeChunkMoveReply : public QNetworkReply
 public:
     FakeChunkMoveReply(FileInfo &uploadsFileInfo, FileInfo &remoteRootFileInfo,
                        QNetworkAccessManager::Operation op, const QNetworkRequest &request,
-                       QObject *parent) : QNetworkReply{parent} {
+                       QObject *parent, int latency = 0) : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
         setOperation(op);
@@ -638,7 +650,7 @@ public:
             abort();
             return;
         }
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        respondAfter(this, latency);
     }
 
     Q_INVOKABLE void respond() {
@@ -666,13 +678,13 @@ class FakeErrorReply : public QNetworkReply
 {
     Q_OBJECT
 public:
-    FakeErrorReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    FakeErrorReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent, int latency = 0)
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
         setOperation(op);
         open(QIODevice::ReadOnly);
-        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+        respondAfter(this, latency);
     }
 
     Q_INVOKABLE void respond() {
@@ -691,19 +703,43 @@ class FakeQNAM : public QNetworkAccessManager
     FileInfo _remoteRootFileInfo;
     FileInfo _uploadFileInfo;
     QStringList _errorPaths;
+    int _propfindLatency = 0;
+    int _requestLatency = 0;
+    int _latencyPerRequestInFlight = 0;
+    int _requestsInFlight = 0;
+    int _maxRequestsInFlight = 0;
 public:
     FakeQNAM(FileInfo initialRoot) : _remoteRootFileInfo{std::move(initialRoot)} { }
     FileInfo &currentRemoteState() { return _remoteRootFileInfo; }
     FileInfo &uploadState() { return _uploadFileInfo; }
     QStringList &errorPaths() { return _errorPaths; }
+    // Delay in milliseconds before a PROPFIND reply is sent
+    void setPropfindLatency(int msec) { _propfindLatency = msec; }
+    // Delay in milliseconds before the other replies are sent, growing with the amount
+    // of requests in flight like on a congested link
+    void setRequestLatency(int msec, int msecPerRequestInFlight = 0) {
+        _requestLatency = msec;
+        _latencyPerRequestInFlight = msecPerRequestInFlight;
+    }
+    // The most requests that were in flight at the same time since the last reset
+    int maxRequestsInFlight() const { return _maxRequestsInFlight; }
+    void resetMaxRequestsInFlight() { _maxRequestsInFlight = _requestsInFlight; }
 
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request,
                                          QIODevice *outgoingData = 0) {
+        QNetworkReply *reply = createReply(op, request, outgoingData);
+        _maxRequestsInFlight = std::max(_maxRequestsInFlight, ++_requestsInFlight);
+        QObject::connect(reply, &QNetworkReply::finished, this, [this] { --_requestsInFlight; });
+        return reply;
+    }
+
+    QNetworkReply *createReply(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) {
         const QString fileName = getFilePathFromUrl(request.url());
         Q_ASSERT(!fileName.isNull());
+        const int latency = _requestLatency + _requestsInFlight * _latencyPerRequestInFlight;
         if (_errorPaths.contains(fileName))
-            return new FakeErrorReply{op, request, this};
+            return new FakeErrorReply{op, request, this, latency};
 
         bool isUpload = request.url().path().startsWith(sUploadUrl.path());
         FileInfo &info = isUpload ? _uploadFileInfo : _remoteRootFileInfo;
@@ -711,19 +747,19 @@ protected:
         auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute);
         if (verb == QLatin1String("PROPFIND"))
             // Ignore outgoingData always returning somethign good enough, works for now.
-            return new FakePropfindReply{info, op, request, this};
+            return new FakePropfindReply{info, op, request, this, _propfindLatency};
         else if (verb == QLatin1String("GET"))
-            return new FakeGetReply{info, op, request, this};
+            return new FakeGetReply{info, op, request, this, latency};
         else if (verb == QLatin1String("PUT"))
-            return new FakePutReply{info, op, request, outgoingData->readAll(), this};
+            return new FakePutReply{info, op, request, outgoingData->readAll(), this, latency};
         else if (verb == QLatin1String("MKCOL"))
-            return new FakeMkcolReply{info, op, request, this};
+            return new FakeMkcolReply{info, op, request, this, latency};
         else if (verb == QLatin1String("DELETE"))
-            return new FakeDeleteReply{info, op, request, this};
+            return new FakeDeleteReply{info, op, request, this, latency};
         else if (verb == QLatin1String("MOVE") && !isUpload)
-            return new FakeMoveReply{info, op, request, this};
+            return new FakeMoveReply{info, op, request, this, latency};
         else if (verb == QLatin1String("MOVE") && isUpload)
-            return new FakeChunkMoveReply{info, _remoteRootFileInfo, op, request, this};
+            return new FakeChunkMoveReply{info, _remoteRootFileInfo, op, request, this, latency};
         else {
             qDebug() << verb << outgoingData;
             Q_UNREACHABLE();
@@ -799,6 +835,10 @@ public:
     FileInfo &uploadState() { return _fakeQnam->uploadState(); }
 
     QStringList &serverErrorPaths() { return _fakeQnam->errorPaths(); }
+    void setPropfindLatency(int msec) { _fakeQnam->setPropfindLatency(msec); }
+    void setRequestLatency(int msec, int msecPerRequestInFlight = 0) { _fakeQnam->setRequestLatency(msec, msecPerRequestInFlight); }
+    int maxRequestsInFlight() const { return _fakeQnam->maxRequestsInFlight(); }
+    void resetMaxRequestsInFlight() { _fakeQnam->resetMaxRequestsInFlight(); }
 
     QString localPath() const {
         // SyncEngine wants a trailing slash
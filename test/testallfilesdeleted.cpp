@@ -112,6 +112,51 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
         QCOMPARE(fakeFolder.currentLocalState().children.count(), 0);
     }
+
+    void testAllFilesDeletedInRounds_data()
+    {
+        testAllFilesDeletedKeep_data();
+    }
+
+    /*
+     * Each round of a sync over the memory budget only sees a part of the tree: the user is
+     * asked once, when all the files of the whole tree are removed, and not when the files
+     * of one top-level directory are
+     */
+    void testAllFilesDeletedInRounds()
+    {
+        QFETCH(bool, deleteOnRemote);
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        SyncOptions options;
+        // Room for the three records of one directory only, the root has no files
+        options._memoryBudget = 6000;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        int aboutToRemoveAllFilesCalled = 0;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToRemoveAllFiles,
+            [&](SyncFileItem::Direction, bool *cancel) {
+                aboutToRemoveAllFilesCalled++;
+                *cancel = false;
+            });
+        auto &modifier = deleteOnRemote ? fakeFolder.remoteModifier() : fakeFolder.localModifier();
+
+        // A whole top-level directory
+        modifier.remove("A");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(aboutToRemoveAllFilesCalled, 0);
+        QVERIFY(!fakeFolder.currentLocalState().find("A"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("A"));
+        QVERIFY(fakeFolder.currentLocalState().find("B/b1"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // Everything else
+        for (const auto &s : fakeFolder.currentRemoteState().children.keys())
+            modifier.remove(s);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(aboutToRemoveAllFilesCalled, 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentLocalState().children.count(), 0);
+    }
 };
 
 QTEST_GUILESS_MAIN(TestAllFilesDeleted)
@@ -0,0 +1,122 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "concurrencycontroller.h"
+
+using namespace OCC;
+
+class TestConcurrencyController : public QObject
+{
+    Q_OBJECT
+
+    qint64 _now = 0;
+
+    // `count` requests of `latency` ms, one after the other
+    void addSamples(ConcurrencyController &controller, int count, qint64 latency,
+        qint64 bytes = 0, int failures = 0)
+    {
+        for (int i = 0; i < count; ++i) {
+            _now += latency;
+            controller.addSample(_now, latency, bytes, i < failures);
+        }
+    }
+
+private slots:
+    void testStartsAtTheMaximum()
+    {
+        ConcurrencyController controller(2, 6);
+        QCOMPARE(controller.limit(), 6);
+        addSamples(controller, 12, 20);
+        QCOMPARE(controller.limit(), 6);
+        QCOMPARE(controller.baselineLatency(), qint64(20));
+    }
+
+    void testErrors()
+    {
+        ConcurrencyController controller(2, 6);
+        // One in twelve is fine
+        addSamples(controller, 12, 20, 0, 1);
+        QCOMPARE(controller.limit(), 6);
+        addSamples(controller, 12, 20, 0, 2);
+        QCOMPARE(controller.limit(), 3);
+        addSamples(controller, 6, 20);
+        QCOMPARE(controller.limit(), 4);
+    }
+
+    void testLatency()
+    {
+        ConcurrencyController controller(2, 6);
+        addSamples(controller, 12, 20);
+        // Congested
+        addSamples(controller, 12, 200);
+        QCOMPARE(controller.limit(), 3);
+        QCOMPARE(controller.lastLatency(), qint64(200));
+        addSamples(controller, 6, 200);
+        QCOMPARE(controller.limit(), 2);
+        // Still as slow with as few jobs as possible: that is just the network
+        addSamples(controller, 4, 200);
+        QCOMPARE(controller.limit(), 2);
+        QCOMPARE(controller.baselineLatency(), qint64(200));
+        addSamples(controller, 4, 200);
+        QCOMPARE(controller.limit(), 3);
+
+        // Small differences do not matter on fast networks
+        ConcurrencyController lan(2, 6);
+        addSamples(lan, 12, 2);
+        addSamples(lan, 12, 40);
+        QCOMPARE(lan.limit(), 6);
+    }
+
+    void testCongestedFromTheStart()
+    {
+        ConcurrencyController controller(2, 6);
+        // Each request is slower with more requests in flight, only the first ones were alone
+        for (qint64 latency : { 20, 80, 140, 200, 260 })
+            addSamples(controller, 1, latency);
+        addSamples(controller, 7, 320);
+        QCOMPARE(controller.limit(), 6);
+        QCOMPARE(controller.baselineLatency(), qint64(80));
+        addSamples(controller, 12, 320);
+        QCOMPARE(controller.limit(), 3);
+    }
+
+    void testThroughput()
+    {
+        ConcurrencyController controller(2, 6);
+        addSamples(controller, 12, 20, 0, 2);
+        QCOMPARE(controller.limit(), 3);
+        addSamples(controller, 6, 1000, 1000 * 1000);
+        QCOMPARE(controller.limit(), 4);
+        QCOMPARE(controller.lastThroughput(), qint64(1000 * 1000));
+        // The additional job made it worse
+        addSamples(controller, 8, 2000, 1000 * 1000);
+        QCOMPARE(controller.limit(), 3);
+        // Not the consequence of an increase, so tried again
+        addSamples(controller, 6, 2000, 1000 * 1000);
+        QCOMPARE(controller.limit(), 4);
+    }
+
+    void testIdleTimeDoesNotCount()
+    {
+        ConcurrencyController controller(2, 6);
+        addSamples(controller, 12, 20, 0, 2);
+        QCOMPARE(controller.limit(), 3);
+        addSamples(controller, 6, 1000, 1000 * 1000);
+        QCOMPARE(controller.limit(), 4);
+        // The window goes over to the next sync, a minute later
+        addSamples(controller, 4, 1000, 1000 * 1000);
+        _now += 60 * 1000;
+        addSamples(controller, 4, 1000, 1000 * 1000);
+        QCOMPARE(controller.lastThroughput(), qint64(1000 * 1000));
+        QCOMPARE(controller.limit(), 5);
+    }
+};
+
+QTEST_APPLESS_MAIN(TestConcurrencyController)
+#include "testconcurrencycontroller.moc"
@@ -39,6 +39,27 @@ private slots:
         QVERIFY(excluded.isExcluded("/a/foo_conflict-bar", "/a", keepHidden));
         QVERIFY(excluded.isExcluded("/a/.b", "/a", excludeHidden));
     }
+
+    void testDirectoryCache()
+    {
+        c_strlist_t *excludeList = nullptr;
+        ExcludedFiles excluded(&excludeList);
+        bool keepHidden = false;
+
+        QVERIFY(!excluded.isExcluded("/a/build/x/file", "/a/", keepHidden));
+        QVERIFY(!excluded.isExcluded("/a/build/x/file2", "/a/", keepHidden));
+
+        // Changing the patterns drops the cached verdicts for the directories
+        excluded.addExcludeExpr("build/");
+        QVERIFY(excluded.isExcluded("/a/build/x/file", "/a/", keepHidden));
+        QVERIFY(excluded.isExcluded("/a/build/x/file2", "/a/", keepHidden));
+        QVERIFY(excluded.isExcluded("/a/src/build/file", "/a/", keepHidden));
+        QVERIFY(!excluded.isExcluded("/a/src/file", "/a/", keepHidden));
+
+        // Hidden directories are only excluded when asked for
+        QVERIFY(!excluded.isExcluded("/a/.hidden/file", "/a/", keepHidden));
+        QVERIFY(excluded.isExcluded("/a/.hidden/file", "/a/", true));
+    }
 };
 
 QTEST_APPLESS_MAIN(TestExcludedFiles)
@@ -0,0 +1,146 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+class TestLocalDiscovery : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    // Only the directories containing a changed path are read from the file system
+    void testLocalDiscoveryStyle()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        SyncOptions options;
+        options._localDiscoveryFromJournal = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        // Changing the contents of a file does not change the mtime of its directory
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.localModifier().appendByte("B/b1");
+
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(DatabaseAndFilesystem, QStringList() << "A/a1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.syncEngine().lastLocalDiscoveryStyle(), DatabaseAndFilesystem);
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a1")->size, fakeFolder.currentLocalState().find("A/a1")->size);
+        QVERIFY(fakeFolder.currentRemoteState().find("B/b1")->size != fakeFolder.currentLocalState().find("B/b1")->size);
+
+        // The options only apply to one sync, the next one walks the whole tree
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.syncEngine().lastLocalDiscoveryStyle(), FilesystemOnly);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Reading directories from the journal is opt-in, without the option the whole tree is walked
+    void testLocalDiscoveryFromJournalOption_data()
+    {
+        QTest::addColumn<bool>("fromJournal");
+        QTest::newRow("off") << false;
+        QTest::newRow("on") << true;
+    }
+
+    void testLocalDiscoveryFromJournalOption()
+    {
+        QFETCH(bool, fromJournal);
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        QCOMPARE(SyncOptions()._localDiscoveryFromJournal, false);
+        SyncOptions options;
+        options._localDiscoveryFromJournal = fromJournal;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        fakeFolder.localModifier().appendByte("B/b1");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(DatabaseAndFilesystem, QStringList() << "A/a1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.syncEngine().lastLocalDiscoveryStyle(), fromJournal ? DatabaseAndFilesystem : FilesystemOnly);
+        QCOMPARE(fakeFolder.currentRemoteState().find("B/b1")->size == fakeFolder.currentLocalState().find("B/b1")->size, !fromJournal);
+    }
+
+    // A changed directory is read from the file system completely
+    void testChangedDirectory()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        SyncOptions options;
+        options._localDiscoveryFromJournal = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        fakeFolder.localModifier().mkdir("A/Y");
+        fakeFolder.localModifier().insert("A/Y/y1");
+        fakeFolder.localModifier().appendByte("B/b1");
+
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(DatabaseAndFilesystem, QStringList() << "A/Y");
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentRemoteState().find("A/Y/y1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("B/b1")->size != fakeFolder.currentLocalState().find("B/b1")->size);
+
+        // The root marks everything as changed
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(DatabaseAndFilesystem, QStringList() << "");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Directories read from the journal are not removed if removed on the server, they
+    // may contain ignored files. The next full discovery takes care of them.
+    void testRemoteRemoveOfUnchangedDirectory()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        SyncOptions options;
+        options._localDiscoveryFromJournal = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        fakeFolder.remoteModifier().remove("B");
+
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(DatabaseAndFilesystem, QStringList());
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentLocalState().find("B"));
+        QVERIFY(!fakeFolder.currentLocalState().find("B/b1"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("B"));
+
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(!fakeFolder.currentLocalState().find("B"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("B"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Directories listed ahead by several threads give the same result
+    void testParallelLocalDiscovery()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        SyncOptions options;
+        options._localDiscoveryThreads = 4;
+        options._localDiscoveryFromJournal = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        fakeFolder.localModifier().mkdir("Y");
+        fakeFolder.localModifier().mkdir("Y/Z");
+        fakeFolder.localModifier().insert("Y/Z/d0");
+        fakeFolder.localModifier().insert("A/a0");
+        fakeFolder.localModifier().appendByte("C/c1");
+        fakeFolder.localModifier().remove("B/b2");
+        fakeFolder.localModifier().rename("S/s1", "Y/s1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // Only the changed directories are listed
+        fakeFolder.localModifier().insert("Y/Z/d1");
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(DatabaseAndFilesystem, QStringList() << "Y/Z/d1");
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(fakeFolder.currentRemoteState().find("Y/Z/d1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("A/a1")->size != fakeFolder.currentLocalState().find("A/a1")->size);
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestLocalDiscovery)
+#include "testlocaldiscovery.moc"
@@ -121,6 +121,129 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    // Checksums of touched files of any type are compared in the background
+    void testLocalChecksumThreads() {
+        FakeFolder fakeFolder{FileInfo{}};
+        SyncOptions options;
+        options._discoveryChecksumThreads = 2;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.localModifier().mkdir("A");
+        fakeFolder.localModifier().mkdir("A/B");
+        fakeFolder.localModifier().mkdir("C");
+        fakeFolder.localModifier().insert("A/a1.txt", 64, 'A');
+        fakeFolder.localModifier().insert("A/a2.txt", 64, 'A');
+        fakeFolder.localModifier().insert("A/B/b1.txt", 64, 'A');
+        fakeFolder.localModifier().insert("C/c1.txt", 64, 'A');
+        // Upload and calculate the checksums
+        QVERIFY(fakeFolder.syncOnce());
+
+        QSignalSpy completeSpy(&fakeFolder.syncEngine(), SIGNAL(itemCompleted(const SyncFileItemPtr &)));
+        // Touch files without changing the content, they shouldn't be uploaded
+        fakeFolder.localModifier().setContents("A/a1.txt", 'A');
+        fakeFolder.localModifier().setContents("C/c1.txt", 'A');
+        // Change the content of a file in a sub directory
+        fakeFolder.localModifier().setContents("A/B/b1.txt", 'B');
+        // A directory removed on the server is removed even if a file in it was touched
+        fakeFolder.remoteModifier().remove("C");
+        QVERIFY(fakeFolder.syncOnce());
+
+        QVERIFY(!itemDidComplete(completeSpy, "A/a1.txt"));
+        QVERIFY(!itemDidComplete(completeSpy, "A/a2.txt"));
+        QVERIFY(itemDidCompleteSuccessfully(completeSpy, "A/B/b1.txt"));
+        QVERIFY(itemDidCompleteSuccessfully(completeSpy, "C"));
+        QVERIFY(!fakeFolder.currentLocalState().find("C"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // The first sync propagates the files at the root, then each top-level directory on its own
+    void testStreamInitialSync() {
+        FakeFolder fakeFolder{FileInfo{}};
+        SyncOptions options;
+        options._streamInitialSync = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().insert("r1");
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().mkdir("A/sub");
+        fakeFolder.remoteModifier().insert("A/sub/a1");
+        fakeFolder.remoteModifier().mkdir("B");
+        fakeFolder.remoteModifier().insert("B/b1");
+        fakeFolder.localModifier().insert("l1");
+        fakeFolder.localModifier().mkdir("C");
+        fakeFolder.localModifier().insert("C/c1");
+
+        QList<QStringList> rounds;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate,
+            [&](SyncFileItemVector &items) {
+                QStringList files;
+                for (const auto &item : items)
+                    files.append(item->_file);
+                rounds.append(files);
+            });
+        QSignalSpy finishedSpy(&fakeFolder.syncEngine(), SIGNAL(finished(bool)));
+        QVERIFY(fakeFolder.syncOnce());
+
+        QCOMPARE(finishedSpy.count(), 1);
+        QCOMPARE(rounds.size(), 4);
+        QCOMPARE(rounds[0], QStringList({ "l1", "r1" }));
+        QCOMPARE(rounds[1], QStringList({ "A", "A/sub", "A/sub/a1" }));
+        QCOMPARE(rounds[2], QStringList({ "B", "B/b1" }));
+        QCOMPARE(rounds[3], QStringList({ "C", "C/c1" }));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // The journal is not empty anymore: the next sync is a normal one
+        rounds.clear();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(rounds.size(), 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testSyncInRoundsOverMemoryBudget() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        SyncOptions options;
+        // Room for the three records of one directory only
+        options._memoryBudget = 6000;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        fakeFolder.localModifier().insert("B/b3");
+        fakeFolder.remoteModifier().remove("C/c1");
+        fakeFolder.remoteModifier().remove("S");
+        fakeFolder.localModifier().remove("S");
+
+        QList<QStringList> rounds;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate,
+            [&](SyncFileItemVector &items) {
+                QStringList files;
+                for (const auto &item : items)
+                    files.append(item->_file);
+                rounds.append(files);
+            });
+        QSignalSpy finishedSpy(&fakeFolder.syncEngine(), SIGNAL(finished(bool)));
+        QVERIFY(fakeFolder.syncOnce());
+
+        // The root, A, B, C, and S that is only left in the journal
+        QCOMPARE(finishedSpy.count(), 1);
+        QCOMPARE(rounds.size(), 5);
+        QVERIFY(rounds[1].contains("A/a1"));
+        QVERIFY(rounds[2].contains("B/b3"));
+        QVERIFY(rounds[3].contains("C/c1"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // Each round cleaned up its own part of the journal only
+        auto journal = fakeFolder.syncEngine().journal();
+        QVERIFY(!journal->getFileRecord("C/c1").isValid());
+        QVERIFY(!journal->getFileRecord("S/s1").isValid());
+        QVERIFY(journal->getFileRecord("C/c2").isValid());
+        QVERIFY(journal->getFileRecord("B/b3").isValid());
+
+        // Nothing is left for a sync of the whole tree
+        fakeFolder.syncEngine().setSyncOptions(SyncOptions());
+        QSignalSpy completeSpy(&fakeFolder.syncEngine(), SIGNAL(itemCompleted(const SyncFileItemPtr &)));
+        rounds.clear();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(rounds.size(), 1);
+        QCOMPARE(completeSpy.count(), 0);
+    }
+
     void testRemoteChangeInMovedFolder() {
         // issue #5192
         FakeFolder fakeFolder{FileInfo{ QString(), {
@@ -148,6 +271,122 @@ private slots:
 
     }
 
+    void testMoveOutOfMovedDirectory() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.localModifier().rename("A", "X");
+        fakeFolder.localModifier().rename("X/a1", "B/a1");
+        QStringList completed;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted,
+            [&](const SyncFileItemPtr &item) { completed.append(item->destination()); });
+        QVERIFY(fakeFolder.syncOnce());
+        // B sorts first, but the file is only in X on the server once A was moved there
+        QVERIFY(completed.indexOf("X") >= 0);
+        QVERIFY(completed.indexOf("X") < completed.indexOf("B/a1"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.currentRemoteState().find("B/a1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("X/a2"));
+    }
+
+    void testMoveDirectoryOutOfMovedDirectory() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.localModifier().mkdir("A/s");
+        fakeFolder.localModifier().insert("A/s/s1");
+        QVERIFY(fakeFolder.syncOnce());
+
+        fakeFolder.localModifier().rename("A", "X");
+        fakeFolder.localModifier().rename("X/s", "B/s");
+        // The move to B/s is created first and waits for the move to X, which comes after it
+        QSignalSpy finished(&fakeFolder.syncEngine(), SIGNAL(finished(bool)));
+        fakeFolder.scheduleSync();
+        QVERIFY(finished.wait(10000));
+        QCOMPARE(finished.first().first().toBool(), true);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.currentRemoteState().find("B/s/s1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("X/a1"));
+    }
+
+    void testNewDirectoryWhereOneWasMovedAway() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.localModifier().rename("B", "Z");
+        fakeFolder.localModifier().mkdir("B");
+        fakeFolder.localModifier().insert("B/new");
+        // The new B is created first and waits for the move of the old one to Z
+        QSignalSpy finished(&fakeFolder.syncEngine(), SIGNAL(finished(bool)));
+        fakeFolder.scheduleSync();
+        QVERIFY(finished.wait(10000));
+        QCOMPARE(finished.first().first().toBool(), true);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.currentRemoteState().find("Z/b1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("B/new"));
+    }
+
+    void testCyclicDirectoryMoves() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.localModifier().rename("A", "tmpA");
+        fakeFolder.localModifier().rename("B", "tmpB");
+        fakeFolder.localModifier().mkdir("A");
+        fakeFolder.localModifier().mkdir("B");
+        fakeFolder.localModifier().rename("tmpA", "B/C");
+        fakeFolder.localModifier().rename("tmpB", "A/D");
+        // The moves of A to B/C and of B to A/D wait for each other: they fail instead of
+        // holding up the sync forever
+        QSignalSpy finished(&fakeFolder.syncEngine(), SIGNAL(finished(bool)));
+        fakeFolder.scheduleSync();
+        QVERIFY(finished.wait(10000));
+        // Nothing was lost on the server
+        QVERIFY(fakeFolder.currentRemoteState().find("A/a1"));
+        QVERIFY(fakeFolder.currentRemoteState().find("B/b1"));
+    }
+
+    void testSmallFilesFirst() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.remoteModifier().insert("A/a_big", 200 * 1024);
+        fakeFolder.remoteModifier().insert("A/z_small", 10);
+        QStringList completed;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted,
+            [&](const SyncFileItemPtr &item) { completed.append(item->destination()); });
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(completed.indexOf("A/z_small") >= 0);
+        QVERIFY(completed.indexOf("A/z_small") < completed.indexOf("A/a_big"));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testParallelDownloadsWithBandwidthLimit() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        for (int i = 0; i < 6; ++i)
+            fakeFolder.remoteModifier().insert("A/new" + QString::number(i), 20 * 1000);
+        fakeFolder.syncEngine().setNetworkLimits(0, 200 * 1000);
+        fakeFolder.scheduleSync();
+        fakeFolder.execUntilBeforePropagation();
+        fakeFolder.resetMaxRequestsInFlight();
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(fakeFolder.execUntilFinished());
+        // The limit is shared by the downloads instead of making them wait for each other
+        QVERIFY(fakeFolder.maxRequestsInFlight() > 1);
+        // 120kB at 200kB/s
+        QVERIFY(timer.elapsed() >= 400);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // The propagators of all the syncs tune the same number of parallel jobs
+    void testConcurrencyTunedAcrossSyncs() {
+        FakeFolder fakeFolder{FileInfo{}};
+        const ConcurrencyController &concurrency = fakeFolder.syncEngine().concurrencyController();
+
+        // Each sync has fewer uploads than it takes to decide on the limit
+        for (int i = 0; i < 6; ++i)
+            fakeFolder.localModifier().insert("a" + QString::number(i));
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(concurrency.lastLatency(), qint64(-1));
+
+        for (int i = 0; i < 6; ++i)
+            fakeFolder.localModifier().insert("b" + QString::number(i));
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(concurrency.lastLatency() >= 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
     void testSelectiveSyncModevFolder() {
         // issue #5224
         FakeFolder fakeFolder{FileInfo{ QString(), {
@@ -224,6 +463,33 @@ private slots:
         QCOMPARE(finishedSpy.size(), 1);
         QCOMPARE(finishedSpy.first().first().toBool(), false);
     }
+
+    void testParallelRemoteDiscovery() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        SyncOptions options;
+        options._parallelDiscoveryJobs = 4;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.setPropfindLatency(5);
+
+        fakeFolder.remoteModifier().mkdir("Y");
+        fakeFolder.remoteModifier().mkdir("Y/Z");
+        fakeFolder.remoteModifier().insert("Y/Z/d0");
+        fakeFolder.remoteModifier().insert("A/a0");
+        fakeFolder.remoteModifier().appendByte("C/c1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // A listing that fails while being fetched ahead of time must not matter
+        // as long as the directory is not actually needed.
+        fakeFolder.serverErrorPaths().append("B");
+        fakeFolder.remoteModifier().insert("A/a3");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // But it must if the directory changed.
+        fakeFolder.remoteModifier().insert("B/b3");
+        QVERIFY(!fakeFolder.syncOnce());
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncEngine)
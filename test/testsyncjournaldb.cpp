@@ -53,6 +53,9 @@ private slots:
         record._fileId = "abcd";
         record._remotePerm = "744";
         record._fileSize = 213089055;
+        record._modtimeNsec = 123456789;
+        record._ctime = 1480000000;
+        record._ctimeNsec = 42;
         record._contentChecksum = "mychecksum";
         record._contentChecksumType = "MD5";
         QVERIFY(_db.setFileRecord(record));
@@ -75,6 +78,9 @@ private slots:
         record._fileId = "efg";
         record._remotePerm = "777";
         record._fileSize = 289055;
+        record._modtimeNsec = 987654321;
+        record._ctime = 1480000001;
+        record._ctimeNsec = 0;
         _db.setFileRecordMetadata(record);
         storedRecord = _db.getFileRecord("foo");
         QVERIFY(storedRecord == record);
@@ -439,6 +439,88 @@ private slots:
         QVERIFY(_subdirs.size() == 1);
     }
 
+    void testParserIncremental() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004213ocobzus5kn6s</oc:id>"
+              "<oc:size>121780</oc:size>"
+              "<d:getetag>\"5527beb0400b0\"</d:getetag>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/quitte%20t%C3%A4st.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004215ocobzus5kn6s</oc:id>"
+              "<d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>"
+              "<d:resourcetype/>"
+              "<d:getcontentlength>121780</d:getcontentlength>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+
+        connect( &parser, SIGNAL(directoryListingSubfolders(const QStringList&)),
+                 this, SLOT(slotDirectoryListingSubFolders(const QStringList&)) );
+        connect( &parser, SIGNAL(directoryListingIterated(const QString&, const QMap<QString,QString>&)),
+                 this, SLOT(slotDirectoryListingIterated(const QString&, const QMap<QString,QString>&)) );
+        connect( &parser, SIGNAL(finishedWithoutError()),
+                 this, SLOT(slotFinishedSuccessfully()) );
+
+        QHash <QString, qint64> sizes;
+        parser.start(&sizes, "/oc/remote.php/webdav/sharefolder");
+
+        // Feed the reply in small chunks, splitting tags and texts
+        const int secondResponse = testXml.indexOf("<d:response>", testXml.indexOf("</d:response>"));
+        bool checkedFirstEntry = false;
+        for (int pos = 0; pos < testXml.size(); pos += 3) {
+            if (pos >= secondResponse && !checkedFirstEntry) {
+                // The first entry is complete, it must be known before the reply is
+                QCOMPARE(_items.size(), 1);
+                checkedFirstEntry = true;
+            }
+            QVERIFY(parser.addData(testXml.mid(pos, 3)));
+        }
+        QVERIFY(!_success);
+        QVERIFY(parser.finish());
+
+        QVERIFY(_success);
+        QCOMPARE(sizes.size(), 1);
+        QCOMPARE(_items.size(), 2);
+        QVERIFY(_items.contains("/oc/remote.php/webdav/sharefolder"));
+        QVERIFY(_items.contains(QString::fromUtf8("/oc/remote.php/webdav/sharefolder/quitte täst.pdf")));
+        QCOMPARE(_subdirs.size(), 1);
+    }
+
+    void testParserIncrementalTruncated() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>";
+
+        LsColXMLParser parser;
+        connect( &parser, SIGNAL(finishedWithoutError()),
+                 this, SLOT(slotFinishedSuccessfully()) );
+
+        QHash <QString, qint64> sizes;
+        parser.start(&sizes, "/oc/remote.php/webdav/sharefolder");
+        QVERIFY(parser.addData(testXml)); // Could be continued
+        QVERIFY(!parser.finish()); // But it was not
+        QVERIFY(!_success);
+    }
+
 };
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)